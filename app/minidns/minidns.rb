@@ -94,6 +94,7 @@ class DNSServer
   def mainloop
     bind_socket
     connect_to_server
+    served = 0
     while true
       towait = true
       begin
@@ -101,8 +102,14 @@ class DNSServer
 	p alist
 	y = receive_query(x)
 	@client_sock.send(y, 0, alist[3], alist[1])
+        served += 1
         nowait = false
       rescue Errno::EWOULDBLOCK
+        # idle after a burst of queries: give the sparse heap pages back
+        if served >= 1000
+          GC.compact
+          served = 0
+        end
       end
       sleep 0.01 if towait
     end
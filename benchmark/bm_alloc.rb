@@ -0,0 +1,17 @@
+# Allocation throughput: short-lived strings, arrays, hashes and objects
+
+class Point
+  def initialize(x, y)
+    @x = x
+    @y = y
+  end
+end
+
+i = 0
+while i < 2_000_000
+  s = "abc"
+  a = [i, s]
+  h = {:k => a}
+  o = Point.new(i, h)
+  i += 1
+end
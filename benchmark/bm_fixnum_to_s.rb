@@ -0,0 +1,15 @@
+# Fixnum formatting: to_s, interpolation and Array#join
+
+a = []
+i = 0
+while i < 1000
+  a << i * 7919
+  i += 1
+end
+
+n = 0
+while n < 300
+  a.each { |x| x.to_s; "id=#{x}" }
+  a.join(",")
+  n += 1
+end
@@ -0,0 +1,14 @@
+# Float#to_s on random doubles spread over many magnitudes
+
+floats = []
+i = 0
+while i < 1000
+  floats << rand * 10.0 ** (rand(60) - 30)
+  i += 1
+end
+
+n = 0
+while n < 500
+  floats.each { |f| f.to_s }
+  n += 1
+end
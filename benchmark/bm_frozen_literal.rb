@@ -0,0 +1,13 @@
+# frozen_string_literal: true
+# Constant header names and keys built in a loop; with the magic
+# comment above each literal is one shared object, without it every
+# evaluation allocates a copy
+
+h = {}
+i = 0
+while i < 1000000
+  h["Content-Type"] = "text/plain"
+  h["Content-Length"] = "0"
+  h["Connection"] = "keep-alive"
+  i += 1
+end
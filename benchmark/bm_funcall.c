@@ -0,0 +1,77 @@
+/*
+** bm_funcall.c - calls from C: mrb_funcall, mrb_funcall_id, and a
+** call handle inside mrb_protect
+**
+**   cc -Iinclude benchmark/bm_funcall.c build/host/lib/libmruby.a -lm -o bm_funcall
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "mruby.h"
+#include "mruby/compile.h"
+
+#define N 3000000
+
+static double
+now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static mrb_value
+loop_handle(mrb_state *mrb, mrb_value obj)
+{
+  mrb_call_handle h;
+  mrb_value v = mrb_nil_value(), a = mrb_fixnum_value(1);
+  int i;
+
+  mrb_call_handle_init(mrb, &h, mrb_intern_lit(mrb, "add"));
+  for (i=0; i<N; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    v = mrb_funcall_handle(mrb, &h, obj, 1, &a);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return v;
+}
+
+int
+main(void)
+{
+  mrb_state *mrb = mrb_open();
+  mrb_value obj, v = mrb_nil_value();
+  mrb_sym add;
+  mrb_bool state;
+  double t;
+  int i;
+
+  obj = mrb_load_string(mrb,
+    "class Foo; def initialize; @n=0; end; def add(x); @n+=x; end; end; Foo.new");
+  add = mrb_intern_lit(mrb, "add");
+
+  t = now();
+  for (i=0; i<N; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    v = mrb_funcall(mrb, obj, "add", 1, mrb_fixnum_value(1));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  printf("mrb_funcall            %.3fs\n", now() - t);
+
+  t = now();
+  for (i=0; i<N; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    v = mrb_funcall_id(mrb, obj, add, 1, mrb_fixnum_value(1));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  printf("mrb_funcall_id         %.3fs\n", now() - t);
+
+  t = now();
+  v = mrb_protect(mrb, loop_handle, obj, &state);
+  printf("handle in mrb_protect  %.3fs\n", now() - t);
+  printf("@n = %d\n", (int)mrb_fixnum(v));
+
+  mrb_close(mrb);
+  return state ? 1 : 0;
+}
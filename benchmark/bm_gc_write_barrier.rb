@@ -0,0 +1,11 @@
+# Minor GC cost when a large old Array keeps receiving young objects
+
+GC.generational_mode = true
+big = Array.new(1_000_000, 0)
+GC.start
+
+i = 0
+while i < 1_000_000
+  big[i % 100] = "x"
+  i += 1
+end
@@ -0,0 +1,8 @@
+# Hash literals with Symbol, Fixnum and String keys
+
+n = 0
+while n < 300000
+  h = { :a => n, :b => 2, :c => 3, 1 => "x", 2 => "y", "k" => n }
+  h = { :id => n, :name => "foo" }
+  n += 1
+end
@@ -0,0 +1,18 @@
+# Hash lookups with String keys: a fixed set of key objects, reused
+
+keys = []
+i = 0
+while i < 1000
+  keys << "user_session_key_#{i}"
+  i += 1
+end
+
+h = {}
+keys.each { |k| h[k] = k.size }
+
+n = 0
+sum = 0
+while n < 300
+  keys.each { |k| sum += h[k] }
+  n += 1
+end
@@ -0,0 +1,18 @@
+# Calls passing keyword arguments
+
+def kw(a, timeout: 1, retry_count: 0)
+  a + timeout + retry_count
+end
+
+def opts(a, h)
+  a + h[:timeout]
+end
+
+n = 0
+while n < 1000000
+  kw(n, timeout: 2)
+  kw(n, timeout: 2, retry_count: 3)
+  kw(n)
+  opts(n, timeout: 2)
+  n += 1
+end
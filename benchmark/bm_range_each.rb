@@ -0,0 +1,10 @@
+# Fixnum range iteration, membership and to_a
+
+sum = 0
+n = 0
+while n < 100
+  (0...10000).each { |i| sum += i }
+  sum += 1 if (0..100).include?(n)
+  (0...1000).to_a
+  n += 1
+end
@@ -0,0 +1,25 @@
+# Splitting and trimming an HTTP request
+
+req = "GET /index.html HTTP/1.1\r\n" +
+      "Host: www.example.com\r\n" +
+      "User-Agent: benchmark/1.0 (compatible; mruby)\r\n" +
+      "Accept: text/html,application/xhtml+xml\r\n" +
+      "Accept-Language: en-US,en;q=0.5\r\n" +
+      "Connection: keep-alive\r\n\r\n"
+
+n = 0
+while n < 50000
+  lines = req.split("\n")
+  method, path, ver = lines[0].chomp.split(" ")
+  i = 1
+  while i < lines.size
+    line = lines[i].chomp
+    k, v = line.split(":", 2)
+    if v
+      k = k.downcase
+      v = v.strip
+    end
+    i += 1
+  end
+  n += 1
+end
@@ -0,0 +1,19 @@
+# String#to_i and #to_f over CSV-like numeric columns
+
+rows = []
+i = 0
+while i < 2000
+  rows << [(i * 7919).to_s, (i * 0.37).to_s, (rand * 1e6).to_s,
+           (rand(2000000) - 1000000).to_s].join(",")
+  i += 1
+end
+
+n = 0
+while n < 40
+  rows.each do |row|
+    id, a, b, c = row.split(",")
+    id.to_i + c.to_i
+    a.to_f + b.to_f
+  end
+  n += 1
+end
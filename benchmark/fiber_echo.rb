@@ -0,0 +1,51 @@
+# Echo server and clients sharing one Scheduler loop.
+# Needs a build with the mruby-scheduler gem.
+#
+#   mruby benchmark/fiber_echo.rb [connections] [rounds]
+
+conns = (ARGV[0] || 5000).to_i
+rounds = (ARGV[1] || 10).to_i
+msg = "x" * 64
+
+limit = Scheduler.raise_fd_limit
+conns = ((limit - 16) / 2).to_i if conns * 2 + 16 > limit
+
+server = Scheduler.tcp_listen("127.0.0.1", 0, 4096)
+port = Scheduler.local_port(server)
+
+Scheduler.spawn do
+  conns.times do
+    Scheduler.spawn(Scheduler.accept(server)) do |c|
+      while s = Scheduler.read(c, 4096)
+        Scheduler.write(c, s)
+      end
+      Scheduler.close(c)
+    end
+  end
+  Scheduler.close(server)
+end
+
+done = 0
+peak = 0
+live = 0
+conns.times do
+  Scheduler.spawn do
+    fd = Scheduler.tcp_connect("127.0.0.1", port)
+    live += 1
+    peak = live if live > peak
+    rounds.times do
+      Scheduler.write(fd, msg)
+      got = 0
+      got += Scheduler.read(fd, 4096).size while got < msg.size
+    end
+    Scheduler.close(fd)
+    live -= 1
+    done += 1
+  end
+end
+
+t = Scheduler.now
+Scheduler.run
+t = Scheduler.now - t
+puts "connections: #{done}, concurrent: #{peak}, round trips: #{done * rounds}"
+puts "time: #{t}s, #{(done * rounds / t).to_i} round trips/s"
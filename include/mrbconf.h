@@ -53,14 +53,31 @@
 /* initial minimum size for string buffer */
 //#define MRB_STR_BUF_MIN_SIZE 128
 
+/* fixed String#hash key instead of a random one per mrb_state */
+//#define MRB_STR_HASH_SEED 0
+
 /* arena size */
 //#define MRB_GC_ARENA_SIZE 100
 
 /* fixed size GC arena */
 //#define MRB_GC_FIXED_ARENA
 
+/* report arena growth and check MRB_GC_ARENA_SCOPE nesting */
+//#define MRB_GC_ARENA_DEBUG
+
+/* arena size first reported by MRB_GC_ARENA_DEBUG (doubles per report) */
+//#define MRB_GC_ARENA_WARN 100
+
+/* number of released fiber contexts kept for reuse */
+//#define MRB_CONTEXT_POOL_SIZE 16
+
+/* pooled contexts are shrunk to these stack/callinfo sizes */
+//#define MRB_CONTEXT_POOL_STACK_MAX 1024
+//#define MRB_CONTEXT_POOL_CI_MAX 64
+
 /* -DDISABLE_XXXX to drop following features */
 //#define DISABLE_STDIO		/* use of stdio */
+//#define DISABLE_TAILCALL	/* tail call elimination (keeps full backtraces) */
 
 /* -DENABLE_XXXX to enable following features */
 //#define ENABLE_DEBUG		/* hooks for debugger */
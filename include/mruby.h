@@ -56,6 +56,8 @@ typedef struct {
   int stackidx;
   int nregs;
   int argc;
+  int kwc;                      /* keyword arguments passed by OP_SENDK */
+  mrb_sym *kwsyms;              /* their names */
   mrb_code *pc;                 /* return address */
   mrb_code *err;                /* error position */
   int acc;
@@ -103,6 +105,8 @@ typedef struct mrb_state {
 
   struct mrb_context *c;
   struct mrb_context *root_c;
+  struct mrb_context *context_pool;       /* released fiber contexts */
+  int context_pool_len;
 
   struct RObject *exc;                    /* exception */
   struct iv_tbl *globals;                 /* global variable table */
@@ -123,6 +127,7 @@ typedef struct mrb_state {
   struct RClass *nil_class;
   struct RClass *symbol_class;
   struct RClass *kernel_module;
+  uint32_t method_serial;                 /* bumped when method lookup may change */
 
   struct heap_page *heaps;                /* heaps for GC */
   struct heap_page *sweeps;
@@ -135,6 +140,11 @@ typedef struct mrb_state {
   int arena_capa;
 #endif
   int arena_idx;
+  int arena_max;                           /* high-water mark of arena_idx */
+#ifdef MRB_GC_ARENA_DEBUG
+  int arena_warn;                          /* next arena_idx to report at */
+  int arena_scope_depth;                   /* open MRB_GC_ARENA_SCOPE_BEGINs */
+#endif
 
   enum gc_state gc_state; /* state of gc */
   int current_white_part; /* make white object by white_part */
@@ -144,15 +154,24 @@ typedef struct mrb_state {
   size_t gc_threshold;
   int gc_interval_ratio;
   int gc_step_ratio;
+  uint32_t gc_max_pause_us;     /* time budget of an incremental step; 0 for none */
+  struct RBasic *gc_scan_obj;   /* large Array/Hash being marked in chunks */
+  size_t gc_scan_pos;
+  void *gc_scan_ptr;            /* its element buffer when the scan started */
   mrb_bool gc_disabled:1;
   mrb_bool gc_full:1;
   mrb_bool is_generational_gc_mode:1;
   mrb_bool out_of_memory:1;
   size_t majorgc_old_threshold;
   struct alloca_header *mems;
+  void (*alloc_hook)(struct mrb_state *mrb, struct RBasic *obj); /* called for each new object if set */
+  void *alloc_hook_data;
+  uint64_t str_hash_key[2];     /* SipHash key of String#hash */
 
   mrb_sym symidx;
   struct kh_n2s *name2sym;      /* symbol table */
+  struct kh_lit *lit_table;     /* pool strings shared between ireps */
+  mrb_sym sym_hash, sym_eq, sym_eql, sym_cmp; /* methods the core calls from C */
 
 #ifdef ENABLE_DEBUG
   void (*code_fetch_hook)(struct mrb_state* mrb, struct mrb_irep *irep, mrb_code *pc, mrb_value *regs);
@@ -228,6 +247,20 @@ int mrb_get_args(mrb_state *mrb, const char *format, ...);
 mrb_value mrb_funcall(mrb_state*, mrb_value, const char*, int,...);
 mrb_value mrb_funcall_argv(mrb_state*, mrb_value, mrb_sym, int, mrb_value*);
 mrb_value mrb_funcall_with_block(mrb_state*, mrb_value, mrb_sym, int, mrb_value*, mrb_value);
+mrb_value mrb_funcall_id(mrb_state*, mrb_value, mrb_sym, int,...);
+
+/* method lookup cached across calls from C; revalidated by receiver class */
+typedef struct mrb_call_handle {
+  mrb_sym mid;
+  uint32_t serial;
+  struct RClass *klass;
+  struct RClass *owner;
+  struct RProc *proc;
+} mrb_call_handle;
+
+void mrb_call_handle_init(mrb_state*, mrb_call_handle*, mrb_sym);
+mrb_value mrb_funcall_handle(mrb_state*, mrb_call_handle*, mrb_value, int, mrb_value*);
+mrb_value mrb_protect(mrb_state*, mrb_func_t, mrb_value, mrb_bool*);
 mrb_sym mrb_intern_cstr(mrb_state*,const char*);
 mrb_sym mrb_intern(mrb_state*,const char*,size_t);
 mrb_sym mrb_intern_static(mrb_state*,const char*,size_t);
@@ -276,8 +309,53 @@ mrb_bool mrb_eql(mrb_state *mrb, mrb_value obj1, mrb_value obj2);
 void mrb_garbage_collect(mrb_state*);
 void mrb_full_gc(mrb_state*);
 void mrb_incremental_gc(mrb_state *);
+mrb_int mrb_gc_compact(mrb_state *);
+void mrb_gc_idle(mrb_state *);
 int mrb_gc_arena_save(mrb_state*);
 void mrb_gc_arena_restore(mrb_state*,int);
+
+/*
+ * Scoped arena save/restore.  Objects protected between BEGIN and END
+ * are released from the arena at END; RESET releases them early, e.g.
+ * at the end of each iteration of a loop that allocates:
+ *
+ *   MRB_GC_ARENA_SCOPE_BEGIN(mrb);
+ *   for (i = 0; i < n; i++) {
+ *     mrb_ary_push(mrb, ary, mrb_str_new_cstr(mrb, names[i]));
+ *     MRB_GC_ARENA_SCOPE_RESET(mrb);
+ *   }
+ *   MRB_GC_ARENA_SCOPE_END(mrb);
+ *
+ * BEGIN and END open and close a block, so an unbalanced pair does not
+ * compile.  Do not return from inside the scope; with MRB_GC_ARENA_DEBUG
+ * an END that does not close the innermost open scope, or that finds
+ * the arena below the point it was opened at, aborts.
+ */
+struct mrb_gc_arena_scope {
+  int ai;
+#ifdef MRB_GC_ARENA_DEBUG
+  int depth;
+#endif
+};
+
+#ifdef MRB_GC_ARENA_DEBUG
+void mrb_gc_arena_scope_begin(mrb_state*,struct mrb_gc_arena_scope*);
+void mrb_gc_arena_scope_end(mrb_state*,struct mrb_gc_arena_scope*);
+void mrb_gc_arena_scope_reset(mrb_state*,struct mrb_gc_arena_scope*);
+#else
+#define mrb_gc_arena_scope_begin(mrb,s) ((s)->ai = mrb_gc_arena_save(mrb))
+#define mrb_gc_arena_scope_end(mrb,s) mrb_gc_arena_restore((mrb),(s)->ai)
+#define mrb_gc_arena_scope_reset(mrb,s) ((mrb)->arena_idx = (s)->ai)
+#endif
+
+#define MRB_GC_ARENA_SCOPE_BEGIN(mrb) do {\
+  struct mrb_gc_arena_scope mrb_arena_scope_;\
+  mrb_gc_arena_scope_begin((mrb), &mrb_arena_scope_)
+#define MRB_GC_ARENA_SCOPE_RESET(mrb) mrb_gc_arena_scope_reset((mrb), &mrb_arena_scope_)
+#define MRB_GC_ARENA_SCOPE_END(mrb) \
+  mrb_gc_arena_scope_end((mrb), &mrb_arena_scope_);\
+} while (0)
+
 void mrb_gc_mark(mrb_state*,struct RBasic*);
 #define mrb_gc_mark_value(mrb,val) do {\
   if (mrb_type(val) >= MRB_TT_HAS_BASIC) mrb_gc_mark((mrb), mrb_basic_ptr(val));\
@@ -27,6 +27,8 @@ typedef struct mrbc_context {
   mrb_bool capture_errors:1;
   mrb_bool dump_result:1;
   mrb_bool no_exec:1;
+  mrb_bool optimize:1;
+  mrb_bool frozen_string_literal:1;
 } mrbc_context;
 
 mrbc_context* mrbc_context_new(mrb_state *mrb);
@@ -139,6 +141,9 @@ struct mrb_parser_state {
   mrb_ast_node *tree;
 
   int capture_errors;
+  mrb_bool optimize:1;
+  mrb_bool frozen_string_literal:1; /* by mrbc_context or magic comment */
+  mrb_bool token_seen:1;
   struct mrb_parser_message error_buffer[10];
   struct mrb_parser_message warn_buffer[10];
 
@@ -12,6 +12,9 @@
 
 typedef void (each_object_callback)(mrb_state *mrb, struct RBasic* obj, void *data);
 void mrb_objspace_each_objects(mrb_state *mrb, each_object_callback* callback, void *data);
+void mrb_gc_update_value(mrb_state *mrb, mrb_value *v);
 void mrb_free_context(mrb_state *mrb, struct mrb_context *c);
+struct mrb_context *mrb_context_alloc(mrb_state *mrb, size_t stsize, size_t cisize);
+void mrb_context_recycle(mrb_state *mrb, struct mrb_context *c);
 
 #endif  /* MRUBY_GC_H */
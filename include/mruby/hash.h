@@ -21,6 +21,7 @@ struct RHash {
 #define mrb_hash_value(p)  mrb_obj_value((void*)(p))
 
 mrb_value mrb_hash_new_capa(mrb_state*, int);
+mrb_value mrb_hash_new_from_values(mrb_state *mrb, mrb_int n, const mrb_value *kv);
 mrb_value mrb_hash_new(mrb_state *mrb);
 
 void mrb_hash_set(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value val);
@@ -45,7 +46,11 @@ struct kh_ht * mrb_hash_tbl(mrb_state *mrb, mrb_value hash);
 /* GC functions */
 void mrb_gc_mark_hash(mrb_state*, struct RHash*);
 size_t mrb_gc_mark_hash_size(mrb_state*, struct RHash*);
+size_t mrb_gc_mark_hash_range(mrb_state*, struct RHash*, size_t, size_t);
+size_t mrb_gc_hash_buckets(mrb_state*, struct RHash*, void**);
 void mrb_gc_free_hash(mrb_state*, struct RHash*);
+void mrb_gc_pin_hash_keys(mrb_state*, struct RHash*);
+void mrb_gc_update_hash(mrb_state*, struct RHash*);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
@@ -15,10 +15,18 @@ extern "C" {
 #define NEGFIXABLE(f) ((f) >= MRB_INT_MIN)
 #define FIXABLE(f) (POSFIXABLE(f) && NEGFIXABLE(f))
 
+/* buffer size for mrb_flo_to_buf and mrb_fixnum_to_buf */
+#define MRB_NUM_BUF_SIZE 72
+
 mrb_value mrb_flo_to_fixnum(mrb_state *mrb, mrb_value val);
-mrb_value mrb_flo_to_str(mrb_state *mrb, mrb_value flo, int max_digit);
+mrb_value mrb_flo_to_str(mrb_state *mrb, mrb_value flo);
+size_t mrb_flo_to_buf(mrb_float n, char *buf);
+int mrb_flo_shortest(mrb_float v, char *digits, int *decpt);
+int mrb_read_int(const char *p, const char *e, int base, mrb_int *val, const char **endp);
+double mrb_read_float(mrb_state *mrb, const char *p, const char *e, const char **endp);
 
 mrb_value mrb_fixnum_to_str(mrb_state *mrb, mrb_value x, int base);
+size_t mrb_fixnum_to_buf(mrb_int val, int base, char *buf);
 
 mrb_value mrb_fixnum_plus(mrb_state *mrb, mrb_value x, mrb_value y);
 mrb_value mrb_fixnum_minus(mrb_state *mrb, mrb_value x, mrb_value y);
@@ -20,6 +20,12 @@ struct REnv {
   int cioff;
 };
 
+/* REnv flags hold the stack length and the escape bit */
+#define MRB_ENV_ESCAPED (1<<20)
+#define MRB_ENV_STACK_LEN(e) ((e)->flags & ~MRB_ENV_ESCAPED)
+#define MRB_ENV_SET_STACK_LEN(e,len) ((e)->flags = ((e)->flags & MRB_ENV_ESCAPED) | (unsigned int)(len))
+#define MRB_ENV_ESCAPED_P(e) (((e)->flags & MRB_ENV_ESCAPED) != 0)
+
 struct RProc {
   MRB_OBJECT_HEADER;
   union {
@@ -38,11 +44,18 @@ struct RProc {
 #define MRB_ASPEC_KEY(a)          (((a) >> 2) & 0x1f)
 #define MRB_ASPEC_KDICT(a)        ((a) & (1<<1))
 #define MRB_ASPEC_BLOCK(a)        ((a) & 1)
+#define MRB_ASPEC_NOESCAPE(a)     ((a) & (1<<23))   /* block argument never escapes */
 
 #define MRB_PROC_CFUNC 128
 #define MRB_PROC_CFUNC_P(p) (((p)->flags & MRB_PROC_CFUNC) != 0)
 #define MRB_PROC_STRICT 256
 #define MRB_PROC_STRICT_P(p) (((p)->flags & MRB_PROC_STRICT) != 0)
+/* cfunc reads/writes the array slot stored in env[0]; inlined by OP_SEND */
+#define MRB_PROC_AREF 512
+#define MRB_PROC_ASET 1024
+/* cfunc reads/writes the instance variable named by env[0]; inlined by OP_SEND */
+#define MRB_PROC_IVGET 2048
+#define MRB_PROC_IVSET 4096
 
 #define mrb_proc_ptr(v)    ((struct RProc*)(mrb_ptr(v)))
 
@@ -50,7 +63,10 @@ struct RProc *mrb_proc_new(mrb_state*, mrb_irep*);
 struct RProc *mrb_proc_new_cfunc(mrb_state*, mrb_func_t);
 struct RProc *mrb_closure_new(mrb_state*, mrb_irep*);
 struct RProc *mrb_closure_new_cfunc(mrb_state *mrb, mrb_func_t func, int nlocals);
+struct RProc *mrb_proc_new_cfunc_with_env(mrb_state *mrb, mrb_func_t func, mrb_int argc, const mrb_value *argv);
+mrb_value mrb_cfunc_env_get(mrb_state *mrb, mrb_int idx);
 void mrb_proc_copy(struct RProc *a, struct RProc *b);
+void mrb_proc_escape(mrb_state *mrb, struct RProc *p);
 
 #include "mruby/khash.h"
 KHASH_DECLARE(mt, mrb_sym, struct RProc*, 1)
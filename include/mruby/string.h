@@ -18,6 +18,7 @@ extern const char mrb_digitmap[];
 struct RString {
   MRB_OBJECT_HEADER;
   mrb_int len;
+  uint32_t hash;                /* valid with MRB_STR_HASHED */
   union {
     mrb_int capa;
     struct mrb_shared_string *shared;
@@ -34,6 +35,7 @@ struct RString {
 
 #define MRB_STR_SHARED    1
 #define MRB_STR_NOFREE    2
+#define MRB_STR_HASHED    4
 
 void mrb_gc_free_str(mrb_state*, struct RString*);
 void mrb_str_modify(mrb_state*, struct RString*);
@@ -56,14 +58,18 @@ mrb_value mrb_str_dup(mrb_state *mrb, mrb_value str);
 mrb_value mrb_str_intern(mrb_state *mrb, mrb_value self);
 mrb_value mrb_str_cat_cstr(mrb_state *, mrb_value, const char *);
 mrb_value mrb_str_to_inum(mrb_state *mrb, mrb_value str, int base, int badcheck);
+mrb_value mrb_str_len_to_inum(mrb_state *mrb, const char *str, size_t len, int base, int badcheck);
 double mrb_str_to_dbl(mrb_state *mrb, mrb_value str, int badcheck);
+double mrb_str_len_to_dbl(mrb_state *mrb, const char *p, size_t len, int badcheck);
 mrb_value mrb_str_to_str(mrb_state *mrb, mrb_value str);
+mrb_bool mrb_builtin_to_s_p(mrb_state *mrb, mrb_value obj);
 mrb_int mrb_str_hash(mrb_state *mrb, mrb_value str);
 mrb_value mrb_str_buf_append(mrb_state *mrb, mrb_value str, mrb_value str2);
 mrb_value mrb_str_inspect(mrb_state *mrb, mrb_value str);
 mrb_bool mrb_str_equal(mrb_state *mrb, mrb_value str1, mrb_value str2);
 mrb_value mrb_str_dump(mrb_state *mrb, mrb_value str);
 mrb_value mrb_str_cat(mrb_state *mrb, mrb_value str, const char *ptr, size_t len);
+mrb_value mrb_str_cat_int(mrb_state *mrb, mrb_value str, mrb_int n, int base);
 mrb_value mrb_str_append(mrb_state *mrb, mrb_value str, mrb_value str2);
 
 int mrb_str_cmp(mrb_state *mrb, mrb_value str1, mrb_value str2);
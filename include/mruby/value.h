@@ -349,6 +349,13 @@ mrb_float_value(struct mrb_state *mrb, mrb_float f)
 #define MRB_GC_WHITES (MRB_GC_WHITE_A | MRB_GC_WHITE_B)
 #define MRB_GC_COLOR_MASK 7
 
+/* in flags: an object mrb_gc_compact() must leave where it is */
+#define MRB_FLAG_GC_PINNED (1 << 19)
+/* in flags: the object refuses modification (see Object#freeze) */
+#define MRB_FLAG_FROZEN (1 << 18)
+#define MRB_FROZEN_P(o) ((o)->flags & MRB_FLAG_FROZEN)
+#define MRB_SET_FROZEN_FLAG(o) ((o)->flags |= MRB_FLAG_FROZEN)
+
 #define paint_gray(o) ((o)->color = MRB_GC_GRAY)
 #define paint_black(o) ((o)->color = MRB_GC_BLACK)
 #define paint_white(o) ((o)->color = MRB_GC_WHITES)
@@ -381,6 +388,8 @@ struct RFiber {
   MRB_OBJECT_HEADER;
   struct mrb_context *cxt;
 };
+/* the fiber finished and gave its context back (cxt is NULL) */
+#define MRB_FIBER_DEAD 1
 
 #ifdef MRB_WORD_BOXING
 struct RFloat {
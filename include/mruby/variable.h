@@ -68,7 +68,9 @@ mrb_bool mrb_cv_defined(mrb_state *mrb, mrb_value mod, mrb_sym sym);
 /* GC functions */
 void mrb_gc_mark_gv(mrb_state*);
 void mrb_gc_free_gv(mrb_state*);
+void mrb_gc_update_gv(mrb_state*);
 void mrb_gc_mark_iv(mrb_state*, struct RObject*);
+void mrb_gc_update_iv(mrb_state*, struct RObject*);
 size_t mrb_gc_mark_iv_size(mrb_state*, struct RObject*);
 void mrb_gc_free_iv(mrb_state*, struct RObject*);
 
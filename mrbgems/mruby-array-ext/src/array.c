@@ -59,13 +59,19 @@ mrb_ary_assoc(mrb_state *mrb, mrb_value ary)
 
   mrb_get_args(mrb, "o", &k);
 
+  /* to_ary and == may allocate on every element */
+  v = mrb_nil_value();
+  MRB_GC_ARENA_SCOPE_BEGIN(mrb);
   for (i = 0; i < RARRAY_LEN(ary); ++i) {
     v = mrb_check_array_type(mrb, RARRAY_PTR(ary)[i]);
     if (!mrb_nil_p(v) && RARRAY_LEN(v) > 0 &&
         mrb_equal(mrb, RARRAY_PTR(v)[0], k))
-      return v;
+      break;
+    v = mrb_nil_value();
+    MRB_GC_ARENA_SCOPE_RESET(mrb);
   }
-  return mrb_nil_value();
+  MRB_GC_ARENA_SCOPE_END(mrb);
+  return v;
 }
 
 /*
@@ -31,6 +31,7 @@ struct _args {
   mrb_bool mrbfile      : 1;
   mrb_bool check_syntax : 1;
   mrb_bool verbose      : 1;
+  mrb_bool frozen_str   : 1;
   int argc;
   char** argv;
 };
@@ -45,6 +46,7 @@ usage(const char *name)
   "-e 'command' one line of script",
   "-v           print version number, then run in verbose mode",
   "--verbose    run in verbose mode",
+  "--frozen-string-literal  freeze string literals, as the magic comment does",
   "--version    print the version",
   "--copyright  print the copyright",
   NULL
@@ -129,6 +131,10 @@ append_cmdline:
         args->verbose = 1;
         break;
       }
+      else if (strcmp((*argv) + 2, "frozen-string-literal") == 0) {
+        args->frozen_str = 1;
+        break;
+      }
       else if (strcmp((*argv) + 2, "copyright") == 0) {
         mrb_show_copyright(mrb);
         exit(EXIT_SUCCESS);
@@ -207,6 +213,8 @@ main(int argc, char **argv)
     c->dump_result = 1;
   if (args.check_syntax)
     c->no_exec = 1;
+  if (args.frozen_str)
+    c->frozen_string_literal = 1;
   if (args.mrbfile) {
     v = mrb_load_irep_file_cxt(mrb, args.rfp, c);
   }
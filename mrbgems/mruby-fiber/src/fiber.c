@@ -1,6 +1,7 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/gc.h"
 #include "mruby/proc.h"
 
 #define FIBER_STACK_INIT_SIZE 64
@@ -61,12 +62,12 @@
 static mrb_value
 fiber_init(mrb_state *mrb, mrb_value self)
 {
-  static const struct mrb_context mrb_context_zero = { 0 };
   struct RFiber *f = (struct RFiber*)mrb_ptr(self);
   struct mrb_context *c;
   struct RProc *p;
   mrb_callinfo *ci;
   mrb_value blk;
+  size_t n;
 
   mrb_get_args(mrb, "&", &blk);
   
@@ -78,23 +79,16 @@ fiber_init(mrb_state *mrb, mrb_value self)
     mrb_raise(mrb, E_ARGUMENT_ERROR, "tried to create Fiber from C defined method");
   }
 
-  f->cxt = (struct mrb_context*)mrb_malloc(mrb, sizeof(struct mrb_context));
-  *f->cxt = mrb_context_zero;
+  /* VM stack and callinfo stack; reused from a finished fiber if possible.
+     The block's registers have to fit in the part that is cleared. */
+  n = p->body.irep->nregs;
+  if (n < FIBER_STACK_INIT_SIZE) n = FIBER_STACK_INIT_SIZE;
+  f->cxt = mrb_context_alloc(mrb, n, FIBER_CI_INIT_SIZE);
   c = f->cxt;
 
-  /* initialize VM stack */
-  c->stbase = (mrb_value *)mrb_calloc(mrb, FIBER_STACK_INIT_SIZE, sizeof(mrb_value));
-  c->stend = c->stbase + FIBER_STACK_INIT_SIZE;
-  c->stack = c->stbase;
-
   /* copy receiver from a block */
   c->stack[0] = mrb->c->stack[0];
 
-  /* initialize callinfo stack */
-  c->cibase = (mrb_callinfo *)mrb_calloc(mrb, FIBER_CI_INIT_SIZE, sizeof(mrb_callinfo));
-  c->ciend = c->cibase + FIBER_CI_INIT_SIZE;
-  c->ci = c->cibase;
-
   /* adjust return callinfo */
   ci = c->ci;
   ci->target_class = p->target_class;
@@ -116,6 +110,9 @@ fiber_check(mrb_state *mrb, mrb_value fib)
   struct RFiber *f = (struct RFiber*)mrb_ptr(fib);
 
   if (!f->cxt) {
+    if (f->flags & MRB_FIBER_DEAD) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "resuming dead fiber");
+    }
     mrb_raise(mrb, E_ARGUMENT_ERROR, "uninitialized Fiber");
   }
   return f->cxt;
@@ -200,7 +197,12 @@ fiber_resume(mrb_state *mrb, mrb_value self)
 static mrb_value
 fiber_alive_p(mrb_state *mrb, mrb_value self)
 {
-  struct mrb_context *c = fiber_check(mrb, self);
+  struct mrb_context *c;
+
+  if (mrb_ptr(self) && (mrb_obj_ptr(self)->flags & MRB_FIBER_DEAD)) {
+    return mrb_false_value();
+  }
+  c = fiber_check(mrb, self);
   return mrb_bool_value(c->status != MRB_FIBER_TERMINATED);
 }
 
@@ -62,3 +62,76 @@ assert('Yield raises when called on root fiber') {
     true
   end
 }
+
+assert('Fiber contexts reused after collection') do
+  def fiber_deep(n)
+    n == 0 ? Fiber.yield(:deep) : 1 + fiber_deep(n - 1)
+  end
+
+  3.times do |round|
+    fibers = (0...20).map do |i|
+      Fiber.new do |x|
+        v = Fiber.yield(x + i)
+        v = fiber_deep(100) if i % 5 == 0
+        v
+      end
+    end
+    fibers.each_with_index do |f, i|
+      assert_equal round + i, f.resume(round)
+    end
+    fibers.each_with_index do |f, i|
+      if i % 5 == 0
+        assert_equal :deep, f.resume(i)
+        assert_equal 101, f.resume(1)
+      else
+        assert_equal i, f.resume(i)
+      end
+      assert_false f.alive?
+    end
+    fibers = nil
+    GC.start
+  end
+end
+
+assert('Exception in a fiber reaches the resumer') do
+  log = []
+  f = Fiber.new do
+    begin
+      Fiber.yield 1
+      raise "in fiber"
+    ensure
+      log << :ensure
+    end
+  end
+  assert_equal 1, f.resume
+  msg = begin
+    f.resume
+  rescue RuntimeError => e
+    e.message
+  end
+  assert_equal "in fiber", msg
+  assert_equal [:ensure], log
+  assert_false f.alive?
+  assert_raise(RuntimeError) { f.resume }
+
+  g = Fiber.new { [:after, Fiber.new { raise "nested" }.resume] }
+  assert_raise(RuntimeError) { g.resume }
+  assert_false g.alive?
+end
+
+assert('Finished fiber gives its context back') do
+  f = Fiber.new do
+    x = :kept
+    lambda { x }
+  end
+  get = f.resume
+  assert_false f.alive?
+
+  # these run on the context f just released
+  others = (0...3).map { |i| Fiber.new { a = b = c = i; Fiber.yield(a + b + c); :others } }
+  assert_equal [0, 3, 6], others.map { |o| o.resume }
+  assert_equal :kept, get.call
+  assert_false f.alive?
+  assert_raise(RuntimeError) { f.resume }
+  assert_equal [:others] * 3, others.map { |o| o.resume }
+end
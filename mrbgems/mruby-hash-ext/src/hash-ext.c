@@ -29,9 +29,12 @@ mrb_hash_values_at(mrb_state *mrb, int argc, mrb_value *argv, mrb_value hash)
     mrb_value result = mrb_ary_new_capa(mrb, argc);
     long i;
 
+    MRB_GC_ARENA_SCOPE_BEGIN(mrb);
     for (i=0; i<argc; i++) {
         mrb_ary_push(mrb, result, mrb_hash_get(mrb, hash, argv[i]));
+        MRB_GC_ARENA_SCOPE_RESET(mrb);
     }
+    MRB_GC_ARENA_SCOPE_END(mrb);
     return result;
 }
 
@@ -22,3 +22,14 @@ assert('Hash#values_at') do
   h = { "cat" => "feline", "dog" => "canine", "cow" => "bovine" }
   assert_equal ["bovine", "feline"], h.values_at("cow", "cat")
 end
+
+assert('Hash#values_at keeps the arena bounded') do
+  h = Hash.new { |hash, k| "v#{k}" }
+  GC.start
+  GC.reset_arena_high_water
+  before = GC.arena_high_water
+  v = h.values_at(*(1..2000).to_a)
+  assert_equal 2000, v.size
+  assert_equal "v2000", v.last
+  assert_true GC.arena_high_water < before + 1000
+end
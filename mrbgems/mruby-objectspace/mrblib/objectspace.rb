@@ -0,0 +1,35 @@
+module ObjectSpace
+  ##
+  # call-seq:
+  #    ObjectSpace.trace_allocations(every=1) { ... } -> array
+  #
+  # Records every +every+th allocation made while the block runs and
+  # returns ObjectSpace.allocation_sites.
+  #
+  def self.trace_allocations(every=1, &block)
+    raise ArgumentError, "no block given" unless block
+    trace_allocations_start(every)
+    begin
+      block.call
+    ensure
+      trace_allocations_stop
+    end
+    allocation_sites
+  end
+
+  ##
+  # call-seq:
+  #    ObjectSpace.dump_allocations -> string
+  #
+  # Formats the recorded sites one per line, most sampled first, as
+  # "count<TAB>file:line<TAB>type<TAB>class" below a "#" summary line.
+  #
+  def self.dump_allocations
+    c = allocation_counts
+    out = "# #{c[:sampled]} of #{c[:total]} allocations sampled (every #{c[:every]}), #{c[:sites]} sites\n"
+    allocation_sites.each do |file, line, type, klass, count|
+      out << "#{count}\t#{file || '(unknown)'}:#{line || '?'}\t#{type}\t#{klass}\n"
+    end
+    out
+  end
+end
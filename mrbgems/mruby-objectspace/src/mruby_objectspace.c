@@ -1,7 +1,17 @@
+#include <stdlib.h>
+#include <string.h>
 #include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/irep.h>
+#include <mruby/debug.h>
 #include <mruby/gc.h>
 #include <mruby/hash.h>
+#include <mruby/proc.h>
+#include <mruby/string.h>
 #include <mruby/value.h>
+#include <mruby/variable.h>
 
 struct os_count_struct {
   size_t total;
@@ -23,6 +33,39 @@ os_count_object_type(mrb_state *mrb, struct RBasic* obj, void *data)
   }
 }
 
+static mrb_value
+os_type_value(mrb_state *mrb, size_t tt)
+{
+  switch (tt) {
+#define COUNT_TYPE(t) case (t): return mrb_symbol_value(mrb_intern_cstr(mrb, #t))
+    COUNT_TYPE(MRB_TT_FALSE);
+    COUNT_TYPE(MRB_TT_FREE);
+    COUNT_TYPE(MRB_TT_TRUE);
+    COUNT_TYPE(MRB_TT_FIXNUM);
+    COUNT_TYPE(MRB_TT_SYMBOL);
+    COUNT_TYPE(MRB_TT_UNDEF);
+    COUNT_TYPE(MRB_TT_FLOAT);
+    COUNT_TYPE(MRB_TT_CPTR);
+    COUNT_TYPE(MRB_TT_OBJECT);
+    COUNT_TYPE(MRB_TT_CLASS);
+    COUNT_TYPE(MRB_TT_MODULE);
+    COUNT_TYPE(MRB_TT_ICLASS);
+    COUNT_TYPE(MRB_TT_SCLASS);
+    COUNT_TYPE(MRB_TT_PROC);
+    COUNT_TYPE(MRB_TT_ARRAY);
+    COUNT_TYPE(MRB_TT_HASH);
+    COUNT_TYPE(MRB_TT_STRING);
+    COUNT_TYPE(MRB_TT_RANGE);
+    COUNT_TYPE(MRB_TT_EXCEPTION);
+    COUNT_TYPE(MRB_TT_FILE);
+    COUNT_TYPE(MRB_TT_ENV);
+    COUNT_TYPE(MRB_TT_DATA);
+#undef COUNT_TYPE
+  default:
+    return mrb_fixnum_value(tt);
+  }
+}
+
 /*
  *  call-seq:
  *     ObjectSpace.count_objects([result_hash]) -> hash
@@ -70,39 +113,342 @@ os_count_objects(mrb_state *mrb, mrb_value self)
   mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_cstr(mrb, "FREE")), mrb_fixnum_value(obj_count.freed));
 
   for (i = 0; i < MRB_TT_MAXDEFINE; i++) {
-    mrb_value type;
-    switch (i) {
-#define COUNT_TYPE(t) case (t): type = mrb_symbol_value(mrb_intern_cstr(mrb, #t)); break;
-      COUNT_TYPE(MRB_TT_FALSE);
-      COUNT_TYPE(MRB_TT_FREE);
-      COUNT_TYPE(MRB_TT_TRUE);
-      COUNT_TYPE(MRB_TT_FIXNUM);
-      COUNT_TYPE(MRB_TT_SYMBOL);
-      COUNT_TYPE(MRB_TT_UNDEF);
-      COUNT_TYPE(MRB_TT_FLOAT);
-      COUNT_TYPE(MRB_TT_CPTR);
-      COUNT_TYPE(MRB_TT_OBJECT);
-      COUNT_TYPE(MRB_TT_CLASS);
-      COUNT_TYPE(MRB_TT_MODULE);
-      COUNT_TYPE(MRB_TT_ICLASS);
-      COUNT_TYPE(MRB_TT_SCLASS);
-      COUNT_TYPE(MRB_TT_PROC);
-      COUNT_TYPE(MRB_TT_ARRAY);
-      COUNT_TYPE(MRB_TT_HASH);
-      COUNT_TYPE(MRB_TT_STRING);
-      COUNT_TYPE(MRB_TT_RANGE);
-      COUNT_TYPE(MRB_TT_EXCEPTION);
-      COUNT_TYPE(MRB_TT_FILE);
-      COUNT_TYPE(MRB_TT_ENV);
-      COUNT_TYPE(MRB_TT_DATA);
-#undef COUNT_TYPE
-    default:
-      type = mrb_fixnum_value(i); break;
-    }
     if (obj_count.counts[i])
-      mrb_hash_set(mrb, hash, type, mrb_fixnum_value(obj_count.counts[i]));
+      mrb_hash_set(mrb, hash, os_type_value(mrb, i), mrb_fixnum_value(obj_count.counts[i]));
+  }
+
+  return hash;
+}
+
+/*
+ * Allocation tracing.  While it runs, mrb->alloc_hook counts every new
+ * object and records each Nth one under its call site: the file and
+ * line of the innermost Ruby frame, the object's type and its class.
+ * Classes seen are kept alive in an Array so the table never points
+ * at a freed class.
+ */
+struct alloc_site {
+  char *file;                   /* NULL without debug info */
+  int32_t line;
+  enum mrb_vtype tt;
+  struct RClass *klass;
+  size_t count;
+};
+
+struct alloc_trace {
+  mrb_int every;
+  mrb_int countdown;
+  size_t total;                 /* allocations seen */
+  size_t sampled;
+  struct alloc_site *sites;
+  size_t len, capa;
+  uint32_t *index;              /* open addressing: site index + 1, 0 if empty */
+  size_t index_size;            /* power of 2, above 2 * len */
+  struct RClass *os;
+};
+
+#define TRACE_KEY "__alloc_trace__"
+#define TRACE_CLASSES_KEY "__alloc_trace_classes__"
+
+static void
+trace_clear(mrb_state *mrb, struct alloc_trace *t)
+{
+  size_t i;
+
+  for (i = 0; i < t->len; i++) {
+    mrb_free(mrb, t->sites[i].file);
+  }
+  t->len = 0;
+  t->total = t->sampled = 0;
+  if (t->index) memset(t->index, 0, sizeof(uint32_t)*t->index_size);
+}
+
+static void
+trace_free(mrb_state *mrb, void *p)
+{
+  struct alloc_trace *t = (struct alloc_trace*)p;
+
+  if (mrb->alloc_hook_data == t) {
+    mrb->alloc_hook = NULL;
+    mrb->alloc_hook_data = NULL;
+  }
+  trace_clear(mrb, t);
+  mrb_free(mrb, t->sites);
+  mrb_free(mrb, t->index);
+  mrb_free(mrb, t);
+}
+
+static const struct mrb_data_type trace_type = {
+  TRACE_KEY, trace_free,
+};
+
+static uint32_t
+site_hash(const char *file, int32_t line, enum mrb_vtype tt, struct RClass *c)
+{
+  uint32_t h = 2166136261U;
+
+  if (file) {
+    while (*file) {
+      h = (h ^ (unsigned char)*file++) * 16777619U;
+    }
+  }
+  h ^= (uint32_t)line * 31 + (uint32_t)tt;
+  h ^= (uint32_t)((uintptr_t)c >> 3) * 2654435761U;
+  return h ^ (h >> 15);
+}
+
+static mrb_bool
+site_eq(struct alloc_site *s, const char *file, int32_t line, enum mrb_vtype tt, struct RClass *c)
+{
+  if (s->line != line || s->tt != tt || s->klass != c) return FALSE;
+  if (s->file == NULL || file == NULL) return s->file == file;
+  return strcmp(s->file, file) == 0;
+}
+
+static void
+trace_reindex(mrb_state *mrb, struct alloc_trace *t)
+{
+  size_t size = t->index_size ? t->index_size * 2 : 64;
+  size_t i, mask = size - 1;
+
+  mrb_free(mrb, t->index);
+  t->index = (uint32_t*)mrb_calloc(mrb, size, sizeof(uint32_t));
+  t->index_size = size;
+  for (i = 0; i < t->len; i++) {
+    struct alloc_site *s = &t->sites[i];
+    size_t n = site_hash(s->file, s->line, s->tt, s->klass) & mask;
+
+    while (t->index[n]) n = (n + 1) & mask;
+    t->index[n] = (uint32_t)(i + 1);
+  }
+}
+
+/* file and line of the innermost Ruby frame; line is -1 if unknown */
+static void
+trace_location(mrb_state *mrb, const char **file, int32_t *line)
+{
+  mrb_callinfo *ci = mrb->c->ci, *callee = NULL;
+
+  *file = NULL;
+  *line = -1;
+  for (; ci >= mrb->c->cibase; callee = ci, ci--) {
+    mrb_irep *irep;
+    mrb_code *pc;
+
+    if (!ci->proc || MRB_PROC_CFUNC_P(ci->proc)) continue;
+    irep = ci->proc->body.irep;
+    if (ci->err) pc = ci->err;
+    else if (callee && callee->pc) pc = callee->pc - 1;
+    else return;
+    *file = mrb_debug_get_filename(irep, pc - irep->iseq);
+    *line = mrb_debug_get_line(irep, pc - irep->iseq);
+    return;
+  }
+}
+
+static void
+trace_record(mrb_state *mrb, struct alloc_trace *t, struct RBasic *obj)
+{
+  const char *file;
+  int32_t line;
+  struct RClass *c = obj->c ? mrb_class_real(obj->c) : NULL;
+  size_t n, mask;
+  struct alloc_site *s;
+
+  trace_location(mrb, &file, &line);
+  if ((t->len + 1) * 2 > t->index_size) {
+    trace_reindex(mrb, t);
+  }
+  mask = t->index_size - 1;
+  n = site_hash(file, line, obj->tt, c) & mask;
+  while (t->index[n]) {
+    s = &t->sites[t->index[n] - 1];
+    if (site_eq(s, file, line, obj->tt, c)) {
+      s->count++;
+      return;
+    }
+    n = (n + 1) & mask;
+  }
+
+  if (t->len == t->capa) {
+    t->capa = t->capa ? t->capa * 2 : 32;
+    t->sites = (struct alloc_site*)mrb_realloc(mrb, t->sites, sizeof(struct alloc_site)*t->capa);
+  }
+  s = &t->sites[t->len];
+  s->file = NULL;
+  if (file) {
+    size_t flen = strlen(file);
+
+    s->file = (char*)mrb_malloc(mrb, flen + 1);
+    memcpy(s->file, file, flen + 1);
+  }
+  s->line = line;
+  s->tt = obj->tt;
+  s->klass = c;
+  s->count = 1;
+  t->index[n] = (uint32_t)++t->len;
+  if (c) {
+    /* no object is allocated here; pushing only grows the buffer */
+    mrb_value classes = mrb_obj_iv_get(mrb, (struct RObject*)t->os, mrb_intern_lit(mrb, TRACE_CLASSES_KEY));
+    mrb_ary_push(mrb, classes, mrb_obj_value(c));
+  }
+}
+
+static void
+trace_alloc(mrb_state *mrb, struct RBasic *obj)
+{
+  struct alloc_trace *t = (struct alloc_trace*)mrb->alloc_hook_data;
+
+  t->total++;
+  if (--t->countdown > 0) return;
+  t->countdown = t->every;
+  t->sampled++;
+  trace_record(mrb, t, obj);
+}
+
+static struct alloc_trace*
+trace_get(mrb_state *mrb, mrb_value os, mrb_bool create)
+{
+  mrb_sym key = mrb_intern_lit(mrb, TRACE_KEY);
+  mrb_value v = mrb_iv_get(mrb, os, key);
+  struct alloc_trace *t;
+  struct RData *d;
+
+  if (!mrb_nil_p(v)) return (struct alloc_trace*)DATA_PTR(v);
+  if (!create) return NULL;
+  t = (struct alloc_trace*)mrb_calloc(mrb, 1, sizeof(struct alloc_trace));
+  t->os = mrb_class_ptr(os);
+  d = mrb_data_object_alloc(mrb, mrb->object_class, t, &trace_type);
+  mrb_iv_set(mrb, os, key, mrb_obj_value(d));
+  mrb_iv_set(mrb, os, mrb_intern_lit(mrb, TRACE_CLASSES_KEY), mrb_ary_new(mrb));
+  return t;
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_start(every=1) -> nil
+ *
+ *  Discards the sites recorded so far and starts recording every
+ *  +every+th object allocation by call site.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_int every = 1;
+  struct alloc_trace *t;
+
+  mrb_get_args(mrb, "|i", &every);
+  if (every < 1) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "sampling interval must be positive");
+  }
+  if (mrb->alloc_hook && mrb->alloc_hook != trace_alloc) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "allocation hook already in use");
+  }
+  mrb->alloc_hook = NULL;
+  t = trace_get(mrb, self, TRUE);
+  trace_clear(mrb, t);
+  mrb_ary_clear(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, TRACE_CLASSES_KEY)));
+  t->every = t->countdown = every;
+  mrb->alloc_hook_data = t;
+  mrb->alloc_hook = trace_alloc;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_stop -> nil
+ *
+ *  Stops recording allocations; the sites recorded are kept.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_stop(mrb_state *mrb, mrb_value self)
+{
+  if (mrb->alloc_hook == trace_alloc) {
+    mrb->alloc_hook = NULL;
+  }
+  return mrb_nil_value();
+}
+
+static int
+site_cmp(const void *a, const void *b)
+{
+  const struct alloc_site *x = *(const struct alloc_site**)a;
+  const struct alloc_site *y = *(const struct alloc_site**)b;
+
+  if (x->count != y->count) return x->count < y->count ? 1 : -1;
+  if (x->line != y->line) return x->line < y->line ? -1 : 1;
+  return (int)x->tt - (int)y->tt;
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.allocation_sites -> array
+ *
+ *  Returns the recorded sites as [file, line, type, class, count],
+ *  most sampled first.  file and line are nil when the allocating
+ *  code has no debug info.
+ *
+ */
+
+static mrb_value
+os_allocation_sites(mrb_state *mrb, mrb_value self)
+{
+  struct alloc_trace *t = trace_get(mrb, self, FALSE);
+  void (*hook)(mrb_state*, struct RBasic*) = mrb->alloc_hook;
+  struct alloc_site **order;
+  mrb_value ary;
+  size_t i;
+
+  if (!t) return mrb_ary_new(mrb);
+  /* the hook would grow the table under us */
+  mrb->alloc_hook = NULL;
+  ary = mrb_ary_new_capa(mrb, t->len);
+  order = (struct alloc_site**)mrb_malloc(mrb, sizeof(struct alloc_site*)*(t->len+1));
+  for (i = 0; i < t->len; i++) {
+    order[i] = &t->sites[i];
+  }
+  qsort(order, t->len, sizeof(struct alloc_site*), site_cmp);
+  for (i = 0; i < t->len; i++) {
+    struct alloc_site *s = order[i];
+    mrb_value site[5];
+    int ai = mrb_gc_arena_save(mrb);
+
+    site[0] = s->file ? mrb_str_new_cstr(mrb, s->file) : mrb_nil_value();
+    site[1] = s->line < 0 ? mrb_nil_value() : mrb_fixnum_value(s->line);
+    site[2] = os_type_value(mrb, s->tt);
+    site[3] = s->klass ? mrb_obj_value(s->klass) : mrb_nil_value();
+    site[4] = mrb_fixnum_value(s->count);
+    mrb_ary_push(mrb, ary, mrb_ary_new_from_values(mrb, 5, site));
+    mrb_gc_arena_restore(mrb, ai);
   }
+  mrb_free(mrb, order);
+  mrb->alloc_hook = hook;
+  return ary;
+}
 
+/*
+ *  call-seq:
+ *     ObjectSpace.allocation_counts -> hash
+ *
+ *  Returns {:total=>allocations, :sampled=>recorded, :every=>interval,
+ *  :sites=>distinct sites} for the current or last trace.
+ *
+ */
+
+static mrb_value
+os_allocation_counts(mrb_state *mrb, mrb_value self)
+{
+  struct alloc_trace *t = trace_get(mrb, self, FALSE);
+  mrb_value hash = mrb_hash_new(mrb);
+
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "total")), mrb_fixnum_value(t ? t->total : 0));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "sampled")), mrb_fixnum_value(t ? t->sampled : 0));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "every")), mrb_fixnum_value(t ? t->every : 0));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "sites")), mrb_fixnum_value(t ? t->len : 0));
   return hash;
 }
 
@@ -110,8 +456,15 @@ void
 mrb_mruby_objectspace_gem_init(mrb_state* mrb) {
   struct RClass *os = mrb_define_module(mrb, "ObjectSpace");
   mrb_define_class_method(mrb, os, "count_objects", os_count_objects, MRB_ARGS_ANY());
+  mrb_define_class_method(mrb, os, "trace_allocations_start", os_trace_allocations_start, MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, os, "trace_allocations_stop", os_trace_allocations_stop, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "allocation_sites", os_allocation_sites, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "allocation_counts", os_allocation_counts, MRB_ARGS_NONE());
 }
 
 void
 mrb_mruby_objectspace_gem_final(mrb_state* mrb) {
+  if (mrb->alloc_hook == trace_alloc) {
+    mrb->alloc_hook = NULL;
+  }
 }
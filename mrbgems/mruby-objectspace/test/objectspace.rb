@@ -35,3 +35,45 @@ assert('ObjectSpace.count_objects') do
   assert_equal(h[:MRB_TT_HASH], h_before[:MRB_TT_HASH] + 1000)
   assert_equal(h_after[:MRB_TT_HASH], h_before[:MRB_TT_HASH])
 end
+
+class AllocTraceTest; end
+
+assert('ObjectSpace.trace_allocations') do
+  sites = ObjectSpace.trace_allocations do
+    i = 0
+    while i < 100
+      AllocTraceTest.new
+      s = "str#{i}"
+      i += 1
+    end
+  end
+  obj = sites.find { |s| s[3] == AllocTraceTest }
+  assert_equal :MRB_TT_OBJECT, obj[2]
+  assert_equal 100, obj[4]
+  assert_true sites.any? { |s| s[2] == :MRB_TT_STRING && s[4] >= 100 }
+  c = ObjectSpace.allocation_counts
+  assert_equal 1, c[:every]
+  assert_equal c[:total], c[:sampled]
+  assert_equal sites.size, c[:sites]
+
+  # recording stopped with the block
+  AllocTraceTest.new
+  assert_equal 100, ObjectSpace.allocation_sites.find { |s| s[3] == AllocTraceTest }[4]
+end
+
+assert('ObjectSpace.trace_allocations sampling') do
+  ObjectSpace.trace_allocations(10) do
+    100.times { AllocTraceTest.new }
+  end
+  c = ObjectSpace.allocation_counts
+  assert_equal 10, c[:every]
+  assert_equal (c[:total] / 10).floor, c[:sampled]
+  assert_raise(ArgumentError) { ObjectSpace.trace_allocations_start(0) }
+end
+
+assert('ObjectSpace.dump_allocations') do
+  ObjectSpace.trace_allocations { AllocTraceTest.new }
+  lines = ObjectSpace.dump_allocations.split("\n")
+  assert_equal "#", lines[0][0]
+  assert_true lines.any? { |l| l.split("\t")[3] == "AllocTraceTest" }
+end
@@ -0,0 +1,39 @@
+/*
+** mruby/scheduler.h - Fiber scheduler C API
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_SCHEDULER_H
+#define MRUBY_SCHEDULER_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define MRB_SCHED_READABLE 1
+#define MRB_SCHED_WRITABLE 2
+#define MRB_SCHED_ERROR    4
+
+/*
+ * Parks the running fiber until fd is ready for events, or until
+ * timeout seconds have passed (a negative timeout waits forever).
+ * Like Fiber.yield, this switches contexts, so a method written in C
+ * must return its result directly:
+ *
+ *   if (errno == EAGAIN)
+ *     return mrb_sched_wait_fd(mrb, fd, MRB_SCHED_READABLE, -1.0);
+ *
+ * The method call then evaluates to true once fd is ready, or false
+ * on timeout, and the caller retries the operation.
+ */
+mrb_value mrb_sched_wait_fd(mrb_state *mrb, int fd, int events, mrb_float timeout);
+
+/* Creates a fiber running proc and appends it to the run queue. */
+mrb_value mrb_sched_spawn(mrb_state *mrb, mrb_value proc);
+
+#if defined(__cplusplus)
+}  /* extern "C" { */
+#endif
+
+#endif  /* MRUBY_SCHEDULER_H */
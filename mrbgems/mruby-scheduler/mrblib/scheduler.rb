@@ -0,0 +1,253 @@
+##
+# Scheduler
+#
+# Runs fibers cooperatively on top of an epoll loop.  A fiber that
+# would block on a descriptor or a sleep is parked, and resumed once
+# the descriptor is ready or the timer expires.
+#
+#   Scheduler.spawn { Scheduler.sleep 0.1; puts "later" }
+#   Scheduler.spawn { puts "first" }
+#   Scheduler.run
+#
+# Each wait is recorded as [fiber, done, table, fd]; whichever of the
+# descriptor or its timeout fires first marks it done, and the other
+# one is then ignored.
+module Scheduler
+  @runq = []
+  @timers = []
+  @readers = {}
+  @writers = {}
+
+  ##
+  # Creates a fiber running block with args and queues it.
+  def self.spawn(*args, &block)
+    raise ArgumentError, "tried to create a fiber without a block" unless block
+    fiber = Fiber.new(&block)
+    @runq.push [fiber, args]
+    fiber
+  end
+
+  ##
+  # Runs queued fibers until none is left runnable, sleeping or
+  # waiting on a descriptor.
+  #
+  # An exception that ends a fiber does not stop the others: it is
+  # passed to the block with the fiber, if one is given, or else
+  # raised once the rest have finished.
+  def self.run(&handler)
+    error = nil
+    while entry = __next
+      fiber, args = entry
+      next unless fiber.alive?
+      begin
+        fiber.resume(*args)
+      rescue => e
+        __forget(fiber)
+        if handler
+          handler.call(fiber, e)
+        else
+          error ||= e
+        end
+      end
+    end
+    raise error if error
+    nil
+  end
+
+  ##
+  # Lets the other runnable fibers go first.
+  def self.pass
+    @runq.push [Fiber.current, []]
+    Fiber.yield
+    nil
+  end
+
+  ##
+  # Parks the running fiber for sec seconds.
+  def self.sleep(sec)
+    __add_timer(sec, [Fiber.current, false])
+    Fiber.yield
+    nil
+  end
+
+  ##
+  # Parks until fd is readable; false if timeout seconds pass first.
+  def self.wait_readable(fd, timeout=nil)
+    __park(fd, READABLE, timeout)
+    Fiber.yield
+  end
+
+  ##
+  # Parks until fd is writable; false if timeout seconds pass first.
+  def self.wait_writable(fd, timeout=nil)
+    __park(fd, WRITABLE, timeout)
+    Fiber.yield
+  end
+
+  ##
+  # Reads up to len bytes from fd; nil at end of file.
+  def self.read(fd, len)
+    while (s = __read(fd, len)) == false
+      wait_readable(fd)
+    end
+    s
+  end
+
+  ##
+  # Writes all of str to fd and returns its size in bytes.
+  def self.write(fd, str)
+    total = str.bytesize
+    off = 0
+    while off < total
+      n = __write(fd, str, off)
+      if n == false
+        wait_writable(fd)
+      else
+        off += n
+      end
+    end
+    total
+  end
+
+  ##
+  # Accepts a connection on a listening fd.
+  def self.accept(fd)
+    while (c = __accept(fd)) == false
+      wait_readable(fd)
+    end
+    c
+  end
+
+  ##
+  # Connects to host:port and returns the socket fd.
+  def self.tcp_connect(host, port)
+    fd = __connect(host, port)
+    wait_writable(fd)
+    __connect_finish(fd)
+    fd
+  end
+
+  ##
+  # Registers a wait for the running fiber; the caller yields next.
+  def self.__park(fd, events, timeout)
+    fiber = Fiber.current
+    tbl = (events & READABLE) != 0 ? @readers : @writers
+    raise RuntimeError, "fd #{fd} already has a waiting fiber" if tbl[fd]
+    rec = [fiber, false, tbl, fd]
+    tbl[fd] = rec
+    __rearm(fd)
+    __add_timer(timeout, rec) if timeout
+    nil
+  end
+
+  # drops the waits a dead fiber left behind
+  def self.__forget(fiber)
+    [@readers, @writers].each do |tbl|
+      tbl.keys.each do |fd|
+        rec = tbl[fd]
+        if rec[0].equal?(fiber)
+          rec[1] = true
+          tbl.delete(fd)
+          __rearm(fd)
+        end
+      end
+    end
+    @runq = @runq.reject { |e| e[0].equal?(fiber) }
+  end
+
+  def self.__rearm(fd)
+    ev = 0
+    ev |= READABLE if @readers[fd]
+    ev |= WRITABLE if @writers[fd]
+    __epoll_ctl(fd, ev)
+  end
+
+  # @timers is a binary min-heap of [deadline, seq, rec]
+  def self.__add_timer(sec, rec)
+    @seq = (@seq || 0) + 1
+    t = [now + sec, @seq, rec]
+    h = @timers
+    i = h.size
+    h.push t
+    while i > 0
+      parent = (i - 1) >> 1
+      break unless __timer_lt(t, h[parent])
+      h[i] = h[parent]
+      i = parent
+    end
+    h[i] = t
+  end
+
+  def self.__timer_lt(a, b)
+    a[0] < b[0] || (a[0] == b[0] && a[1] < b[1])
+  end
+
+  def self.__pop_timer
+    h = @timers
+    top = h[0]
+    last = h.pop
+    n = h.size
+    if n > 0
+      i = 0
+      while true
+        c = 2 * i + 1
+        break if c >= n
+        c += 1 if c + 1 < n && __timer_lt(h[c+1], h[c])
+        break unless __timer_lt(h[c], last)
+        h[i] = h[c]
+        i = c
+      end
+      h[i] = last
+    end
+    top
+  end
+
+  def self.__wake(rec, val)
+    return if rec[1]
+    rec[1] = true
+    @runq.push [rec[0], [val]]
+  end
+
+  def self.__next
+    while @runq.empty?
+      # drop timeouts of waits that already completed
+      __pop_timer while !@timers.empty? && @timers[0][2][1]
+      return nil if @timers.empty? && @readers.empty? && @writers.empty?
+      if @timers.empty?
+        timeout = -1
+      else
+        timeout = ((@timers[0][0] - now) * 1000).ceil
+        timeout = 0 if timeout < 0
+      end
+      evs = __epoll_wait(timeout)
+      i = 0
+      while i < evs.size
+        fd = evs[i]
+        ev = evs[i+1]
+        if (ev & (READABLE|ERROR)) != 0 && (rec = @readers.delete(fd))
+          __wake(rec, true)
+        end
+        if (ev & (WRITABLE|ERROR)) != 0 && (rec = @writers.delete(fd))
+          __wake(rec, true)
+        end
+        __rearm(fd) if @readers[fd] || @writers[fd]
+        i += 2
+      end
+      unless @timers.empty?
+        t = now
+        while !@timers.empty? && @timers[0][0] <= t
+          rec = __pop_timer[2]
+          unless rec[1]
+            tbl = rec[2]
+            if tbl && tbl[rec[3]].equal?(rec)
+              tbl.delete(rec[3])
+              __rearm(rec[3])
+            end
+            __wake(rec, false)
+          end
+        end
+      end
+    end
+    @runq.shift
+  end
+end
@@ -0,0 +1,427 @@
+/*
+** scheduler.c - Scheduler module
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef __linux__
+# error mruby-scheduler requires epoll (Linux)
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#include "mruby/scheduler.h"
+
+#define SCHED_MAX_EVENTS 256
+#define SCHED_READ_MAX (1024*1024)
+
+#define MARK_CONTEXT_MODIFY(c) (c)->ci->target_class = NULL
+
+static void
+sched_sys_fail(mrb_state *mrb, const char *mesg)
+{
+  mrb_raisef(mrb, E_RUNTIME_ERROR, "%S: %S",
+             mrb_str_new_cstr(mrb, mesg), mrb_str_new_cstr(mrb, strerror(errno)));
+}
+
+static struct RClass*
+sched_module(mrb_state *mrb)
+{
+  return mrb_class_get(mrb, "Scheduler");
+}
+
+static int
+sched_epfd(mrb_state *mrb)
+{
+  mrb_value fd = mrb_iv_get(mrb, mrb_obj_value(sched_module(mrb)), mrb_intern_lit(mrb, "__epfd"));
+
+  if (!mrb_fixnum_p(fd)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "scheduler poller is not available");
+  }
+  return (int)mrb_fixnum(fd);
+}
+
+static int
+set_nonblock(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+
+  if (flags < 0) return -1;
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int
+fill_addr(mrb_state *mrb, struct sockaddr_in *addr, mrb_value host, mrb_int port)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons((unsigned short)port);
+  return inet_pton(AF_INET, mrb_string_value_cstr(mrb, &host), &addr->sin_addr);
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.now -> float
+ *
+ *  Returns the monotonic clock in seconds.
+ */
+static mrb_value
+sched_now(mrb_state *mrb, mrb_value self)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return mrb_float_value(mrb, (mrb_float)ts.tv_sec + (mrb_float)ts.tv_nsec / 1e9);
+}
+
+/* Scheduler.__epoll_ctl(fd, events): arm fd for the next event (oneshot) */
+static mrb_value
+sched_epoll_ctl(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd, events;
+  struct epoll_event ev;
+  int epfd = sched_epfd(mrb);
+
+  mrb_get_args(mrb, "ii", &fd, &events);
+  if (events == 0) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, (int)fd, NULL);
+    return mrb_nil_value();
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLONESHOT;
+  if (events & MRB_SCHED_READABLE) ev.events |= EPOLLIN;
+  if (events & MRB_SCHED_WRITABLE) ev.events |= EPOLLOUT;
+  ev.data.fd = (int)fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_MOD, (int)fd, &ev) < 0) {
+    if (errno != ENOENT || epoll_ctl(epfd, EPOLL_CTL_ADD, (int)fd, &ev) < 0) {
+      sched_sys_fail(mrb, "epoll_ctl");
+    }
+  }
+  return mrb_nil_value();
+}
+
+/*
+ * Scheduler.__epoll_wait(timeout_ms) -> [fd, events, fd, events, ...]
+ * A negative timeout blocks until some fd becomes ready.  Before the
+ * loop goes to sleep, pending GC sweep work is finished.
+ */
+static mrb_value
+sched_epoll_wait(mrb_state *mrb, mrb_value self)
+{
+  mrb_int timeout;
+  struct epoll_event evs[SCHED_MAX_EVENTS];
+  mrb_value ary;
+  int i, n;
+
+  mrb_get_args(mrb, "i", &timeout);
+  n = epoll_wait(sched_epfd(mrb), evs, SCHED_MAX_EVENTS, 0);
+  if (n == 0 && timeout != 0) {
+    mrb_gc_idle(mrb);
+    n = epoll_wait(sched_epfd(mrb), evs, SCHED_MAX_EVENTS, (int)timeout);
+  }
+  if (n < 0) {
+    if (errno != EINTR) sched_sys_fail(mrb, "epoll_wait");
+    n = 0;
+  }
+  ary = mrb_ary_new_capa(mrb, n * 2);
+  for (i = 0; i < n; i++) {
+    mrb_int events = 0;
+
+    if (evs[i].events & EPOLLIN) events |= MRB_SCHED_READABLE;
+    if (evs[i].events & EPOLLOUT) events |= MRB_SCHED_WRITABLE;
+    if (evs[i].events & (EPOLLERR|EPOLLHUP)) events |= MRB_SCHED_ERROR;
+    mrb_ary_push(mrb, ary, mrb_fixnum_value(evs[i].data.fd));
+    mrb_ary_push(mrb, ary, mrb_fixnum_value(events));
+  }
+  return ary;
+}
+
+/* Scheduler.__read(fd, len) -> string, nil at end of file, false if it would block */
+static mrb_value
+sched_read(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd, len;
+  mrb_value buf;
+  ssize_t n;
+
+  mrb_get_args(mrb, "ii", &fd, &len);
+  if (len < 0) mrb_raise(mrb, E_ARGUMENT_ERROR, "negative length");
+  if (len > SCHED_READ_MAX) len = SCHED_READ_MAX;
+  buf = mrb_str_buf_new(mrb, len);
+  n = read((int)fd, RSTRING_PTR(buf), (size_t)len);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return mrb_false_value();
+    sched_sys_fail(mrb, "read");
+  }
+  if (n == 0 && len > 0) return mrb_nil_value();
+  return mrb_str_resize(mrb, buf, (mrb_int)n);
+}
+
+/* Scheduler.__write(fd, str, off = 0) -> bytes written from byte offset
+   off, false if it would block */
+static mrb_value
+sched_write(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd, off = 0;
+  mrb_value str;
+  ssize_t n;
+
+  mrb_get_args(mrb, "iS|i", &fd, &str, &off);
+  if (off < 0 || off > RSTRING_LEN(str)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "offset out of string");
+  }
+  n = write((int)fd, RSTRING_PTR(str) + off, RSTRING_LEN(str) - off);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return mrb_false_value();
+    sched_sys_fail(mrb, "write");
+  }
+  return mrb_fixnum_value((mrb_int)n);
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.close(fd) -> nil
+ */
+static mrb_value
+sched_close(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd;
+
+  mrb_get_args(mrb, "i", &fd);
+  if (close((int)fd) < 0) sched_sys_fail(mrb, "close");
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.pipe -> [read_fd, write_fd]
+ *
+ *  Creates a non-blocking pipe.
+ */
+static mrb_value
+sched_pipe(mrb_state *mrb, mrb_value self)
+{
+  int fds[2];
+  mrb_value ary;
+
+  if (pipe(fds) < 0) sched_sys_fail(mrb, "pipe");
+  set_nonblock(fds[0]);
+  set_nonblock(fds[1]);
+  ary = mrb_ary_new_capa(mrb, 2);
+  mrb_ary_push(mrb, ary, mrb_fixnum_value(fds[0]));
+  mrb_ary_push(mrb, ary, mrb_fixnum_value(fds[1]));
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.tcp_listen(host, port, backlog=1024) -> fd
+ *
+ *  Opens a non-blocking IPv4 listening socket.
+ */
+static mrb_value
+sched_tcp_listen(mrb_state *mrb, mrb_value self)
+{
+  mrb_value host;
+  mrb_int port, backlog = 1024;
+  struct sockaddr_in addr;
+  int fd, on = 1;
+
+  mrb_get_args(mrb, "Si|i", &host, &port, &backlog);
+  if (fill_addr(mrb, &addr, host, port) != 1) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid address: %S", host);
+  }
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) sched_sys_fail(mrb, "socket");
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(fd, (int)backlog) < 0 ||
+      set_nonblock(fd) < 0) {
+    int e = errno;
+
+    close(fd);
+    errno = e;
+    sched_sys_fail(mrb, "tcp_listen");
+  }
+  return mrb_fixnum_value(fd);
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.local_port(fd) -> port
+ */
+static mrb_value
+sched_local_port(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd;
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+
+  mrb_get_args(mrb, "i", &fd);
+  if (getsockname((int)fd, (struct sockaddr*)&addr, &len) < 0) sched_sys_fail(mrb, "getsockname");
+  return mrb_fixnum_value(ntohs(addr.sin_port));
+}
+
+/* Scheduler.__accept(fd) -> client fd, false if it would block */
+static mrb_value
+sched_accept(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd;
+  int c, on = 1;
+
+  mrb_get_args(mrb, "i", &fd);
+  c = accept((int)fd, NULL, NULL);
+  if (c < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return mrb_false_value();
+    sched_sys_fail(mrb, "accept");
+  }
+  set_nonblock(c);
+  setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return mrb_fixnum_value(c);
+}
+
+/* Scheduler.__connect(host, port) -> fd with the connection in progress */
+static mrb_value
+sched_connect(mrb_state *mrb, mrb_value self)
+{
+  mrb_value host;
+  mrb_int port;
+  struct sockaddr_in addr;
+  int fd, on = 1;
+
+  mrb_get_args(mrb, "Si", &host, &port);
+  if (fill_addr(mrb, &addr, host, port) != 1) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid address: %S", host);
+  }
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) sched_sys_fail(mrb, "socket");
+  set_nonblock(fd);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    int e = errno;
+
+    close(fd);
+    errno = e;
+    sched_sys_fail(mrb, "connect");
+  }
+  return mrb_fixnum_value(fd);
+}
+
+/* Scheduler.__connect_finish(fd): raises if the pending connect failed */
+static mrb_value
+sched_connect_finish(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd;
+  int err = 0;
+  socklen_t len = sizeof(err);
+
+  mrb_get_args(mrb, "i", &fd);
+  if (getsockopt((int)fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) sched_sys_fail(mrb, "getsockopt");
+  if (err != 0) {
+    close((int)fd);
+    errno = err;
+    sched_sys_fail(mrb, "connect");
+  }
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.raise_fd_limit -> limit
+ *
+ *  Raises the soft limit on open descriptors to the hard limit, so a
+ *  single interpreter can hold thousands of connections.
+ */
+static mrb_value
+sched_raise_fd_limit(mrb_state *mrb, mrb_value self)
+{
+  struct rlimit rl;
+
+  if (getrlimit(RLIMIT_NOFILE, &rl) < 0) sched_sys_fail(mrb, "getrlimit");
+  if (rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+  }
+  if (rl.rlim_cur == RLIM_INFINITY) return mrb_fixnum_value(MRB_INT_MAX);
+  return mrb_fixnum_value((mrb_int)rl.rlim_cur);
+}
+
+mrb_value
+mrb_sched_wait_fd(mrb_state *mrb, int fd, int events, mrb_float timeout)
+{
+  struct mrb_context *c = mrb->c;
+  mrb_value tmo = timeout < 0 ? mrb_nil_value() : mrb_float_value(mrb, timeout);
+
+  if (!c->prev) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "can't wait from root fiber");
+  }
+  mrb_funcall(mrb, mrb_obj_value(sched_module(mrb)), "__park", 3,
+              mrb_fixnum_value(fd), mrb_fixnum_value(events), tmo);
+  /* same switch as Fiber.yield; the resumer gets nil */
+  c->prev->status = MRB_FIBER_RUNNING;
+  mrb->c = c->prev;
+  c->prev = NULL;
+  MARK_CONTEXT_MODIFY(mrb->c);
+  return mrb_nil_value();
+}
+
+mrb_value
+mrb_sched_spawn(mrb_state *mrb, mrb_value proc)
+{
+  mrb_value mod = mrb_obj_value(sched_module(mrb));
+
+  return mrb_funcall_with_block(mrb, mod, mrb_intern_lit(mrb, "spawn"), 0, NULL, proc);
+}
+
+void
+mrb_mruby_scheduler_gem_init(mrb_state* mrb)
+{
+  struct RClass *s = mrb_define_module(mrb, "Scheduler");
+  int epfd;
+
+  mrb_define_const(mrb, s, "READABLE", mrb_fixnum_value(MRB_SCHED_READABLE));
+  mrb_define_const(mrb, s, "WRITABLE", mrb_fixnum_value(MRB_SCHED_WRITABLE));
+  mrb_define_const(mrb, s, "ERROR", mrb_fixnum_value(MRB_SCHED_ERROR));
+
+  mrb_define_class_method(mrb, s, "now", sched_now, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, s, "close", sched_close, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, s, "pipe", sched_pipe, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, s, "tcp_listen", sched_tcp_listen, MRB_ARGS_ARG(2,1));
+  mrb_define_class_method(mrb, s, "local_port", sched_local_port, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, s, "raise_fd_limit", sched_raise_fd_limit, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, s, "__epoll_ctl", sched_epoll_ctl, MRB_ARGS_REQ(2));
+  mrb_define_class_method(mrb, s, "__epoll_wait", sched_epoll_wait, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, s, "__read", sched_read, MRB_ARGS_REQ(2));
+  mrb_define_class_method(mrb, s, "__write", sched_write, MRB_ARGS_ARG(2,1));
+  mrb_define_class_method(mrb, s, "__accept", sched_accept, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, s, "__connect", sched_connect, MRB_ARGS_REQ(2));
+  mrb_define_class_method(mrb, s, "__connect_finish", sched_connect_finish, MRB_ARGS_REQ(1));
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd >= 0) {
+    mrb_iv_set(mrb, mrb_obj_value(s), mrb_intern_lit(mrb, "__epfd"), mrb_fixnum_value(epfd));
+  }
+}
+
+void
+mrb_mruby_scheduler_gem_final(mrb_state* mrb)
+{
+  struct RClass *s = mrb_class_get(mrb, "Scheduler");
+  mrb_value fd = mrb_iv_get(mrb, mrb_obj_value(s), mrb_intern_lit(mrb, "__epfd"));
+
+  if (mrb_fixnum_p(fd)) close((int)mrb_fixnum(fd));
+}
@@ -0,0 +1,39 @@
+#include <errno.h>
+#include <unistd.h>
+#include "mruby.h"
+#include "mruby/string.h"
+#include "mruby/scheduler.h"
+
+static mrb_value
+sched_test_read(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fd;
+  char buf[64];
+  ssize_t n;
+
+  mrb_get_args(mrb, "i", &fd);
+  n = read((int)fd, buf, sizeof(buf));
+  if (n < 0 && errno == EAGAIN) {
+    return mrb_sched_wait_fd(mrb, (int)fd, MRB_SCHED_READABLE, -1.0);
+  }
+  if (n <= 0) return mrb_nil_value();
+  return mrb_str_new(mrb, buf, n);
+}
+
+static mrb_value
+sched_test_spawn(mrb_state *mrb, mrb_value self)
+{
+  mrb_value blk;
+
+  mrb_get_args(mrb, "&", &blk);
+  return mrb_sched_spawn(mrb, blk);
+}
+
+void
+mrb_mruby_scheduler_gem_test(mrb_state *mrb)
+{
+  struct RClass *t = mrb_define_module(mrb, "SchedulerTest");
+
+  mrb_define_class_method(mrb, t, "read", sched_test_read, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, t, "spawn", sched_test_spawn, MRB_ARGS_BLOCK());
+}
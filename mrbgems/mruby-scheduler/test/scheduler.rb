@@ -0,0 +1,175 @@
+##
+# Scheduler Test
+
+assert('Scheduler.spawn and run') {
+  log = []
+  Scheduler.spawn(1, 2) {|a, b| log << a + b }
+  Scheduler.spawn { log << :second }
+  Scheduler.run
+  log == [3, :second]
+}
+
+assert('Scheduler.pass') {
+  log = []
+  Scheduler.spawn { log << 1; Scheduler.pass; log << 3 }
+  Scheduler.spawn { log << 2 }
+  Scheduler.run
+  log == [1, 2, 3]
+}
+
+assert('Scheduler.sleep') {
+  log = []
+  Scheduler.spawn { Scheduler.sleep 0.02; log << :late }
+  Scheduler.spawn { Scheduler.sleep 0.01; log << :early }
+  Scheduler.spawn { log << :now }
+  t = Scheduler.now
+  Scheduler.run
+  log == [:now, :early, :late] and Scheduler.now - t >= 0.02
+}
+
+assert('Scheduler.read and write on a pipe') {
+  r, w = Scheduler.pipe
+  got = []
+  Scheduler.spawn {
+    while s = Scheduler.read(r, 100)
+      got << s
+    end
+  }
+  Scheduler.spawn {
+    Scheduler.write(w, "abc")
+    Scheduler.sleep 0.01
+    Scheduler.write(w, "def")
+    Scheduler.close(w)
+  }
+  Scheduler.run
+  Scheduler.close(r)
+  got == ["abc", "def"]
+}
+
+assert('Scheduler.write parks while the pipe is full') {
+  r, w = Scheduler.pipe
+  data = "x" * 1000
+  n = 0
+  Scheduler.spawn {
+    200.times { n += Scheduler.write(w, data) }
+    Scheduler.close(w)
+  }
+  total = 0
+  Scheduler.spawn {
+    while s = Scheduler.read(r, 4096)
+      total += s.size
+    end
+  }
+  Scheduler.run
+  Scheduler.close(r)
+  n == 200000 and total == 200000
+}
+
+assert('Scheduler.write counts bytes') {
+  r, w = Scheduler.pipe
+  data = "\xC3\xA9" * 100000
+  n = nil
+  Scheduler.spawn {
+    n = Scheduler.write(w, data)
+    Scheduler.close(w)
+  }
+  got = ""
+  Scheduler.spawn {
+    while s = Scheduler.read(r, 4096)
+      got << s
+    end
+  }
+  Scheduler.run
+  Scheduler.close(r)
+  n == 200000 and got == data
+}
+
+assert('Scheduler.wait_readable timeout') {
+  r, w = Scheduler.pipe
+  res = nil
+  Scheduler.spawn { res = Scheduler.wait_readable(r, 0.01) }
+  t = Scheduler.now
+  Scheduler.run
+  Scheduler.close(r)
+  Scheduler.close(w)
+  res == false and Scheduler.now - t < 1
+}
+
+assert('Scheduler TCP echo') {
+  server = Scheduler.tcp_listen("127.0.0.1", 0)
+  port = Scheduler.local_port(server)
+  replies = []
+  Scheduler.spawn {
+    3.times {
+      Scheduler.spawn(Scheduler.accept(server)) {|c|
+        while s = Scheduler.read(c, 100)
+          Scheduler.write(c, s)
+        end
+        Scheduler.close(c)
+      }
+    }
+  }
+  3.times {|i|
+    Scheduler.spawn {
+      fd = Scheduler.tcp_connect("127.0.0.1", port)
+      Scheduler.write(fd, "hi#{i}")
+      replies << Scheduler.read(fd, 100)
+      Scheduler.close(fd)
+    }
+  }
+  Scheduler.run
+  Scheduler.close(server)
+  replies.sort == ["hi0", "hi1", "hi2"]
+}
+
+assert('mrb_sched_wait_fd') {
+  r, w = Scheduler.pipe
+  got = nil
+  SchedulerTest.spawn {
+    s = true
+    s = SchedulerTest.read(r) while s == true
+    got = s
+  }
+  Scheduler.spawn { Scheduler.sleep 0.01; Scheduler.write(w, "from C") }
+  Scheduler.run
+  Scheduler.close(r)
+  Scheduler.close(w)
+  got == "from C"
+}
+
+assert('Scheduler.run rescues per fiber') {
+  log = []
+  errors = []
+  Scheduler.spawn { log << 1; raise "first" }
+  Scheduler.spawn { Scheduler.sleep 0.01; log << 2 }
+  Scheduler.spawn { Scheduler.pass; raise ArgumentError, "second" }
+  Scheduler.spawn { Scheduler.pass; log << 3 }
+  Scheduler.run {|f, e| errors << e.message }
+  log == [1, 3, 2] and errors == ["first", "second"]
+}
+
+assert('Scheduler.run raises after the other fibers finish') {
+  log = []
+  Scheduler.spawn { raise "boom" }
+  Scheduler.spawn { Scheduler.sleep 0.01; log << :done }
+  msg = nil
+  begin
+    Scheduler.run
+  rescue => e
+    msg = e.message
+  end
+  msg == "boom" and log == [:done]
+}
+
+assert('Scheduler.run drops the waits of a failed fiber') {
+  r, w = Scheduler.pipe
+  Scheduler.spawn {
+    Scheduler.__park(r, Scheduler::READABLE, 5)
+    raise "before yield"
+  }
+  t = Scheduler.now
+  Scheduler.run {|f, e| }
+  Scheduler.close(r)
+  Scheduler.close(w)
+  Scheduler.now - t < 1
+}
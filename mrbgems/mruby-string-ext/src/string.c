@@ -163,6 +163,66 @@ mrb_str_end_with(mrb_state *mrb, mrb_value self)
   return mrb_false_value();
 }
 
+#define STRIP_SPACE_P(c) ((c) == ' ' || ('\t' <= (c) && (c) <= '\r'))
+
+static mrb_value
+str_strip(mrb_state *mrb, mrb_value str, int left, int right)
+{
+  const char *p = RSTRING_PTR(str);
+  mrb_int beg = 0, end = RSTRING_LEN(str);
+
+  if (left) {
+    while (beg < end && STRIP_SPACE_P(p[beg])) beg++;
+  }
+  if (right) {
+    while (beg < end && (STRIP_SPACE_P(p[end-1]) || p[end-1] == '\0')) end--;
+  }
+  /* the result shares the receiver's buffer */
+  return mrb_str_substr(mrb, str, beg, end - beg);
+}
+
+/*
+ *  call-seq:
+ *     str.lstrip   -> new_str
+ *
+ *  Returns a copy of <i>str</i> with leading whitespace removed.
+ *
+ *     "  hello  ".lstrip   #=> "hello  "
+ */
+static mrb_value
+mrb_str_lstrip(mrb_state *mrb, mrb_value self)
+{
+  return str_strip(mrb, self, TRUE, FALSE);
+}
+
+/*
+ *  call-seq:
+ *     str.rstrip   -> new_str
+ *
+ *  Returns a copy of <i>str</i> with trailing whitespace and nulls removed.
+ *
+ *     "  hello  ".rstrip   #=> "  hello"
+ */
+static mrb_value
+mrb_str_rstrip(mrb_state *mrb, mrb_value self)
+{
+  return str_strip(mrb, self, FALSE, TRUE);
+}
+
+/*
+ *  call-seq:
+ *     str.strip   -> new_str
+ *
+ *  Returns a copy of <i>str</i> with leading and trailing whitespace removed.
+ *
+ *     "\tgoodbye\r\n".strip   #=> "goodbye"
+ */
+static mrb_value
+mrb_str_strip(mrb_state *mrb, mrb_value self)
+{
+  return str_strip(mrb, self, TRUE, TRUE);
+}
+
 void
 mrb_mruby_string_ext_gem_init(mrb_state* mrb)
 {
@@ -176,6 +236,9 @@ mrb_mruby_string_ext_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, s, "<<",              mrb_str_concat2,         MRB_ARGS_REQ(1));
   mrb_define_method(mrb, s, "start_with?",     mrb_str_start_with,      MRB_ARGS_REST());
   mrb_define_method(mrb, s, "end_with?",       mrb_str_end_with,        MRB_ARGS_REST());
+  mrb_define_method(mrb, s, "lstrip",          mrb_str_lstrip,          MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "rstrip",          mrb_str_rstrip,          MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "strip",           mrb_str_strip,           MRB_ARGS_NONE());
 }
 
 void
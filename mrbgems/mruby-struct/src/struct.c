@@ -11,6 +11,7 @@
 #include "mruby/string.h"
 #include "mruby/class.h"
 #include "mruby/data.h"
+#include "mruby/proc.h"
 #include "mruby/variable.h"
 
 #define RSTRUCT_ARY(st) mrb_ary_ptr(st)
@@ -129,38 +130,17 @@ mrb_struct_getmember(mrb_state *mrb, mrb_value obj, mrb_sym id)
   return mrb_nil_value();       /* not reached */
 }
 
+/* member reader; the slot index is kept in the method proc */
 static mrb_value
 mrb_struct_ref(mrb_state *mrb, mrb_value obj)
 {
-  return mrb_struct_getmember(mrb, obj, mrb->c->ci->mid);
-}
-
-static mrb_value mrb_struct_ref0(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[0];}
-static mrb_value mrb_struct_ref1(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[1];}
-static mrb_value mrb_struct_ref2(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[2];}
-static mrb_value mrb_struct_ref3(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[3];}
-static mrb_value mrb_struct_ref4(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[4];}
-static mrb_value mrb_struct_ref5(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[5];}
-static mrb_value mrb_struct_ref6(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[6];}
-static mrb_value mrb_struct_ref7(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[7];}
-static mrb_value mrb_struct_ref8(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[8];}
-static mrb_value mrb_struct_ref9(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[9];}
-
-#define numberof(array) (int)(sizeof(array) / sizeof((array)[0]))
-#define N_REF_FUNC numberof(ref_func)
-
-static mrb_value (*const ref_func[])(mrb_state*, mrb_value) = {
-  mrb_struct_ref0,
-  mrb_struct_ref1,
-  mrb_struct_ref2,
-  mrb_struct_ref3,
-  mrb_struct_ref4,
-  mrb_struct_ref5,
-  mrb_struct_ref6,
-  mrb_struct_ref7,
-  mrb_struct_ref8,
-  mrb_struct_ref9,
-};
+  mrb_int i = mrb_fixnum(mrb_cfunc_env_get(mrb, 0));
+
+  if (i < RSTRUCT_LEN(obj)) {
+    return RSTRUCT_PTR(obj)[i];
+  }
+  return mrb_nil_value();
+}
 
 mrb_sym
 mrb_id_attrset(mrb_state *mrb, mrb_sym id)
@@ -181,40 +161,16 @@ mrb_id_attrset(mrb_state *mrb, mrb_sym id)
   return mid;
 }
 
-static mrb_value
-mrb_struct_set(mrb_state *mrb, mrb_value obj, mrb_value val)
-{
-  const char *name;
-  size_t i, len;
-  mrb_sym mid;
-  mrb_value members, slot, *ptr, *ptr_members;
-
-  /* get base id */
-  name = mrb_sym2name_len(mrb, mrb->c->ci->mid, &len);
-  mid = mrb_intern(mrb, name, len-1); /* omit last "=" */
-
-  members = mrb_struct_members(mrb, obj);
-  ptr_members = RARRAY_PTR(members);
-  len = RARRAY_LEN(members);
-  ptr = RSTRUCT_PTR(obj);
-  for (i=0; i<len; i++) {
-    slot = ptr_members[i];
-    if (mrb_symbol(slot) == mid) {
-      return ptr[i] = val;
-    }
-  }
-  mrb_raisef(mrb, E_INDEX_ERROR, "`%S' is not a struct member",
-             mrb_sym2str(mrb, mid));
-  return mrb_nil_value();            /* not reached */
-}
-
+/* member writer; the slot index is kept in the method proc */
 static mrb_value
 mrb_struct_set_m(mrb_state *mrb, mrb_value obj)
 {
+  mrb_int i = mrb_fixnum(mrb_cfunc_env_get(mrb, 0));
   mrb_value val;
 
   mrb_get_args(mrb, "o", &val);
-  return mrb_struct_set(mrb, obj, val);
+  mrb_ary_set(mrb, obj, i, val);
+  return val;
 }
 
 #define is_notop_id(id) (id)//((id)>tLAST_TOKEN)
@@ -269,13 +225,19 @@ make_struct(mrb_state *mrb, mrb_value name, mrb_value members, struct RClass * k
   for (i=0; i< len; i++) {
     mrb_sym id = mrb_symbol(ptr_members[i]);
     if (mrb_is_local_id(id) || mrb_is_const_id(id)) {
-      if (i < N_REF_FUNC) {
-        mrb_define_method_id(mrb, c, id, ref_func[i], MRB_ARGS_NONE());
-      }
-      else {
-        mrb_define_method_id(mrb, c, id, mrb_struct_ref, MRB_ARGS_NONE());
-      }
-      mrb_define_method_id(mrb, c, mrb_id_attrset(mrb, id), mrb_struct_set_m, MRB_ARGS_REQ(1));
+      mrb_value at = mrb_fixnum_value(i);
+      int ai = mrb_gc_arena_save(mrb);
+      struct RProc *p;
+
+      p = mrb_proc_new_cfunc_with_env(mrb, mrb_struct_ref, 1, &at);
+      p->flags |= MRB_PROC_AREF;
+      p->target_class = c;
+      mrb_define_method_raw(mrb, c, id, p);
+      p = mrb_proc_new_cfunc_with_env(mrb, mrb_struct_set_m, 1, &at);
+      p->flags |= MRB_PROC_ASET;
+      p->target_class = c;
+      mrb_define_method_raw(mrb, c, mrb_id_attrset(mrb, id), p);
+      mrb_gc_arena_restore(mrb, ai);
     }
   }
   return nstr;
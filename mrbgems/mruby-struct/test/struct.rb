@@ -73,5 +73,25 @@ if Object.const_defined?(:Struct)
     cc = c.new(1,2)
     cc.select{|v| v % 2 == 0} == [2]
   end
+
+  assert('Struct member accessors') do
+    c = Struct.new(:m1, :m2, :m3, :m4, :m5, :m6, :m7, :m8, :m9, :m10, :m11, :m12)
+    cc = c.new(*(1..12).to_a)
+    assert_equal 1, cc.m1
+    assert_equal 12, cc.m12
+    cc.m11 = :x
+    assert_equal :x, cc.m11
+    assert_equal :x, cc[10]
+    assert_equal 12, cc.send(:m12)
+    assert_equal 5, cc.__send__(:m5=, 5)
+
+    d = Class.new(c) do
+      def initialize; end
+    end
+    dd = d.new
+    assert_nil dd.m3
+    dd.m3 = 3
+    assert_equal 3, dd.m3
+  end
 end
 
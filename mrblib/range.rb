@@ -11,11 +11,38 @@ class Range
   # ISO 15.2.14.4.4
   def each(&block)
     val = self.first
+    last = self.last
+
+    if val.kind_of?(Fixnum) && last.kind_of?(Fixnum)
+      # no <=> nor succ: OP_LT and OP_ADD handle Fixnums inline
+      lim = last
+      lim += 1 unless exclude_end?
+      while val < lim
+        block.call(val)
+        val += 1
+      end
+      return self
+    end
+
     unless val.respond_to? :succ
       raise TypeError, "can't iterate"
     end
 
-    last = self.last
+    if val.kind_of?(String) && last.kind_of?(String)
+      # as String#upto: stops when val outgrows last
+      c = val <=> last
+      return self if c > 0 || (c == 0 && exclude_end?)
+      len = last.size
+      while true
+        break if exclude_end? && val == last
+        block.call(val)
+        break if val == last
+        val = val.succ
+        break if val.size > len || val.size == 0
+      end
+      return self
+    end
+
     return self if (val <=> last) > 0
 
     while((val <=> last) < 0)
@@ -28,6 +55,41 @@ class Range
     end
     self
   end
+
+  ##
+  # Calls the given block with every n-th element of +self+,
+  # starting with the first.
+  def step(n=1, &block)
+    raise ArgumentError, "step can't be negative" if n < 0
+    raise ArgumentError, "step can't be 0" if n == 0
+    val = self.first
+    last = self.last
+
+    if val.kind_of?(Fixnum) && last.kind_of?(Fixnum) && n.kind_of?(Fixnum)
+      lim = last
+      lim += 1 unless exclude_end?
+      while val < lim
+        block.call(val)
+        val += n
+      end
+    elsif val.kind_of?(Numeric) && last.kind_of?(Numeric)
+      # beg + i*n rather than a running sum, which drifts for Floats
+      i = 0
+      while true
+        v = val + i * n
+        break if exclude_end? ? v >= last : v > last
+        block.call(v)
+        i += 1
+      end
+    else
+      i = 0
+      each do |v|
+        block.call(v) if i % n == 0
+        i += 1
+      end
+    end
+    self
+  end
 end
 
 ##
@@ -7,6 +7,7 @@
 #include "mruby.h"
 #include <stdarg.h>
 #include <ctype.h>
+#include <string.h>
 #include "mruby/array.h"
 #include "mruby/class.h"
 #include "mruby/numeric.h"
@@ -299,6 +300,7 @@ mrb_define_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, struct RPro
   if (!h) h = c->mt = kh_init(mt, mrb);
   k = kh_put(mt, mrb, h, mid);
   kh_value(h, k) = p;
+  mrb->method_serial++;
   if (p) {
     mrb_field_write_barrier(mrb, (struct RBasic *)c, (struct RBasic *)p);
   }
@@ -333,6 +335,7 @@ mrb_define_method_vm(mrb_state *mrb, struct RClass *c, mrb_sym name, mrb_value b
   k = kh_put(mt, mrb, h, name);
   p = mrb_proc_ptr(body);
   kh_value(h, k) = p;
+  mrb->method_serial++;
   if (p) {
     mrb_field_write_barrier(mrb, (struct RBasic *)c, (struct RBasic *)p);
   }
@@ -656,6 +659,9 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
           bp = mrb->c->stack + mrb->c->ci->argc + 1;
         }
         *p = *bp;
+        if (mrb_type(*p) == MRB_TT_PROC) {
+          mrb_proc_escape(mrb, mrb_proc_ptr(*p));
+        }
       }
       break;
     case '|':
@@ -744,6 +750,7 @@ mrb_include_module(mrb_state *mrb, struct RClass *c, struct RClass *m)
     ic->super = ins_pos->super;
     ins_pos->super = ic;
     mrb_field_write_barrier(mrb, (struct RBasic*)ins_pos, (struct RBasic*)ic);
+    mrb->method_serial++;
     ins_pos = ic;
   skip:
     m = m->super;
@@ -960,6 +967,10 @@ mrb_singleton_class(mrb_state *mrb, mrb_value v)
     break;
   }
   obj = mrb_basic_ptr(v);
+  if (MRB_FROZEN_P(obj) && obj->c->tt != MRB_TT_SCLASS) {
+    /* frozen literals are shared between evaluations, like immediates */
+    mrb_raise(mrb, E_TYPE_ERROR, "can't define singleton");
+  }
   prepare_singleton_class(mrb, obj);
   return mrb_obj_value(obj->c);
 }
@@ -1497,6 +1508,89 @@ mod_define_method(mrb_state *mrb, mrb_value self)
   return mrb_symbol_value(mid);
 }
 
+/* ivar name for an attribute; the symbol is kept in the accessor proc */
+static mrb_value
+attr_ivar_name(mrb_state *mrb, mrb_value name)
+{
+  mrb_value str;
+
+  name = mrb_sym2str(mrb, mrb_obj_to_sym(mrb, name));
+  if (memchr(RSTRING_PTR(name), '@', RSTRING_LEN(name)) ||
+      memchr(RSTRING_PTR(name), '?', RSTRING_LEN(name)) ||
+      memchr(RSTRING_PTR(name), '$', RSTRING_LEN(name))) {
+    mrb_name_error(mrb, mrb_intern_str(mrb, name),
+                   "%S is not allowed as an instance variable name", mrb_inspect(mrb, name));
+  }
+  str = mrb_str_new(mrb, "@", 1);
+  mrb_str_concat(mrb, str, name);
+  return mrb_symbol_value(mrb_intern_str(mrb, str));
+}
+
+static mrb_value
+attr_reader(mrb_state *mrb, mrb_value obj)
+{
+  mrb_get_args(mrb, "");
+  return mrb_iv_get(mrb, obj, mrb_symbol(mrb_cfunc_env_get(mrb, 0)));
+}
+
+static mrb_value
+attr_writer(mrb_state *mrb, mrb_value obj)
+{
+  mrb_value val;
+
+  mrb_get_args(mrb, "o", &val);
+  mrb_iv_set(mrb, obj, mrb_symbol(mrb_cfunc_env_get(mrb, 0)), val);
+  return val;
+}
+
+/* 15.2.2.4.13 */
+static mrb_value
+mrb_mod_attr_reader(mrb_state *mrb, mrb_value mod)
+{
+  struct RClass *c = mrb_class_ptr(mod);
+  mrb_value *argv;
+  int argc, i;
+
+  mrb_get_args(mrb, "*", &argv, &argc);
+  for (i=0; i<argc; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_value ivname = attr_ivar_name(mrb, argv[i]);
+    struct RProc *p;
+
+    p = mrb_proc_new_cfunc_with_env(mrb, attr_reader, 1, &ivname);
+    p->flags |= MRB_PROC_IVGET;
+    p->target_class = c;
+    mrb_define_method_raw(mrb, c, mrb_obj_to_sym(mrb, argv[i]), p);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return mrb_nil_value();
+}
+
+/* 15.2.2.4.14 */
+static mrb_value
+mrb_mod_attr_writer(mrb_state *mrb, mrb_value mod)
+{
+  struct RClass *c = mrb_class_ptr(mod);
+  mrb_value *argv;
+  int argc, i;
+
+  mrb_get_args(mrb, "*", &argv, &argc);
+  for (i=0; i<argc; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_value ivname = attr_ivar_name(mrb, argv[i]);
+    mrb_value name = mrb_sym2str(mrb, mrb_obj_to_sym(mrb, argv[i]));
+    struct RProc *p;
+
+    p = mrb_proc_new_cfunc_with_env(mrb, attr_writer, 1, &ivname);
+    p->flags |= MRB_PROC_IVSET;
+    p->target_class = c;
+    mrb_str_cat(mrb, name, "=", 1);
+    mrb_define_method_raw(mrb, c, mrb_intern_str(mrb, name), p);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return mrb_nil_value();
+}
+
 static void
 check_cv_name_sym(mrb_state *mrb, mrb_sym id)
 {
@@ -1738,6 +1832,7 @@ remove_method(mrb_state *mrb, mrb_value mod, mrb_sym mid)
     k = kh_get(mt, mrb, h, mid);
     if (k != kh_end(h)) {
       kh_del(mt, mrb, h, k);
+      mrb->method_serial++;
       return;
     }
   }
@@ -1959,6 +2054,8 @@ mrb_init_class(mrb_state *mrb)
   mrb_define_method(mrb, mod, "remove_const",            mrb_mod_remove_const,     MRB_ARGS_REQ(1)); /* 15.2.2.4.40 */
   mrb_define_method(mrb, mod, "const_missing",           mrb_mod_const_missing,    MRB_ARGS_REQ(1));
   mrb_define_method(mrb, mod, "define_method",           mod_define_method,        MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mod, "attr_reader",             mrb_mod_attr_reader,      MRB_ARGS_ANY());  /* 15.2.2.4.13 */
+  mrb_define_method(mrb, mod, "attr_writer",             mrb_mod_attr_writer,      MRB_ARGS_ANY());  /* 15.2.2.4.14 */
   mrb_define_method(mrb, mod, "class_variables",         mrb_mod_class_variables,  MRB_ARGS_NONE()); /* 15.2.2.4.19 */
   mrb_define_method(mrb, mod, "===",                     mrb_mod_eqq,              MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, mod, "constants",         mrb_mod_s_constants,      MRB_ARGS_ANY());  /* 15.2.2.3.1 */
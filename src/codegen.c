@@ -47,8 +47,16 @@ typedef struct scope {
   int sp;
   int pc;
   int lastlabel;
+  int tail_label;               /* label the jumps in tail_jmp lead to */
+  int tail_njmp;
+  int tail_jmp[16];             /* OP_JMPs right after an OP_SEND */
   int ainfo:15;
   mrb_bool mscope:1;
+  mrb_bool blkarg_escape:1;
+  mrb_bool blkref:1;
+  mrb_bool has_block:1;         /* a block or lambda literal is nested in it */
+  mrb_sym blkarg;
+  node *kwargs;                 /* (keywords . kwrest) of a method */
 
   struct loopinfo *loop;
   int ensure_level;
@@ -74,6 +82,16 @@ typedef struct scope {
 } codegen_scope;
 
 static codegen_scope* scope_new(mrb_state *mrb, codegen_scope *prev, node *lv);
+
+/* mark the scopes up to the enclosing method as holding a block */
+static void
+scope_has_block(codegen_scope *s)
+{
+  for (; s; s = s->prev) {
+    s->has_block = TRUE;
+    if (s->mscope) break;
+  }
+}
 static void scope_finish(codegen_scope *s);
 static struct loopinfo *loop_push(codegen_scope *s, enum looptype t);
 static void loop_break(codegen_scope *s, node *tree);
@@ -159,9 +177,61 @@ genop(codegen_scope *s, mrb_code i)
 #define NOVAL  0
 #define VAL    1
 
+/* a method call can replace the current frame only when no rescue
+   handler or ensure clause needs to run in it afterwards, and no block
+   created in the method may still `return` to it */
+static mrb_bool
+tailcall_p(codegen_scope *s)
+{
+#ifdef DISABLE_TAILCALL
+  return FALSE;
+#else
+  struct loopinfo *lp;
+
+  if (!s->mscope || s->has_block || s->ensure_level > 0) return FALSE;
+  for (lp = s->loop; lp; lp = lp->prev) {
+    if (lp->type == LOOP_BEGIN || lp->type == LOOP_RESCUE) return FALSE;
+  }
+  return TRUE;
+#endif
+}
+
+/* an OP_RETURN at a label (at pos) also ends the branches that jump to
+   it (if/else, case/when); calls at the end of those become tail calls */
+static void
+tailcall_branches(codegen_scope *s, mrb_code ret, int pos)
+{
+  int a = GETARG_A(ret);
+  mrb_code c;
+  int n, pc;
+
+  if (GETARG_B(ret) != OP_R_NORMAL || !tailcall_p(s)) return;
+  if (s->tail_label == pos) {
+    for (n=0; n<s->tail_njmp; n++) {
+      pc = s->tail_jmp[n];
+      c = s->iseq[pc-1];
+      if (GET_OPCODE(c) == OP_SEND && GETARG_A(c) == a &&
+          GET_OPCODE(s->iseq[pc]) == OP_JMP) {
+        s->iseq[pc-1] = MKOP_ABC(OP_TAILCALL, a, GETARG_B(c), GETARG_C(c));
+        s->iseq[pc] = ret;
+      }
+    }
+  }
+  /* the branch that falls through to the label */
+  if (pos > 0) {
+    c = s->iseq[pos-1];
+    if (GET_OPCODE(c) == OP_SEND && GETARG_A(c) == a) {
+      s->iseq[pos-1] = MKOP_ABC(OP_TAILCALL, a, GETARG_B(c), GETARG_C(c));
+    }
+  }
+}
+
 static void
 genop_peep(codegen_scope *s, mrb_code i, int val)
 {
+  if (GET_OPCODE(i) == OP_RETURN && s->lastlabel == s->pc) {
+    tailcall_branches(s, i, s->pc);
+  }
   /* peephole optimization */
   if (s->lastlabel != s->pc && s->pc > 0) {
     mrb_code i0 = s->iseq[s->pc-1];
@@ -193,6 +263,7 @@ genop_peep(codegen_scope *s, mrb_code i, int val)
         }
         break;
       case OP_ARRAY:
+      case OP_STRCATN:
       case OP_HASH:
       case OP_RANGE:
       case OP_AREF:
@@ -275,6 +346,9 @@ genop_peep(codegen_scope *s, mrb_code i, int val)
         return;
       case OP_MOVE:
         s->iseq[s->pc-1] = MKOP_AB(OP_RETURN, GETARG_B(i0), OP_R_NORMAL);
+        if (s->lastlabel == s->pc-1) {
+          tailcall_branches(s, s->iseq[s->pc-1], s->pc-1);
+        }
         return;
       case OP_SETIV:
       case OP_SETCV:
@@ -287,14 +361,14 @@ genop_peep(codegen_scope *s, mrb_code i, int val)
         i0 = s->iseq[s->pc-1];
         genop(s, MKOP_AB(OP_RETURN, GETARG_A(i0), OP_R_NORMAL));
         return;
-#if 0
       case OP_SEND:
-        if (GETARG_B(i) == OP_R_NORMAL && GETARG_A(i) == GETARG_A(i0)) {
+        if (GETARG_B(i) == OP_R_NORMAL && GETARG_A(i) == GETARG_A(i0) && tailcall_p(s)) {
           s->iseq[s->pc-1] = MKOP_ABC(OP_TAILCALL, GETARG_A(i0), GETARG_B(i0), GETARG_C(i0));
+          /* keep OP_RETURN; C functions are called normally by OP_TAILCALL */
+          genop(s, i);
           return;
         }
         break;
-#endif
       default:
         break;
       }
@@ -344,6 +418,15 @@ dispatch(codegen_scope *s, int pc)
   int c = GET_OPCODE(i);
 
   s->lastlabel = s->pc;
+  if (c == OP_JMP && pc > 0 && GET_OPCODE(s->iseq[pc-1]) == OP_SEND) {
+    if (s->tail_label != s->pc) {
+      s->tail_label = s->pc;
+      s->tail_njmp = 0;
+    }
+    if (s->tail_njmp < (int)(sizeof(s->tail_jmp)/sizeof(s->tail_jmp[0]))) {
+      s->tail_jmp[s->tail_njmp++] = pc;
+    }
+  }
   switch (c) {
   case OP_JMP:
   case OP_JMPIF:
@@ -407,6 +490,7 @@ new_lit(codegen_scope *s, mrb_value val)
 
       if (mrb_type(*pv) != MRB_TT_STRING) continue;
       if ((len = RSTRING_LEN(*pv)) != RSTRING_LEN(val)) continue;
+      if (MRB_FROZEN_P(mrb_str_ptr(*pv)) != MRB_FROZEN_P(mrb_str_ptr(val))) continue;
       if (memcmp(RSTRING_PTR(*pv), RSTRING_PTR(val), len) == 0)
         return i;
     }
@@ -538,6 +622,7 @@ for_body(codegen_scope *s, node *tree)
   // generate receiver
   codegen(s, tree->cdr->car, VAL);
   // generate loop-block
+  scope_has_block(s);
   s = scope_new(s->mrb, s, tree->car);
 
   lp = loop_push(s, LOOP_FOR);
@@ -573,7 +658,10 @@ static int
 lambda_body(codegen_scope *s, node *tree, int blk)
 {
   mrb_code c;
+  int enter = -1;
   codegen_scope *parent = s;
+
+  if (blk) scope_has_block(s);
   s = scope_new(s->mrb, s, tree->car);
   s->mscope = !blk;
 
@@ -586,7 +674,7 @@ lambda_body(codegen_scope *s, node *tree, int blk)
     mrb_aspec a;
     int ma, oa, ra, pa, ka, kd, ba;
     int pos, i;
-    node *n, *opt;
+    node *n, *opt, *tail, *kw;
 
     ma = node_len(tree->car->car);
     n = tree->car->car;
@@ -596,8 +684,18 @@ lambda_body(codegen_scope *s, node *tree, int blk)
     oa = node_len(tree->car->cdr->car);
     ra = tree->car->cdr->cdr->car ? 1 : 0;
     pa = node_len(tree->car->cdr->cdr->cdr->car);
-    ka = kd = 0;
-    ba = tree->car->cdr->cdr->cdr->cdr ? 1 : 0;
+    tail = tree->car->cdr->cdr->cdr->cdr;
+    kw = tail->car;
+    ka = kw ? node_len(kw->car) : 0;
+    kd = (kw && kw->cdr) ? 1 : 0;
+    ba = tail->cdr ? 1 : 0;
+    s->kwargs = kw;
+    /* OP_ENTER looks the keyword names up in the first mSyms */
+    for (n = kw ? kw->car : 0, i = 0; n; n = n->cdr, i++) {
+      if (new_sym(s, sym(n->car->car)) != i) {
+        codegen_error(s, "duplicated keyword argument name");
+      }
+    }
 
     a = ((mrb_aspec)(ma & 0x1f) << 18)
       | ((mrb_aspec)(oa & 0x1f) << 13)
@@ -609,7 +707,11 @@ lambda_body(codegen_scope *s, node *tree, int blk)
     s->ainfo = (((ma+oa) & 0x3f) << 6) /* (12bits = 6:1:5) */
       | ((ra & 1) << 5)
       | (pa & 0x1f);
+    enter = s->pc;
     genop(s, MKOP_Ax(OP_ENTER, a));
+    if (!blk && ba) {
+      s->blkarg = sym(tail->cdr);
+    }
     pos = new_label(s);
     for (i=0; i<oa; i++) {
       new_label(s);
@@ -634,6 +736,23 @@ lambda_body(codegen_scope *s, node *tree, int blk)
     if (oa > 0) {
       dispatch(s, pos+i);
     }
+    for (n = kw ? kw->car : 0, i = 0; n; n = n->cdr, i++) {
+      int idx = lv_idx(s, sym(n->car->car));
+
+      if (n->car->cdr) {
+        /* OP_JMP skips the initializer when the keyword was passed */
+        genop(s, MKOP_ABC(OP_KARG, idx, i, 1));
+        pos = new_label(s);
+        genop(s, MKOP_sBx(OP_JMP, 0));
+        codegen(s, n->car->cdr, VAL);
+        pop();
+        genop_peep(s, MKOP_AB(OP_MOVE, idx, cursp()), NOVAL);
+        dispatch(s, pos);
+      }
+      else {
+        genop(s, MKOP_ABC(OP_KARG, idx, i, 0));
+      }
+    }
   }
   codegen(s, tree->cdr->car, VAL);
   pop();
@@ -652,6 +771,10 @@ lambda_body(codegen_scope *s, node *tree, int blk)
   if (blk) {
     loop_pop(s, NOVAL);
   }
+  if (s->blkarg && !s->blkarg_escape) {
+    /* let the VM keep blocks passed to this method off the heap */
+    s->iseq[enter] = MKOP_Ax(OP_ENTER, GETARG_Ax(s->iseq[enter]) | (1<<23));
+  }
   scope_finish(s);
   return parent->irep->rlen - 1;
 }
@@ -766,16 +889,125 @@ gen_values(codegen_scope *s, node *t, int val)
 
 #define CALL_MAXARGS 127
 
+/* `blk.call(...)` and `&blk` keep the block argument on the stack;
+   any other read of it may store or return the block */
+static void
+blkarg_ref(codegen_scope *s, mrb_sym name)
+{
+  if (s->blkref) {
+    s->blkref = FALSE;
+    return;
+  }
+  while (s) {
+    if (lv_idx(s, name) > 0) {
+      if (s->mscope && s->blkarg == name) {
+        s->blkarg_escape = TRUE;
+      }
+      return;
+    }
+    if (s->mscope) return;
+    s = s->prev;
+  }
+}
+
+/*
+ * keyword arguments OP_SENDK can pass in registers: the pairs of a
+ * trailing hash argument whose keys are distinct symbol literals
+ */
+static node*
+send_kwargs(codegen_scope *s, node *args, int *np, int *kp)
+{
+  node *t, *p, *q;
+  int n = 0, k = 0;
+
+  for (t = args; t->cdr; t = t->cdr) {
+    if ((intptr_t)t->car->car == NODE_SPLAT) return NULL;
+    n++;
+  }
+  if ((intptr_t)t->car->car != NODE_HASH) return NULL;
+  for (p = t->car->cdr; p; p = p->cdr) {
+    if ((intptr_t)p->car->car->car != NODE_SYM) return NULL;
+    for (q = t->car->cdr; q != p; q = q->cdr) {
+      if (sym(q->car->car->cdr) == sym(p->car->car->cdr)) return NULL;
+    }
+    k++;
+  }
+  if (k == 0 || k > SENDK_MAXKW || n > SENDK_MAXARGS) return NULL;
+  *np = n;
+  *kp = k;
+  return t->car->cdr;
+}
+
+/* mSym run of OP_SENDK: the method name followed by the keyword names */
+static int
+new_kwmsym(codegen_scope *s, mrb_sym sym, node *kw, int k)
+{
+  size_t i, len;
+  int j;
+  node *p;
+
+  len = s->irep->slen;
+  if (len > 256) len = 256;
+  for (i=0; i+k<len; i++) {
+    if (s->irep->syms[i] != sym) continue;
+    for (j=1, p=kw; p; j++, p=p->cdr) {
+      if (s->irep->syms[i+j] != sym(p->car->car->cdr)) break;
+    }
+    if (!p) return i;
+  }
+  /* stay below the point where new_sym() starts filling holes */
+  if (s->irep->slen + k + 1 > 125) return -1;
+  i = s->irep->slen;
+  s->irep->syms[i] = sym;
+  for (j=1, p=kw; p; j++, p=p->cdr) {
+    s->irep->syms[i+j] = sym(p->car->car->cdr);
+  }
+  s->irep->slen += k + 1;
+  return i;
+}
+
 static void
 gen_call(codegen_scope *s, node *tree, mrb_sym name, int sp, int val)
 {
   mrb_sym sym = name ? name : sym(tree->cdr->car);
   int idx;
   int n = 0, noop = 0, sendv = 0, blk = 0;
+  node *kw = NULL;
+  int nk = 0;
 
+  if (tree->car && (intptr_t)tree->car->car == NODE_LVAR && sym == mrb_intern_lit(s->mrb, "call")) {
+    s->blkref = TRUE;
+  }
   codegen(s, tree->car, VAL); /* receiver */
-  idx = new_msym(s, sym);
   tree = tree->cdr->cdr->car;
+  if (!sp && tree && tree->car) {
+    kw = send_kwargs(s, tree->car, &n, &nk);
+  }
+  if (kw && (idx = new_kwmsym(s, sym, kw, nk)) >= 0) {
+    node *t;
+
+    for (t = tree->car; t->cdr; t = t->cdr) {
+      codegen(s, t->car, VAL);
+    }
+    for (t = kw; t; t = t->cdr) {
+      codegen(s, t->car->cdr, VAL);
+    }
+    if (tree->cdr) {
+      codegen(s, tree->cdr, VAL);
+    }
+    else {
+      genop(s, MKOP_A(OP_LOADNIL, cursp()));
+      push();
+    }
+    pop_n(n+nk+2);
+    genop(s, MKOP_ABC(OP_SENDK, cursp(), idx, SENDK_C(n, nk)));
+    if (val) {
+      push();
+    }
+    return;
+  }
+  n = 0;
+  idx = new_msym(s, sym);
   if (tree) {
     n = gen_values(s, tree->car, VAL);
     if (n < 0) {
@@ -973,6 +1205,26 @@ gen_vmassignment(codegen_scope *s, node *tree, int rhs, int val)
   }
 }
 
+/* tree is (ptr . len); a frozen literal is not copied by OP_STRING,
+   so strings that get concatenated onto must not be frozen */
+static void
+gen_str_lit(codegen_scope *s, node *tree, mrb_bool frozen)
+{
+  char *p = (char*)tree->car;
+  size_t len = (intptr_t)tree->cdr;
+  int ai = mrb_gc_arena_save(s->mrb);
+  mrb_value str = mrb_str_new(s->mrb, p, len);
+  int off;
+
+  if (frozen) {
+    MRB_SET_FROZEN_FLAG(mrb_str_ptr(str));
+  }
+  off = new_lit(s, str);
+  mrb_gc_arena_restore(s->mrb, ai);
+  genop(s, MKOP_ABx(OP_STRING, cursp(), off));
+  push();
+}
+
 static void
 gen_send_intern(codegen_scope *s)
 {
@@ -991,7 +1243,13 @@ gen_literal_array(codegen_scope *s, node *tree, int sym, int val)
       case NODE_STR:
         if ((tree->cdr == NULL) && ((intptr_t)tree->car->cdr->cdr == 0))
           break;
-        /* fall through */
+        /* the first part of a word is concatenated onto */
+        gen_str_lit(s, tree->car->cdr,
+                    s->parser && s->parser->frozen_string_literal && (j > 0 || !tree->cdr ||
+                    (intptr_t)tree->cdr->car->car == NODE_LITERAL_DELIM));
+        ++j;
+        break;
+
       case NODE_BEGIN:
         codegen(s, tree->car, VAL);
         ++j;
@@ -1693,6 +1951,32 @@ codegen(codegen_scope *s, node *tree, int val)
       }
       if (s2) ainfo = s2->ainfo;
       genop(s, MKOP_ABx(OP_ARGARY, cursp(), (ainfo<<4)|(lv & 0xf)));
+      if (s2 && s2->kwargs) {
+        /* keyword arguments go on as a trailing hash */
+        node *kw = s2->kwargs, *n;
+        int r = ((ainfo>>6)&0x3f) + ((ainfo>>5)&0x1) + (ainfo&0x1f) + 2;
+        int nk = 0;
+
+        push(); push();
+        for (n = kw->car; n; n = n->cdr, r++, nk++) {
+          genop(s, MKOP_ABx(OP_LOADSYM, cursp(), new_sym(s, sym(n->car->car))));
+          push();
+          if (lv == 0) genop(s, MKOP_AB(OP_MOVE, cursp(), r));
+          else genop(s, MKOP_ABC(OP_GETUPVAR, cursp(), r, lv-1));
+          push();
+        }
+        pop_n(nk*2);
+        genop(s, MKOP_ABC(OP_HASH, cursp(), cursp(), nk));
+        if (kw->cdr) {
+          push();
+          if (lv == 0) genop(s, MKOP_AB(OP_MOVE, cursp(), r));
+          else genop(s, MKOP_ABC(OP_GETUPVAR, cursp(), r, lv-1));
+          pop();
+          genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "merge")), 1));
+        }
+        pop(); pop();
+        genop(s, MKOP_AB(OP_ARYPUSH, cursp(), cursp()+2));
+      }
       if (tree && tree->cdr) {
         push();
         codegen(s, tree->cdr, VAL);
@@ -1829,6 +2113,7 @@ codegen(codegen_scope *s, node *tree, int val)
     if (val) {
       int idx = lv_idx(s, sym(tree));
 
+      blkarg_ref(s, sym(tree));
       if (idx > 0) {
         genop(s, MKOP_AB(OP_MOVE, cursp(), idx));
       }
@@ -1924,6 +2209,9 @@ codegen(codegen_scope *s, node *tree, int val)
     break;
 
   case NODE_BLOCK_ARG:
+    if ((intptr_t)tree->car == NODE_LVAR) {
+      s->blkref = TRUE;
+    }
     codegen(s, tree, VAL);
     break;
 
@@ -2029,14 +2317,7 @@ codegen(codegen_scope *s, node *tree, int val)
 
   case NODE_STR:
     if (val) {
-      char *p = (char*)tree->car;
-      size_t len = (intptr_t)tree->cdr;
-      int ai = mrb_gc_arena_save(s->mrb);
-      int off = new_lit(s, mrb_str_new(s->mrb, p, len));
-
-      mrb_gc_arena_restore(s->mrb, ai);
-      genop(s, MKOP_ABx(OP_STRING, cursp(), off));
-      push();
+      gen_str_lit(s, tree, s->parser && s->parser->frozen_string_literal);
     }
     break;
 
@@ -2046,16 +2327,46 @@ codegen(codegen_scope *s, node *tree, int val)
   case NODE_DSTR:
     if (val) {
       node *n = tree;
+      int len = 0;
 
-      codegen(s, n->car, VAL);
-      n = n->cdr;
+      /* parts go to consecutive registers and are joined by one
+         OP_STRCATN; literal parts are read from the pool in place */
       while (n) {
-        codegen(s, n->car, VAL);
-        pop(); pop();
-        genop_peep(s, MKOP_AB(OP_STRCAT, cursp(), cursp()+1), VAL);
-        push();
+        node *part = n->car;
+
+        if ((intptr_t)part->car == NODE_STR) {
+          size_t slen = (intptr_t)part->cdr->cdr;
+
+          if (slen > 0) {
+            int ai = mrb_gc_arena_save(s->mrb);
+            int off = new_lit(s, mrb_str_new(s->mrb, (char*)part->cdr->car, slen));
+
+            mrb_gc_arena_restore(s->mrb, ai);
+            genop(s, MKOP_ABx(OP_LOADL, cursp(), off));
+            push();
+            len++;
+          }
+        }
+        else {
+          codegen(s, part, VAL);
+          len++;
+        }
+        if (len == MAXARG_C) {
+          pop_n(len);
+          genop(s, MKOP_ABC(OP_STRCATN, cursp(), cursp(), len));
+          push();
+          len = 1;
+        }
         n = n->cdr;
       }
+      if (len == 0) {
+        genop(s, MKOP_A(OP_LOADNIL, cursp()));
+        push();
+        len = 1;
+      }
+      pop_n(len);
+      genop(s, MKOP_ABC(OP_STRCATN, cursp(), cursp(), len));
+      push();
     }
     else {
       node *n = tree;
@@ -2137,7 +2448,12 @@ codegen(codegen_scope *s, node *tree, int val)
       genop(s, MKOP_A(OP_OCLASS, cursp()));
       genop(s, MKOP_ABx(OP_GETMCNST, cursp(), sym));
       push();
-      codegen(s, n->car, VAL);
+      if ((intptr_t)n->car->car == NODE_STR) {
+        gen_str_lit(s, n->car->cdr, FALSE);
+      }
+      else {
+        codegen(s, n->car, VAL);
+      }
       n = n->cdr;
       while (n) {
         codegen(s, n->car, VAL);
@@ -2467,6 +2783,614 @@ scope_new(mrb_state *mrb, codegen_scope *prev, node *lv)
   return p;
 }
 
+/*
+ * Post-codegen optimization (enabled by mrbc -O)
+ *
+ * genop_peep() only sees the previous instruction while code is being
+ * emitted.  Once a scope is complete, optimize_iseq() runs a few passes
+ * over the whole instruction sequence: jump threading, constant folding,
+ * OP_LOADI+OP_ADD/OP_SUB to OP_ADDI/OP_SUBI, unreachable code removal
+ * and dead store elimination of temporary registers.  Removed
+ * instructions are first replaced by OP_NOP, then squeezed out by
+ * opt_compact() which relocates jump offsets and line numbers.
+ */
+
+#define OPT_MAX_ITER 4
+#define OPT_SBX_MIN  (-MAXARG_sBx)
+#define OPT_SBX_MAX  (MAXARG_sBx)
+
+typedef struct opt_state {
+  codegen_scope *s;
+  mrb_code *iseq;
+  int ilen;
+  uint8_t *label;               /* instruction is a jump target */
+  uint8_t *pinned;              /* OP_ENTER jump table; never touched */
+  int nbits;                    /* registers tracked by liveness */
+  int nwords;
+  uint32_t *live;               /* live-in bitset per instruction */
+} opt_state;
+
+static mrb_bool
+opt_jump_p(mrb_code i)
+{
+  switch (GET_OPCODE(i)) {
+  case OP_JMP:
+  case OP_JMPIF:
+  case OP_JMPNOT:
+  case OP_ONERR:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+/* instructions that never fall through to the next one */
+static mrb_bool
+opt_terminal_p(mrb_code i)
+{
+  switch (GET_OPCODE(i)) {
+  case OP_JMP:
+  case OP_RETURN:
+  case OP_RAISE:
+  case OP_STOP:
+  case OP_ERR:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+static mrb_bool
+opt_set_jump(opt_state *o, int pc, int target)
+{
+  mrb_code i = o->iseq[pc];
+  int diff = target - pc;
+
+  if (diff < OPT_SBX_MIN || diff > OPT_SBX_MAX) return FALSE;
+  if (GET_OPCODE(i) == OP_JMP || GET_OPCODE(i) == OP_ONERR)
+    o->iseq[pc] = MKOP_sBx(GET_OPCODE(i), diff);
+  else
+    o->iseq[pc] = MKOP_AsBx(GET_OPCODE(i), GETARG_A(i), diff);
+  return TRUE;
+}
+
+static void
+opt_scan_labels(opt_state *o)
+{
+  int pc, n;
+
+  memset(o->label, 0, o->ilen);
+  memset(o->pinned, 0, o->ilen);
+  for (pc=0; pc<o->ilen; pc++) {
+    mrb_code i = o->iseq[pc];
+
+    if (opt_jump_p(i)) {
+      int t = pc + GETARG_sBx(i);
+      if (t >= 0 && t < o->ilen) o->label[t] = 1;
+    }
+    else if (GET_OPCODE(i) == OP_ENTER) {
+      int oa = (GETARG_Ax(i)>>13)&0x1f;
+
+      if (oa > 0) {
+        for (n=1; n<=oa+1 && pc+n<o->ilen; n++) {
+          o->label[pc+n] = 1;
+          o->pinned[pc+n] = 1;
+        }
+      }
+    }
+    else if (GET_OPCODE(i) == OP_KARG && GETARG_C(i) && pc+2 < o->ilen) {
+      /* OP_KARG either runs or skips the OP_JMP after it */
+      o->label[pc+1] = 1;
+      o->pinned[pc+1] = 1;
+      o->label[pc+2] = 1;
+    }
+  }
+}
+
+/* pass 1: jump threading */
+static mrb_bool
+opt_thread_jumps(opt_state *o)
+{
+  mrb_bool changed = FALSE;
+  int pc, hops;
+
+  for (pc=0; pc<o->ilen; pc++) {
+    mrb_code i = o->iseq[pc];
+    int c = GET_OPCODE(i);
+    int t, t0;
+
+    if (o->pinned[pc]) continue;
+    if (c != OP_JMP && c != OP_JMPIF && c != OP_JMPNOT) continue;
+    t0 = t = pc + GETARG_sBx(i);
+    for (hops=0; hops<16 && t>=0 && t<o->ilen && t!=pc; hops++) {
+      mrb_code i2 = o->iseq[t];
+      int c2 = GET_OPCODE(i2);
+
+      if (c2 == OP_JMP) {
+        t += GETARG_sBx(i2);
+      }
+      else if (c != OP_JMP && (c2 == OP_JMPIF || c2 == OP_JMPNOT) &&
+               GETARG_A(i2) == GETARG_A(i)) {
+        /* the condition register is unchanged on the way */
+        if (c2 == c) t += GETARG_sBx(i2);
+        else t++;
+      }
+      else {
+        break;
+      }
+    }
+    if (t < 0 || t >= o->ilen) continue;
+    if (c == OP_JMP && GET_OPCODE(o->iseq[t]) == OP_RETURN &&
+        GETARG_B(o->iseq[t]) == OP_R_NORMAL) {
+      /* jump to return is a return */
+      o->iseq[pc] = o->iseq[t];
+      changed = TRUE;
+      continue;
+    }
+    if (t == pc + 1) {
+      /* jump to the next instruction */
+      o->iseq[pc] = MKOP_A(OP_NOP, 0);
+      changed = TRUE;
+      continue;
+    }
+    if (t != t0 && opt_set_jump(o, pc, t)) {
+      changed = TRUE;
+      continue;
+    }
+    /* JMPIF R(A) L1; JMP L2; L1: => JMPNOT R(A) L2 */
+    if (c != OP_JMP && t == pc + 2 && pc + 1 < o->ilen && !o->label[pc+1] &&
+        GET_OPCODE(o->iseq[pc+1]) == OP_JMP) {
+      int t2 = pc + 1 + GETARG_sBx(o->iseq[pc+1]);
+      int diff = t2 - pc;
+
+      if (diff >= OPT_SBX_MIN && diff <= OPT_SBX_MAX) {
+        o->iseq[pc] = MKOP_AsBx(c == OP_JMPIF ? OP_JMPNOT : OP_JMPIF, GETARG_A(i), diff);
+        o->iseq[pc+1] = MKOP_A(OP_NOP, 0);
+        changed = TRUE;
+      }
+    }
+  }
+  return changed;
+}
+
+static mrb_bool
+opt_fold_int(int op, long x, long y, mrb_code *result, int a)
+{
+  long z;
+
+  switch (op) {
+  case OP_ADD: z = x + y; break;
+  case OP_SUB: z = x - y; break;
+  case OP_MUL: z = x * y; break;
+  case OP_EQ:  *result = MKOP_A((x == y) ? OP_LOADT : OP_LOADF, a); return TRUE;
+  case OP_LT:  *result = MKOP_A((x <  y) ? OP_LOADT : OP_LOADF, a); return TRUE;
+  case OP_LE:  *result = MKOP_A((x <= y) ? OP_LOADT : OP_LOADF, a); return TRUE;
+  case OP_GT:  *result = MKOP_A((x >  y) ? OP_LOADT : OP_LOADF, a); return TRUE;
+  case OP_GE:  *result = MKOP_A((x >= y) ? OP_LOADT : OP_LOADF, a); return TRUE;
+  default:
+    return FALSE;
+  }
+  /* operands are sBx literals, so the result fits in a long */
+  if (z < OPT_SBX_MIN || z > OPT_SBX_MAX) return FALSE;
+  *result = MKOP_AsBx(OP_LOADI, a, z);
+  return TRUE;
+}
+
+/* pass 2: constant folding and OP_LOADI+OP_ADD/OP_SUB rewriting */
+static mrb_bool
+opt_fold(opt_state *o)
+{
+  mrb_bool changed = FALSE;
+  int pc;
+
+  for (pc=0; pc+1<o->ilen; pc++) {
+    mrb_code i0 = o->iseq[pc];
+    mrb_code i1 = o->iseq[pc+1];
+    int c0 = GET_OPCODE(i0);
+    int c1 = GET_OPCODE(i1);
+    int a;
+
+    if (o->pinned[pc] || o->label[pc+1]) continue;
+    if (c0 == OP_LOADI) {
+      a = GETARG_A(i0);
+      /* LOADI R(A) x; ADDI/SUBI R(A) y => LOADI R(A) x+y */
+      if ((c1 == OP_ADDI || c1 == OP_SUBI) && GETARG_A(i1) == a) {
+        mrb_code r;
+
+        if (opt_fold_int(c1 == OP_ADDI ? OP_ADD : OP_SUB,
+                         GETARG_sBx(i0), GETARG_C(i1), &r, a)) {
+          o->iseq[pc] = r;
+          o->iseq[pc+1] = MKOP_A(OP_NOP, 0);
+          changed = TRUE;
+        }
+        continue;
+      }
+      /* LOADI R(A) x; LOADI R(A+1) y; OP R(A) => LOADI/LOADT/LOADF R(A) */
+      if (c1 == OP_LOADI && GETARG_A(i1) == a+1 && pc+2 < o->ilen && !o->label[pc+2]) {
+        mrb_code i2 = o->iseq[pc+2];
+        mrb_code r;
+
+        if (GETARG_A(i2) == a && GETARG_C(i2) == 1 &&
+            opt_fold_int(GET_OPCODE(i2), GETARG_sBx(i0), GETARG_sBx(i1), &r, a)) {
+          o->iseq[pc] = r;
+          o->iseq[pc+1] = MKOP_A(OP_NOP, 0);
+          o->iseq[pc+2] = MKOP_A(OP_NOP, 0);
+          changed = TRUE;
+          continue;
+        }
+      }
+    }
+    /* MOVE R(A) R(B); MOVE R(B) R(A) => MOVE R(A) R(B) */
+    if (c0 == OP_MOVE && c1 == OP_MOVE &&
+        GETARG_A(i0) == GETARG_B(i1) && GETARG_B(i0) == GETARG_A(i1)) {
+      o->iseq[pc+1] = MKOP_A(OP_NOP, 0);
+      changed = TRUE;
+      continue;
+    }
+    /* LOADI R(A+1) c; ADD/SUB R(A) => ADDI/SUBI R(A) c */
+    if (c0 == OP_LOADI && (c1 == OP_ADD || c1 == OP_SUB) &&
+        GETARG_C(i1) == 1 && GETARG_A(i0) == GETARG_A(i1)+1) {
+      int c = GETARG_sBx(i0);
+
+      if (c1 == OP_SUB) c = -c;
+      if (c > 127 || c < -127) continue;
+      if (0 <= c)
+        o->iseq[pc] = MKOP_ABC(OP_ADDI, GETARG_A(i1), GETARG_B(i1), c);
+      else
+        o->iseq[pc] = MKOP_ABC(OP_SUBI, GETARG_A(i1), GETARG_B(i1), -c);
+      o->iseq[pc+1] = MKOP_A(OP_NOP, 0);
+      changed = TRUE;
+      continue;
+    }
+    /* constant conditions */
+    if ((c1 == OP_JMPIF || c1 == OP_JMPNOT) && GETARG_A(i0) == GETARG_A(i1)) {
+      int truth;
+
+      switch (c0) {
+      case OP_LOADI: case OP_LOADSYM: case OP_LOADT:
+        truth = 1; break;
+      case OP_LOADNIL: case OP_LOADF:
+        truth = 0; break;
+      default:
+        continue;
+      }
+      if ((c1 == OP_JMPIF) == truth)
+        o->iseq[pc+1] = MKOP_sBx(OP_JMP, GETARG_sBx(i1));
+      else
+        o->iseq[pc+1] = MKOP_A(OP_NOP, 0);
+      changed = TRUE;
+    }
+  }
+  return changed;
+}
+
+/* pass 3: remove unreachable instructions */
+static mrb_bool
+opt_remove_unreachable(opt_state *o)
+{
+  mrb_bool changed = FALSE;
+  uint8_t *reach = o->label;    /* reuse; labels are rescanned afterwards */
+  int *work;
+  int sp = 0, pc, n;
+
+  work = (int *)codegen_malloc(o->s, sizeof(int)*(o->ilen+1));
+  memset(reach, 0, o->ilen);
+  reach[0] = 1;
+  work[sp++] = 0;
+  while (sp > 0) {
+    mrb_code i;
+    int succ[2], ns = 0;
+
+    pc = work[--sp];
+    i = o->iseq[pc];
+    if (!opt_terminal_p(i) && pc+1 < o->ilen) succ[ns++] = pc+1;
+    if (opt_jump_p(i)) succ[ns++] = pc + GETARG_sBx(i);
+    if (GET_OPCODE(i) == OP_ENTER) {
+      int oa = (GETARG_Ax(i)>>13)&0x1f;
+
+      for (n=2; n<=oa+1 && pc+n<o->ilen; n++) {
+        if (!reach[pc+n]) {
+          reach[pc+n] = 1;
+          work[sp++] = pc+n;
+        }
+      }
+    }
+    if (GET_OPCODE(i) == OP_KARG && GETARG_C(i) && pc+2 < o->ilen) {
+      succ[ns++] = pc+2;
+    }
+    for (n=0; n<ns; n++) {
+      int t = succ[n];
+
+      if (t >= 0 && t < o->ilen && !reach[t]) {
+        reach[t] = 1;
+        work[sp++] = t;
+      }
+    }
+  }
+  for (pc=0; pc<o->ilen; pc++) {
+    if (!reach[pc] && !o->pinned[pc] && GET_OPCODE(o->iseq[pc]) != OP_NOP) {
+      o->iseq[pc] = MKOP_A(OP_NOP, 0);
+      changed = TRUE;
+    }
+  }
+  mrb_free(o->s->mrb, work);
+  opt_scan_labels(o);
+  return changed;
+}
+
+#define OPT_BIT(set,r) ((set)[(r)>>5] & (1U<<((r)&31)))
+
+static void
+opt_use(opt_state *o, uint32_t *set, int r, int n)
+{
+  while (n-- > 0) {
+    if (r >= 0 && r < o->nbits) set[r>>5] |= 1U<<(r&31);
+    r++;
+  }
+}
+
+static void
+opt_def(opt_state *o, uint32_t *set, int r)
+{
+  if (r >= 0 && r < o->nbits) set[r>>5] &= ~(1U<<(r&31));
+}
+
+/*
+ * transfer function: turns live-out into live-in for instruction i.
+ * Writes are only killed when they are certain; anything not known
+ * to be harmless makes every register live.
+ */
+static void
+opt_transfer(opt_state *o, mrb_code i, uint32_t *set)
+{
+  int a = GETARG_A(i);
+  int n;
+
+  switch (GET_OPCODE(i)) {
+  case OP_NOP: case OP_JMP: case OP_ONERR: case OP_POPERR:
+  case OP_EPUSH: case OP_EPOP: case OP_ERR: case OP_DEBUG:
+    break;
+  case OP_MOVE:
+    opt_def(o, set, a);
+    opt_use(o, set, GETARG_B(i), 1);
+    break;
+  case OP_LOADL: case OP_LOADI: case OP_LOADSYM: case OP_LOADNIL:
+  case OP_LOADSELF: case OP_LOADT: case OP_LOADF:
+  case OP_GETGLOBAL: case OP_GETSPECIAL: case OP_GETIV: case OP_GETCV:
+  case OP_GETCONST: case OP_GETUPVAR: case OP_RESCUE: case OP_STRING:
+  case OP_LAMBDA: case OP_OCLASS: case OP_TCLASS:
+    opt_def(o, set, a);
+    break;
+  case OP_SETGLOBAL: case OP_SETSPECIAL: case OP_SETIV: case OP_SETCV:
+  case OP_SETCONST: case OP_SETUPVAR: case OP_JMPIF: case OP_JMPNOT:
+  case OP_RAISE: case OP_RETURN: case OP_GETMCNST: case OP_MODULE:
+  case OP_EXEC: case OP_ADDI: case OP_SUBI: case OP_APOST:
+    opt_use(o, set, a, 1);
+    break;
+  case OP_SETMCNST: case OP_CLASS: case OP_METHOD:
+  case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+  case OP_EQ: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+    opt_use(o, set, a, 2);
+    break;
+  case OP_SEND: case OP_SENDB: case OP_TAILCALL: case OP_SUPER:
+    n = GETARG_C(i);
+    if (n == CALL_MAXARGS) n = 1;
+    opt_use(o, set, a, n+2);
+    break;
+  case OP_SENDK:
+    n = SENDK_ARGC(GETARG_C(i)) + SENDK_KWC(GETARG_C(i));
+    opt_use(o, set, a, n+2);
+    break;
+  case OP_ARYCAT: case OP_ARYPUSH: case OP_ASET: case OP_STRCAT:
+    opt_use(o, set, a, 1);
+    opt_use(o, set, GETARG_B(i), 1);
+    break;
+  case OP_AREF: case OP_SCLASS:
+    opt_def(o, set, a);
+    opt_use(o, set, GETARG_B(i), 1);
+    break;
+  case OP_ARRAY: case OP_STRCATN:
+    opt_def(o, set, a);
+    opt_use(o, set, GETARG_B(i), GETARG_C(i));
+    break;
+  case OP_HASH:
+    opt_def(o, set, a);
+    opt_use(o, set, GETARG_B(i), GETARG_C(i)*2);
+    break;
+  case OP_RANGE:
+    opt_def(o, set, a);
+    opt_use(o, set, GETARG_B(i), 2);
+    break;
+  case OP_STOP:
+    opt_use(o, set, o->s->nlocals, 1);
+    break;
+  default:
+    /* OP_ENTER, OP_CALL, OP_ARGARY, OP_BLKPUSH, ... */
+    opt_use(o, set, 0, o->nbits);
+    break;
+  }
+}
+
+static void
+opt_liveness(opt_state *o)
+{
+  uint32_t *out = (uint32_t *)codegen_malloc(o->s, sizeof(uint32_t)*o->nwords);
+  uint32_t *handler = (uint32_t *)codegen_malloc(o->s, sizeof(uint32_t)*o->nwords);
+  mrb_bool changed = TRUE;
+  int pc, w;
+
+  memset(o->live, 0, sizeof(uint32_t)*o->nwords*o->ilen);
+  memset(handler, 0, sizeof(uint32_t)*o->nwords);
+  while (changed) {
+    changed = FALSE;
+    for (pc=o->ilen-1; pc>=0; pc--) {
+      mrb_code i = o->iseq[pc];
+      uint32_t *in = o->live + pc*o->nwords;
+
+      /* any instruction may raise into a rescue clause */
+      memcpy(out, handler, sizeof(uint32_t)*o->nwords);
+      if (!opt_terminal_p(i) && pc+1 < o->ilen) {
+        uint32_t *next = o->live + (pc+1)*o->nwords;
+        for (w=0; w<o->nwords; w++) out[w] |= next[w];
+      }
+      if (opt_jump_p(i)) {
+        int t = pc + GETARG_sBx(i);
+
+        if (t >= 0 && t < o->ilen) {
+          uint32_t *tgt = o->live + t*o->nwords;
+          for (w=0; w<o->nwords; w++) out[w] |= tgt[w];
+          if (GET_OPCODE(i) == OP_ONERR) {
+            for (w=0; w<o->nwords; w++) {
+              if ((handler[w] | tgt[w]) != handler[w]) {
+                handler[w] |= tgt[w];
+                changed = TRUE;
+              }
+            }
+          }
+        }
+      }
+      opt_transfer(o, i, out);
+      for (w=0; w<o->nwords; w++) {
+        if (in[w] != out[w]) {
+          in[w] = out[w];
+          changed = TRUE;
+        }
+      }
+    }
+  }
+  mrb_free(o->s->mrb, out);
+  mrb_free(o->s->mrb, handler);
+}
+
+/* pass 4: dead stores to temporary registers (redundant OP_MOVEs etc.) */
+static mrb_bool
+opt_remove_dead_stores(opt_state *o)
+{
+  mrb_bool changed = FALSE;
+  int pc;
+
+  opt_liveness(o);
+  for (pc=0; pc<o->ilen; pc++) {
+    mrb_code i = o->iseq[pc];
+    int a = GETARG_A(i);
+    mrb_bool dead;
+
+    if (o->pinned[pc]) continue;
+    switch (GET_OPCODE(i)) {
+    case OP_MOVE:
+      if (a == GETARG_B(i)) {
+        dead = TRUE;
+        break;
+      }
+      /* fall through */
+    case OP_LOADL: case OP_LOADI: case OP_LOADSYM: case OP_LOADNIL:
+    case OP_LOADSELF: case OP_LOADT: case OP_LOADF:
+      if (a < o->s->nlocals || a >= o->nbits) continue;
+      if (pc+1 >= o->ilen) {
+        dead = TRUE;
+      }
+      else {
+        uint32_t *next = o->live + (pc+1)*o->nwords;
+        dead = !OPT_BIT(next, a);
+      }
+      break;
+    default:
+      continue;
+    }
+    if (dead) {
+      o->iseq[pc] = MKOP_A(OP_NOP, 0);
+      changed = TRUE;
+    }
+  }
+  return changed;
+}
+
+/* squeeze out OP_NOPs, relocating jumps and line numbers */
+static void
+opt_compact(opt_state *o)
+{
+  int *map;
+  int pc, n = 0;
+
+  for (pc=0; pc<o->ilen; pc++) {
+    if (GET_OPCODE(o->iseq[pc]) == OP_NOP && !o->pinned[pc]) n++;
+  }
+  /* keep at least one instruction */
+  if (n == 0 || n == o->ilen) return;
+
+  map = (int *)codegen_malloc(o->s, sizeof(int)*(o->ilen+1));
+  n = 0;
+  for (pc=0; pc<o->ilen; pc++) {
+    map[pc] = n;
+    if (GET_OPCODE(o->iseq[pc]) != OP_NOP || o->pinned[pc]) n++;
+  }
+  map[o->ilen] = n;
+  for (pc=0; pc<o->ilen; pc++) {
+    mrb_code i = o->iseq[pc];
+
+    if (opt_jump_p(i)) {
+      int t = pc + GETARG_sBx(i);
+      int diff;
+
+      if (t < 0) t = 0;
+      if (t > o->ilen) t = o->ilen;
+      diff = map[t] - map[pc];
+      if (GET_OPCODE(i) == OP_JMP || GET_OPCODE(i) == OP_ONERR)
+        o->iseq[pc] = MKOP_sBx(GET_OPCODE(i), diff);
+      else
+        o->iseq[pc] = MKOP_AsBx(GET_OPCODE(i), GETARG_A(i), diff);
+    }
+  }
+  for (pc=0; pc<o->ilen; pc++) {
+    if (GET_OPCODE(o->iseq[pc]) == OP_NOP && !o->pinned[pc]) continue;
+    o->iseq[map[pc]] = o->iseq[pc];
+    if (o->s->lines) {
+      o->s->lines[map[pc]] = o->s->lines[pc];
+    }
+  }
+  o->ilen = n;
+  mrb_free(o->s->mrb, map);
+  opt_scan_labels(o);
+}
+
+static void
+optimize_iseq(codegen_scope *s)
+{
+  opt_state o;
+  int iter;
+
+  if (s->pc < 2) return;
+  /* debug info for multi-file scopes refers to positions already */
+  if (s->debug_start_pos != 0) return;
+
+  o.s = s;
+  o.iseq = s->iseq;
+  o.ilen = s->pc;
+  o.nbits = s->nregs + CALL_MAXARGS + 3;
+  o.nwords = (o.nbits + 31) / 32;
+  o.label = (uint8_t *)codegen_malloc(s, o.ilen);
+  o.pinned = (uint8_t *)codegen_malloc(s, o.ilen);
+  o.live = (uint32_t *)codegen_malloc(s, sizeof(uint32_t)*o.nwords*o.ilen);
+  opt_scan_labels(&o);
+
+  for (iter=0; iter<OPT_MAX_ITER; iter++) {
+    mrb_bool changed = FALSE;
+
+    if (opt_thread_jumps(&o)) changed = TRUE;
+    if (opt_fold(&o)) changed = TRUE;
+    if (opt_remove_unreachable(&o)) changed = TRUE;
+    if (opt_remove_dead_stores(&o)) changed = TRUE;
+    if (!changed) break;
+    opt_compact(&o);
+  }
+  s->pc = o.ilen;
+  s->lastlabel = s->pc;
+
+  mrb_free(s->mrb, o.label);
+  mrb_free(s->mrb, o.pinned);
+  mrb_free(s->mrb, o.live);
+}
+
 static void
 scope_finish(codegen_scope *s)
 {
@@ -2477,6 +3401,22 @@ scope_finish(codegen_scope *s)
 
   irep->flags = 0;
   if (s->iseq) {
+    if (s->has_block) {
+      /* a block can come after a tail call in the source
+         (e.g. `return f(pr)` in a loop); undo those calls */
+      int pc;
+
+      for (pc=0; pc<s->pc; pc++) {
+        mrb_code c = s->iseq[pc];
+
+        if (GET_OPCODE(c) == OP_TAILCALL) {
+          s->iseq[pc] = MKOP_ABC(OP_SEND, GETARG_A(c), GETARG_B(c), GETARG_C(c));
+        }
+      }
+    }
+    if (s->parser && s->parser->optimize) {
+      optimize_iseq(s);
+    }
     irep->iseq = (mrb_code *)codegen_realloc(s, s->iseq, sizeof(mrb_code)*s->pc);
     irep->ilen = s->pc;
     if (s->lines) {
@@ -2691,6 +3631,19 @@ codedump(mrb_state *mrb, mrb_irep *irep)
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
              GETARG_C(c));
       break;
+    case OP_SENDK:
+      printf("OP_SENDK\tR%d\t:%s\t%d\t", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             SENDK_ARGC(GETARG_C(c)));
+      {
+        int j;
+
+        for (j=1; j<=SENDK_KWC(GETARG_C(c)); j++) {
+          printf("%s:", mrb_sym2name(mrb, irep->syms[GETARG_B(c)+j]));
+        }
+      }
+      printf("\n");
+      break;
     case OP_TAILCALL:
       printf("OP_TAILCALL\tR%d\t:%s\t%d\n", GETARG_A(c),
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
@@ -2718,6 +3671,11 @@ codedump(mrb_state *mrb, mrb_irep *irep)
              (GETARG_Ax(c)>>1)&0x1,
              GETARG_Ax(c) & 0x1);
       break;
+    case OP_KARG:
+      printf("OP_KARG\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
     case OP_RETURN:
       printf("OP_RETURN\tR%d", GETARG_A(c));
       switch (GETARG_B(c)) {
@@ -2836,6 +3794,9 @@ codedump(mrb_state *mrb, mrb_irep *irep)
     case OP_STRCAT:
       printf("OP_STRCAT\tR%d\tR%d\n", GETARG_A(c), GETARG_B(c));
       break;
+    case OP_STRCATN:
+      printf("OP_STRCATN\tR%d\tR%d\t%d\n", GETARG_A(c), GETARG_B(c), GETARG_C(c));
+      break;
     case OP_HASH:
       printf("OP_HASH\tR%d\tR%d\t%d\n", GETARG_A(c), GETARG_B(c), GETARG_C(c));
       break;
@@ -133,7 +133,12 @@ write_pool_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
       break;
 
     case MRB_TT_STRING:
-      cur += uint8_to_bin(IREP_TT_STRING, cur); /* data type */
+      if (MRB_FROZEN_P(mrb_str_ptr(irep->pool[pool_no]))) {
+        cur += uint8_to_bin(IREP_TT_FSTRING, cur); /* data type */
+      }
+      else {
+        cur += uint8_to_bin(IREP_TT_STRING, cur); /* data type */
+      }
       char_ptr = RSTRING_PTR(irep->pool[pool_no]);
       len = RSTRING_LEN(irep->pool[pool_no]);
       break;
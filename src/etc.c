@@ -171,14 +171,17 @@ mrb_obj_id(mrb_value obj)
     return MakeID(float_id(mrb_float(obj)));
   case  MRB_TT_STRING:
   case  MRB_TT_OBJECT:
+  case  MRB_TT_ARRAY:
+  case  MRB_TT_HASH:
+  case  MRB_TT_RANGE:
+    /* the id is the address, so the object may not move any more */
+    mrb_basic_ptr(obj)->flags |= MRB_FLAG_GC_PINNED;
+    return MakeID(mrb_ptr(obj));
   case  MRB_TT_CLASS:
   case  MRB_TT_MODULE:
   case  MRB_TT_ICLASS:
   case  MRB_TT_SCLASS:
   case  MRB_TT_PROC:
-  case  MRB_TT_ARRAY:
-  case  MRB_TT_HASH:
-  case  MRB_TT_RANGE:
   case  MRB_TT_EXCEPTION:
   case  MRB_TT_FILE:
   case  MRB_TT_DATA:
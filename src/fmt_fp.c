@@ -0,0 +1,349 @@
+/*
+** fmt_fp.c - shortest round-trip Float digits
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mruby.h"
+#include "mruby/numeric.h"
+
+/*
+ * Float#to_s wants the fewest decimal digits that read back as the
+ * same value.  Doubles go through Grisu3 (Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers"),
+ * which finds them with 64-bit integer arithmetic for all but about
+ * 0.5% of inputs; it detects those itself, and they fall back to
+ * trying "%.*e" with increasing precision until strtod agrees.
+ */
+
+#ifdef MRB_USE_FLOAT
+#define FLO_MAX_DIGITS 9
+#else
+#define FLO_MAX_DIGITS 17
+#endif
+
+static int
+exact_shortest(mrb_float v, char *digits, int *decpt)
+{
+  char buf[32];
+  char *p;
+  int prec, n = 0;
+
+  for (prec = 1;; prec++) {
+    snprintf(buf, sizeof(buf), "%.*e", prec - 1, (double)v);
+    if (prec == FLO_MAX_DIGITS || str_to_mrb_float(buf) == v) break;
+  }
+  for (p = buf; *p != 'e'; p++) {
+    if (*p != '.') digits[n++] = *p;
+  }
+  while (n > 1 && digits[n-1] == '0') n--;
+  *decpt = atoi(p + 1) + 1;
+  return n;
+}
+
+#ifndef MRB_USE_FLOAT
+
+typedef struct {
+  uint64_t f;
+  int e;
+} diy_fp;
+
+#define DIY_SIGNIFICAND_SIZE 64
+#define DBL_HIDDEN_BIT  ((uint64_t)1 << 52)
+#define DBL_FRAC_MASK   (DBL_HIDDEN_BIT - 1)
+#define DBL_EXP_BIAS    (0x3ff + 52)
+#define DBL_DENORM_EXP  (1 - DBL_EXP_BIAS)
+
+/* scaled products must land in [2^-60, 2^-32) so the integral part fits 32 bits */
+#define MIN_TARGET_EXP  (-60)
+#define CACHED_POWERS_OFFSET 348
+#define CACHED_POWERS_STEP   8
+
+/* normalized 10^e for e = -348, -340, ..., 340 */
+static const struct {
+  uint64_t f;
+  int16_t e;
+  int16_t dec_e;
+} cached_powers[] = {
+  {0xfa8fd5a0081c0288ULL, -1220, -348},
+  {0xbaaee17fa23ebf76ULL, -1193, -340},
+  {0x8b16fb203055ac76ULL, -1166, -332},
+  {0xcf42894a5dce35eaULL, -1140, -324},
+  {0x9a6bb0aa55653b2dULL, -1113, -316},
+  {0xe61acf033d1a45dfULL, -1087, -308},
+  {0xab70fe17c79ac6caULL, -1060, -300},
+  {0xff77b1fcbebcdc4fULL, -1034, -292},
+  {0xbe5691ef416bd60cULL, -1007, -284},
+  {0x8dd01fad907ffc3cULL, -980, -276},
+  {0xd3515c2831559a83ULL, -954, -268},
+  {0x9d71ac8fada6c9b5ULL, -927, -260},
+  {0xea9c227723ee8bcbULL, -901, -252},
+  {0xaecc49914078536dULL, -874, -244},
+  {0x823c12795db6ce57ULL, -847, -236},
+  {0xc21094364dfb5637ULL, -821, -228},
+  {0x9096ea6f3848984fULL, -794, -220},
+  {0xd77485cb25823ac7ULL, -768, -212},
+  {0xa086cfcd97bf97f4ULL, -741, -204},
+  {0xef340a98172aace5ULL, -715, -196},
+  {0xb23867fb2a35b28eULL, -688, -188},
+  {0x84c8d4dfd2c63f3bULL, -661, -180},
+  {0xc5dd44271ad3cdbaULL, -635, -172},
+  {0x936b9fcebb25c996ULL, -608, -164},
+  {0xdbac6c247d62a584ULL, -582, -156},
+  {0xa3ab66580d5fdaf6ULL, -555, -148},
+  {0xf3e2f893dec3f126ULL, -529, -140},
+  {0xb5b5ada8aaff80b8ULL, -502, -132},
+  {0x87625f056c7c4a8bULL, -475, -124},
+  {0xc9bcff6034c13053ULL, -449, -116},
+  {0x964e858c91ba2655ULL, -422, -108},
+  {0xdff9772470297ebdULL, -396, -100},
+  {0xa6dfbd9fb8e5b88fULL, -369, -92},
+  {0xf8a95fcf88747d94ULL, -343, -84},
+  {0xb94470938fa89bcfULL, -316, -76},
+  {0x8a08f0f8bf0f156bULL, -289, -68},
+  {0xcdb02555653131b6ULL, -263, -60},
+  {0x993fe2c6d07b7facULL, -236, -52},
+  {0xe45c10c42a2b3b06ULL, -210, -44},
+  {0xaa242499697392d3ULL, -183, -36},
+  {0xfd87b5f28300ca0eULL, -157, -28},
+  {0xbce5086492111aebULL, -130, -20},
+  {0x8cbccc096f5088ccULL, -103, -12},
+  {0xd1b71758e219652cULL, -77, -4},
+  {0x9c40000000000000ULL, -50, 4},
+  {0xe8d4a51000000000ULL, -24, 12},
+  {0xad78ebc5ac620000ULL, 3, 20},
+  {0x813f3978f8940984ULL, 30, 28},
+  {0xc097ce7bc90715b3ULL, 56, 36},
+  {0x8f7e32ce7bea5c70ULL, 83, 44},
+  {0xd5d238a4abe98068ULL, 109, 52},
+  {0x9f4f2726179a2245ULL, 136, 60},
+  {0xed63a231d4c4fb27ULL, 162, 68},
+  {0xb0de65388cc8ada8ULL, 189, 76},
+  {0x83c7088e1aab65dbULL, 216, 84},
+  {0xc45d1df942711d9aULL, 242, 92},
+  {0x924d692ca61be758ULL, 269, 100},
+  {0xda01ee641a708deaULL, 295, 108},
+  {0xa26da3999aef774aULL, 322, 116},
+  {0xf209787bb47d6b85ULL, 348, 124},
+  {0xb454e4a179dd1877ULL, 375, 132},
+  {0x865b86925b9bc5c2ULL, 402, 140},
+  {0xc83553c5c8965d3dULL, 428, 148},
+  {0x952ab45cfa97a0b3ULL, 455, 156},
+  {0xde469fbd99a05fe3ULL, 481, 164},
+  {0xa59bc234db398c25ULL, 508, 172},
+  {0xf6c69a72a3989f5cULL, 534, 180},
+  {0xb7dcbf5354e9beceULL, 561, 188},
+  {0x88fcf317f22241e2ULL, 588, 196},
+  {0xcc20ce9bd35c78a5ULL, 614, 204},
+  {0x98165af37b2153dfULL, 641, 212},
+  {0xe2a0b5dc971f303aULL, 667, 220},
+  {0xa8d9d1535ce3b396ULL, 694, 228},
+  {0xfb9b7cd9a4a7443cULL, 720, 236},
+  {0xbb764c4ca7a44410ULL, 747, 244},
+  {0x8bab8eefb6409c1aULL, 774, 252},
+  {0xd01fef10a657842cULL, 800, 260},
+  {0x9b10a4e5e9913129ULL, 827, 268},
+  {0xe7109bfba19c0c9dULL, 853, 276},
+  {0xac2820d9623bf429ULL, 880, 284},
+  {0x80444b5e7aa7cf85ULL, 907, 292},
+  {0xbf21e44003acdd2dULL, 933, 300},
+  {0x8e679c2f5e44ff8fULL, 960, 308},
+  {0xd433179d9c8cb841ULL, 986, 316},
+  {0x9e19db92b4e31ba9ULL, 1013, 324},
+  {0xeb96bf6ebadf77d9ULL, 1039, 332},
+  {0xaf87023b9bf0ee6bULL, 1066, 340},
+};
+
+static diy_fp
+diy_mul(diy_fp x, diy_fp y)
+{
+  const uint64_t m32 = 0xffffffffULL;
+  uint64_t a = x.f >> 32, b = x.f & m32;
+  uint64_t c = y.f >> 32, d = y.f & m32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+  diy_fp r;
+
+  tmp += 1ULL << 31;            /* round */
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static diy_fp
+diy_normalize(diy_fp x)
+{
+  while (!(x.f & (DBL_HIDDEN_BIT << 11))) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/* w is v itself; m_minus and m_plus bound the values that read back as v */
+static void
+dbl_boundaries(double v, diy_fp *w, diy_fp *m_minus, diy_fp *m_plus)
+{
+  uint64_t bits;
+  uint64_t frac;
+  int bexp;
+  diy_fp pl, mi;
+
+  memcpy(&bits, &v, sizeof(bits));
+  frac = bits & DBL_FRAC_MASK;
+  bexp = (int)((bits >> 52) & 0x7ff);
+  if (bexp != 0) {
+    w->f = frac + DBL_HIDDEN_BIT;
+    w->e = bexp - DBL_EXP_BIAS;
+  }
+  else {
+    w->f = frac;
+    w->e = DBL_DENORM_EXP;
+  }
+  pl.f = (w->f << 1) + 1;
+  pl.e = w->e - 1;
+  pl = diy_normalize(pl);
+  if (frac == 0 && bexp > 1) {
+    /* the gap below a power of two is half the gap above */
+    mi.f = (w->f << 2) - 1;
+    mi.e = w->e - 2;
+  }
+  else {
+    mi.f = (w->f << 1) - 1;
+    mi.e = w->e - 1;
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  *w = diy_normalize(*w);
+  *m_minus = mi;
+  *m_plus = pl;
+}
+
+static diy_fp
+cached_power(int min_exp, int *dec_e)
+{
+  int k = (int)ceil((min_exp + DIY_SIGNIFICAND_SIZE - 1) * 0.30102999566398114);
+  int i = (CACHED_POWERS_OFFSET + k - 1) / CACHED_POWERS_STEP + 1;
+  diy_fp r;
+
+  r.f = cached_powers[i].f;
+  r.e = cached_powers[i].e;
+  *dec_e = cached_powers[i].dec_e;
+  return r;
+}
+
+/*
+ * Moves the last digit down towards w while that stays inside the
+ * safe interval, then reports whether the result is provably the
+ * closest shortest representation.
+ */
+static int
+round_weed(char *buf, int len, uint64_t dist_high_w, uint64_t unsafe,
+           uint64_t rest, uint64_t ten_kappa, uint64_t unit)
+{
+  uint64_t small_dist = dist_high_w - unit;
+  uint64_t big_dist = dist_high_w + unit;
+
+  while (rest < small_dist && unsafe - rest >= ten_kappa &&
+         (rest + ten_kappa < small_dist ||
+          small_dist - rest >= rest + ten_kappa - small_dist)) {
+    buf[len-1]--;
+    rest += ten_kappa;
+  }
+  if (rest < big_dist && unsafe - rest >= ten_kappa &&
+      (rest + ten_kappa < big_dist ||
+       big_dist - rest > rest + ten_kappa - big_dist)) {
+    return FALSE;
+  }
+  return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+static int
+digit_gen(diy_fp low, diy_fp w, diy_fp high, char *buf, int *len, int *kappa)
+{
+  uint64_t unit = 1;
+  uint64_t too_high = high.f + unit;
+  uint64_t unsafe = too_high - (low.f - unit);
+  int shift = -w.e;
+  uint64_t one = (uint64_t)1 << shift;
+  uint32_t integrals = (uint32_t)(too_high >> shift);
+  uint64_t fractionals = too_high & (one - 1);
+  uint32_t divisor = 0;
+  int n = 0;
+
+  *kappa = 0;
+  if (integrals > 0) {
+    divisor = 1;
+    *kappa = 1;
+    while (integrals / 10 >= divisor) {
+      divisor *= 10;
+      (*kappa)++;
+    }
+  }
+  while (*kappa > 0) {
+    uint64_t rest;
+
+    buf[n++] = '0' + integrals / divisor;
+    integrals %= divisor;
+    (*kappa)--;
+    rest = ((uint64_t)integrals << shift) + fractionals;
+    if (rest < unsafe) {
+      *len = n;
+      return round_weed(buf, n, too_high - w.f, unsafe, rest,
+                        (uint64_t)divisor << shift, unit);
+    }
+    divisor /= 10;
+  }
+  for (;;) {
+    fractionals *= 10;
+    unit *= 10;
+    unsafe *= 10;
+    buf[n++] = '0' + (int)(fractionals >> shift);
+    fractionals &= one - 1;
+    (*kappa)--;
+    if (fractionals < unsafe) {
+      *len = n;
+      return round_weed(buf, n, (too_high - w.f) * unit, unsafe,
+                        fractionals, one, unit);
+    }
+  }
+}
+
+static int
+grisu3(double v, char *digits, int *len, int *decpt)
+{
+  diy_fp w, m_minus, m_plus, c_mk;
+  int mk, kappa;
+
+  dbl_boundaries(v, &w, &m_minus, &m_plus);
+  c_mk = cached_power(MIN_TARGET_EXP - (w.e + DIY_SIGNIFICAND_SIZE), &mk);
+  w = diy_mul(w, c_mk);
+  m_minus = diy_mul(m_minus, c_mk);
+  m_plus = diy_mul(m_plus, c_mk);
+  if (!digit_gen(m_minus, w, m_plus, digits, len, &kappa)) return FALSE;
+  *decpt = *len + kappa - mk;
+  return TRUE;
+}
+
+#endif
+
+/*
+ * Writes the shortest digit string that reads back as v, a positive
+ * finite value, to digits (room for 20, not NUL terminated) and
+ * returns its length.  *decpt is set so that v == 0.DIGITS * 10**decpt.
+ */
+int
+mrb_flo_shortest(mrb_float v, char *digits, int *decpt)
+{
+#ifndef MRB_USE_FLOAT
+  int len;
+
+  if (grisu3(v, digits, &len, decpt)) return len;
+#endif
+  return exact_shortest(v, digits, decpt);
+}
@@ -7,6 +7,7 @@
 #include <limits.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
@@ -61,6 +62,14 @@
 
   For details, see the comments for each function.
 
+  == Lazy Sweep
+
+  The sweep phase is not run by GC steps. Once marking is done the heap
+  pages are queued on mrb->sweeps, and mrb_obj_alloc sweeps them one at
+  a time only when it runs out of free slots, so the slots are reused
+  right after being swept. No new cycle starts until the queue is empty.
+  The remaining pages are swept by mrb_gc_idle(), or by a full GC.
+
   == Write Barrier
 
   mruby implementer and C extension library writer must write a write
@@ -250,6 +259,7 @@ struct heap_page {
   struct heap_page *next;
   struct heap_page *free_next;
   struct heap_page *free_prev;
+  size_t used;  /* slots handed out so far; the rest are untouched */
   mrb_bool old:1;
   RVALUE objects[MRB_HEAP_PAGE_SIZE];
 };
@@ -299,24 +309,32 @@ unlink_free_heap_page(mrb_state *mrb, struct heap_page *page)
   page->free_next = NULL;
 }
 
+/* heap page full: nothing on its freelist and no untouched slot left */
+#define page_full_p(page) ((page)->freelist == NULL && (page)->used == MRB_HEAP_PAGE_SIZE)
+
 static void
 add_heap(mrb_state *mrb)
 {
-  struct heap_page *page = (struct heap_page *)mrb_calloc(mrb, 1, sizeof(struct heap_page));
-  RVALUE *p, *e;
-  struct RBasic *prev = NULL;
+  /* slots are handed out by bumping page->used, so they need no setup */
+  struct heap_page *page = (struct heap_page *)mrb_malloc(mrb, sizeof(struct heap_page));
 
-  for (p = page->objects, e=p+MRB_HEAP_PAGE_SIZE; p<e; p++) {
-    p->as.free.tt = MRB_TT_FREE;
-    p->as.free.next = prev;
-    prev = &p->as.basic;
-  }
-  page->freelist = prev;
+  page->freelist = NULL;
+  page->prev = page->next = NULL;
+  page->free_prev = page->free_next = NULL;
+  page->used = 0;
+  page->old = FALSE;
 
   link_heap_page(mrb, page);
   link_free_heap_page(mrb, page);
 }
 
+#ifdef MRB_GC_ARENA_DEBUG
+#include <stdio.h>
+#ifndef MRB_GC_ARENA_WARN
+#define MRB_GC_ARENA_WARN MRB_GC_ARENA_SIZE
+#endif
+#endif
+
 #define DEFAULT_GC_INTERVAL_RATIO 200
 #define DEFAULT_GC_STEP_RATIO 200
 #define DEFAULT_MAJOR_GC_INC_RATIO 200
@@ -332,6 +350,9 @@ mrb_init_heap(mrb_state *mrb)
   add_heap(mrb);
   mrb->gc_interval_ratio = DEFAULT_GC_INTERVAL_RATIO;
   mrb->gc_step_ratio = DEFAULT_GC_STEP_RATIO;
+#ifdef MRB_GC_ARENA_DEBUG
+  mrb->arena_warn = MRB_GC_ARENA_WARN;
+#endif
 #ifndef MRB_GC_TURN_OFF_GENERATIONAL
   mrb->is_generational_gc_mode = TRUE;
   mrb->gc_full = TRUE;
@@ -343,6 +364,8 @@ mrb_init_heap(mrb_state *mrb)
 }
 
 static void obj_free(mrb_state *mrb, struct RBasic *obj);
+static void lazy_sweep(mrb_state *mrb, size_t limit, mrb_bool need_free);
+static void clear_all_old(mrb_state *mrb);
 
 void
 mrb_free_heap(mrb_state *mrb)
@@ -354,7 +377,7 @@ mrb_free_heap(mrb_state *mrb)
   while (page) {
     tmp = page;
     page = page->next;
-    for (p = tmp->objects, e=p+MRB_HEAP_PAGE_SIZE; p<e; p++) {
+    for (p = tmp->objects, e=p+tmp->used; p<e; p++) {
       if (p->as.free.tt != MRB_TT_FREE)
         obj_free(mrb, &p->as.basic);
     }
@@ -362,11 +385,84 @@ mrb_free_heap(mrb_state *mrb)
   }
 }
 
+#ifdef MRB_GC_ARENA_DEBUG
+static void
+arena_report_frame(mrb_state *mrb, mrb_callinfo *ci)
+{
+  const char *name = "<top>";
+  size_t len = 5;
+
+  if (ci->mid) name = mrb_sym2name_len(mrb, ci->mid, &len);
+  fprintf(stderr, "%.*s (%s)", (int)len, name,
+          (ci->proc && MRB_PROC_CFUNC_P(ci->proc)) ? "C function" : "Ruby method");
+}
+
+/*
+ * Names the running method and its caller, since a C function that
+ * calls a method from a loop leaks the results in the callee's frame.
+ * Must not allocate: called from gc_protect.
+ */
+static void
+arena_report(mrb_state *mrb)
+{
+  mrb_callinfo *ci = mrb->c->ci;
+
+  fprintf(stderr, "mruby: GC arena reached %d entries in ", mrb->arena_idx);
+  arena_report_frame(mrb, ci);
+  if (ci > mrb->c->cibase) {
+    fputs(", called from ", stderr);
+    arena_report_frame(mrb, ci - 1);
+  }
+  fputs("\n", stderr);
+  mrb->arena_warn *= 2;
+}
+
+void
+mrb_gc_arena_scope_begin(mrb_state *mrb, struct mrb_gc_arena_scope *s)
+{
+  s->ai = mrb->arena_idx;
+  s->depth = ++mrb->arena_scope_depth;
+}
+
+static void
+arena_scope_check(mrb_state *mrb, struct mrb_gc_arena_scope *s, const char *what)
+{
+  if (s->depth != mrb->arena_scope_depth) {
+    fprintf(stderr, "mruby: MRB_GC_ARENA_SCOPE_%s closes scope %d but %d is innermost"
+            " (returned from inside a scope?)\n", what, s->depth, mrb->arena_scope_depth);
+    abort();
+  }
+  if (mrb->arena_idx < s->ai) {
+    fprintf(stderr, "mruby: MRB_GC_ARENA_SCOPE_%s finds arena at %d below scope start %d\n",
+            what, mrb->arena_idx, s->ai);
+    abort();
+  }
+}
+
+void
+mrb_gc_arena_scope_end(mrb_state *mrb, struct mrb_gc_arena_scope *s)
+{
+  arena_scope_check(mrb, s, "END");
+  mrb->arena_scope_depth--;
+  mrb_gc_arena_restore(mrb, s->ai);
+}
+
+void
+mrb_gc_arena_scope_reset(mrb_state *mrb, struct mrb_gc_arena_scope *s)
+{
+  arena_scope_check(mrb, s, "RESET");
+  mrb->arena_idx = s->ai;
+}
+#endif
+
 static void
 gc_protect(mrb_state *mrb, struct RBasic *p)
 {
 #ifdef MRB_GC_FIXED_ARENA
   if (mrb->arena_idx >= MRB_GC_ARENA_SIZE) {
+#ifdef MRB_GC_ARENA_DEBUG
+    arena_report(mrb);
+#endif
     /* arena overflow error */
     mrb->arena_idx = MRB_GC_ARENA_SIZE - 4; /* force room in arena */
     mrb_raise(mrb, E_RUNTIME_ERROR, "arena overflow error");
@@ -379,6 +475,10 @@ gc_protect(mrb_state *mrb, struct RBasic *p)
   }
 #endif
   mrb->arena[mrb->arena_idx++] = p;
+  if (mrb->arena_idx > mrb->arena_max) mrb->arena_max = mrb->arena_idx;
+#ifdef MRB_GC_ARENA_DEBUG
+  if (mrb->arena_idx >= mrb->arena_warn) arena_report(mrb);
+#endif
 }
 
 void
@@ -392,6 +492,7 @@ struct RBasic*
 mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
 {
   struct RBasic *p;
+  struct heap_page *page;
   static const RVALUE RVALUE_zero = { { { MRB_TT_FALSE } } };
 
 #ifdef MRB_GC_STRESS
@@ -400,14 +501,26 @@ mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
   if (mrb->gc_threshold < mrb->live) {
     mrb_incremental_gc(mrb);
   }
-  if (mrb->free_heaps == NULL) {
+  page = mrb->free_heaps;
+  if (page == NULL && mrb->gc_state == GC_STATE_SWEEP) {
+    lazy_sweep(mrb, ~0, TRUE);
+    page = mrb->free_heaps;
+  }
+  if (page == NULL) {
     add_heap(mrb);
+    page = mrb->free_heaps;
   }
 
-  p = mrb->free_heaps->freelist;
-  mrb->free_heaps->freelist = ((struct free_obj*)p)->next;
-  if (mrb->free_heaps->freelist == NULL) {
-    unlink_free_heap_page(mrb, mrb->free_heaps);
+  if (page->freelist) {
+    /* slots reclaimed by the sweeper */
+    p = page->freelist;
+    page->freelist = ((struct free_obj*)p)->next;
+  }
+  else {
+    p = &page->objects[page->used++].as.basic;
+  }
+  if (page_full_p(page)) {
+    unlink_free_heap_page(mrb, page);
   }
 
   mrb->live++;
@@ -416,6 +529,7 @@ mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
   p->tt = ttype;
   p->c = cls;
   paint_partial_white(mrb, p);
+  if (mrb->alloc_hook) mrb->alloc_hook(mrb, p);
   return p;
 }
 
@@ -517,7 +631,7 @@ gc_mark_children(mrb_state *mrb, struct RBasic *obj)
       if (e->cioff < 0) {
         int i, len;
 
-        len = (int)e->flags;
+        len = (int)MRB_ENV_STACK_LEN(e);
         for (i=0; i<len; i++) {
           mrb_gc_mark_value(mrb, e->stack[i]);
         }
@@ -529,7 +643,7 @@ gc_mark_children(mrb_state *mrb, struct RBasic *obj)
     {
       struct mrb_context *c = ((struct RFiber*)obj)->cxt;
 
-      mark_context(mrb, c);
+      if (c) mark_context(mrb, c);
     }
     break;
 
@@ -605,6 +719,8 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
   case MRB_TT_SCLASS:
     mrb_gc_free_mt(mrb, (struct RClass*)obj);
     mrb_gc_free_iv(mrb, (struct RObject*)obj);
+    /* the address may be reused by a class that call handles have not seen */
+    mrb->method_serial++;
     break;
 
   case MRB_TT_ENV:
@@ -623,7 +739,7 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
       struct mrb_context *c = ((struct RFiber*)obj)->cxt;
 
       if (c != mrb->root_c)
-        mrb_free_context(mrb, c);
+        mrb_context_recycle(mrb, c);
     }
     break;
 
@@ -681,6 +797,7 @@ root_scan_phase(mrb_state *mrb)
   if (!is_minor_gc(mrb)) {
     mrb->gray_list = NULL;
     mrb->atomic_gray_list = NULL;
+    mrb->gc_scan_obj = NULL;
   }
 
   mrb_gc_mark_gv(mrb);
@@ -701,11 +818,106 @@ root_scan_phase(mrb_state *mrb)
   }
 }
 
+/*
+ * Chunked marking (GC.max_pause_us > 0).
+ *
+ * A large Array or Hash taken off the gray list is painted black at
+ * once, so write barriers treat it as scanned, and its elements are
+ * then marked GC_MARK_CHUNK at a time from mrb->gc_scan_obj.  Stores
+ * into it go through the barriers as usual.  If its elements may have
+ * moved (ary_modify, a new buffer), the object is handed to the
+ * atomic gray list and rescanned by the final mark instead.
+ */
+#define GC_MARK_CHUNK 1024
+
+static int
+chunked_mark_p(mrb_state *mrb, struct RBasic *obj)
+{
+  if (mrb->gc_max_pause_us == 0) return FALSE;
+  switch (obj->tt) {
+  case MRB_TT_ARRAY:
+    return ((struct RArray*)obj)->len > GC_MARK_CHUNK;
+  case MRB_TT_HASH:
+    return mrb_gc_hash_buckets(mrb, (struct RHash*)obj, NULL) > GC_MARK_CHUNK;
+  default:
+    return FALSE;
+  }
+}
+
+static void*
+scan_buffer(mrb_state *mrb, struct RBasic *obj)
+{
+  void *buf;
+
+  if (obj->tt == MRB_TT_ARRAY) {
+    return ((struct RArray*)obj)->ptr;
+  }
+  mrb_gc_hash_buckets(mrb, (struct RHash*)obj, &buf);
+  return buf;
+}
+
+static void
+scan_start(mrb_state *mrb, struct RBasic *obj)
+{
+  paint_black(obj);
+  mrb->gray_list = obj->gcnext;
+  mrb_gc_mark(mrb, (struct RBasic*)obj->c);
+  if (obj->tt == MRB_TT_HASH) {
+    mrb_gc_mark_iv(mrb, (struct RObject*)obj);
+  }
+  mrb->gc_scan_obj = obj;
+  mrb->gc_scan_pos = 0;
+  mrb->gc_scan_ptr = scan_buffer(mrb, obj);
+}
+
+static size_t
+scan_step(mrb_state *mrb)
+{
+  struct RBasic *obj = mrb->gc_scan_obj;
+  size_t pos = mrb->gc_scan_pos;
+  size_t end, len;
+
+  if (is_black(obj) && scan_buffer(mrb, obj) != mrb->gc_scan_ptr) {
+    /* elements moved to a new buffer; leave it to the final mark */
+    mrb_write_barrier(mrb, obj);
+  }
+  if (!is_black(obj)) {
+    mrb->gc_scan_obj = NULL;
+    return 1;
+  }
+  if (obj->tt == MRB_TT_ARRAY) {
+    struct RArray *a = (struct RArray*)obj;
+    size_t i;
+
+    len = a->len;
+    end = pos + GC_MARK_CHUNK < len ? pos + GC_MARK_CHUNK : len;
+    for (i=pos; i<end; i++) {
+      mrb_gc_mark_value(mrb, a->ptr[i]);
+    }
+  }
+  else {
+    struct RHash *h = (struct RHash*)obj;
+
+    len = mrb_gc_hash_buckets(mrb, h, NULL);
+    end = pos + GC_MARK_CHUNK < len ? pos + GC_MARK_CHUNK : len;
+    mrb_gc_mark_hash_range(mrb, h, pos, end);
+  }
+  if (end >= len) {
+    mrb->gc_scan_obj = NULL;
+  }
+  mrb->gc_scan_pos = end;
+  return end - pos + 1;
+}
+
 static size_t
 gc_gray_mark(mrb_state *mrb, struct RBasic *obj)
 {
   size_t children = 0;
 
+  if (chunked_mark_p(mrb, obj)) {
+    scan_start(mrb, obj);
+    return 1;
+  }
   gc_mark_children(mrb, obj);
 
   switch (obj->tt) {
@@ -731,7 +943,7 @@ gc_gray_mark(mrb_state *mrb, struct RBasic *obj)
     break;
 
   case MRB_TT_ENV:
-    children += (int)obj->flags;
+    children += (int)MRB_ENV_STACK_LEN((struct REnv*)obj);
     break;
 
   case MRB_TT_FIBER:
@@ -740,6 +952,7 @@ gc_gray_mark(mrb_state *mrb, struct RBasic *obj)
       size_t i;
       mrb_callinfo *ci;
 
+      if (!c) break;
       /* mark stack */
       i = c->stack - c->stbase;
       if (c->ci) i += c->ci->nregs;
@@ -798,8 +1011,11 @@ incremental_marking_phase(mrb_state *mrb, size_t limit)
 {
   size_t tried_marks = 0;
 
-  while (mrb->gray_list && tried_marks < limit) {
-    tried_marks += gc_gray_mark(mrb, mrb->gray_list);
+  while ((mrb->gc_scan_obj || mrb->gray_list) && tried_marks < limit) {
+    if (mrb->gc_scan_obj)
+      tried_marks += scan_step(mrb);
+    else
+      tried_marks += gc_gray_mark(mrb, mrb->gray_list);
   }
 
   return tried_marks;
@@ -808,6 +1024,9 @@ incremental_marking_phase(mrb_state *mrb, size_t limit)
 static void
 final_marking_phase(mrb_state *mrb)
 {
+  while (mrb->gc_scan_obj) {
+    scan_step(mrb);
+  }
   mark_context_stack(mrb, mrb->root_c);
   gc_mark_gray_list(mrb);
   mrb_assert(mrb->gray_list == NULL);
@@ -833,10 +1052,10 @@ incremental_sweep_phase(mrb_state *mrb, size_t limit)
 
   while (page && (tried_sweep < limit)) {
     RVALUE *p = page->objects;
-    RVALUE *e = p + MRB_HEAP_PAGE_SIZE;
+    RVALUE *e = p + page->used;
     size_t freed = 0;
     int dead_slot = 1;
-    int full = (page->freelist == NULL);
+    int full = page_full_p(page);
 
     if (is_minor_gc(mrb) && page->old) {
       /* skip a slot which doesn't contain any young object */
@@ -873,7 +1092,7 @@ incremental_sweep_phase(mrb_state *mrb, size_t limit)
       if (full && freed > 0) {
         link_free_heap_page(mrb, page);
       }
-      if (page->freelist == NULL && is_minor_gc(mrb))
+      if (page_full_p(page) && is_minor_gc(mrb))
         page->old = TRUE;
       else
         page->old = FALSE;
@@ -897,7 +1116,7 @@ incremental_gc(mrb_state *mrb, size_t limit)
     flip_white_part(mrb);
     return 0;
   case GC_STATE_MARK:
-    if (mrb->gray_list) {
+    if (mrb->gray_list || mrb->gc_scan_obj) {
       return incremental_marking_phase(mrb, limit);
     }
     else {
@@ -919,6 +1138,54 @@ incremental_gc(mrb_state *mrb, size_t limit)
   }
 }
 
+/* sets up the next cycle once a lazy sweep has finished */
+static void
+gc_cycle_done(mrb_state *mrb)
+{
+  mrb_assert(mrb->live >= mrb->gc_live_after_mark);
+  mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
+  if (mrb->gc_threshold < GC_STEP_SIZE) {
+    mrb->gc_threshold = GC_STEP_SIZE;
+  }
+
+  if (is_major_gc(mrb)) {
+    mrb->majorgc_old_threshold = mrb->gc_live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
+    mrb->gc_full = FALSE;
+  }
+  else if (is_minor_gc(mrb)) {
+    if (mrb->live > mrb->majorgc_old_threshold) {
+      clear_all_old(mrb);
+      mrb->gc_full = TRUE;
+    }
+  }
+}
+
+/*
+ * Sweeps queued pages one by one, up to limit slots; with need_free it
+ * stops as soon as a page with a free slot shows up.
+ */
+static void
+lazy_sweep(mrb_state *mrb, size_t limit, mrb_bool need_free)
+{
+  size_t tried_sweep = 0;
+  size_t live = mrb->live;
+
+  while (mrb->gc_state == GC_STATE_SWEEP && tried_sweep < limit) {
+    tried_sweep += incremental_sweep_phase(mrb, MRB_HEAP_PAGE_SIZE);
+    if (need_free) {
+      /* the next step stays due after the same number of allocations */
+      mrb->gc_threshold -= live - mrb->live;
+      live = mrb->live;
+    }
+    if (!mrb->sweeps) {
+      mrb->gc_state = GC_STATE_NONE;
+      gc_cycle_done(mrb);
+      return;
+    }
+    if (need_free && mrb->free_heaps) return;
+  }
+}
+
 static void
 incremental_gc_until(mrb_state *mrb, enum gc_state to_state)
 {
@@ -927,15 +1194,41 @@ incremental_gc_until(mrb_state *mrb, enum gc_state to_state)
   } while (mrb->gc_state != to_state);
 }
 
+static size_t
+gc_clock_us(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (size_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  return (size_t)((double)clock() * 1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+/* work done between clock checks in pause-target mode */
+#define GC_TIMED_SLICE 256
+
 static void
 incremental_gc_step(mrb_state *mrb)
 {
   size_t limit = 0, result = 0;
-  limit = (GC_STEP_SIZE/100) * mrb->gc_step_ratio;
-  while (result < limit) {
-    result += incremental_gc(mrb, limit);
-    if (mrb->gc_state == GC_STATE_NONE)
-      break;
+
+  if (mrb->gc_max_pause_us > 0) {
+    size_t deadline = gc_clock_us() + mrb->gc_max_pause_us;
+
+    do {
+      incremental_gc(mrb, GC_TIMED_SLICE);
+    } while (mrb->gc_state != GC_STATE_SWEEP && gc_clock_us() < deadline);
+  }
+  else {
+    limit = (GC_STEP_SIZE/100) * mrb->gc_step_ratio;
+    while (result < limit) {
+      result += incremental_gc(mrb, limit);
+      if (mrb->gc_state == GC_STATE_SWEEP)
+        break;
+    }
   }
 
   mrb->gc_threshold = mrb->live + GC_STEP_SIZE;
@@ -961,6 +1254,7 @@ clear_all_old(mrb_state *mrb)
 
   /* The gray objects has already been painted as white */
   mrb->atomic_gray_list = mrb->gray_list = NULL;
+  mrb->gc_scan_obj = NULL;
 }
 
 void
@@ -971,33 +1265,32 @@ mrb_incremental_gc(mrb_state *mrb)
   GC_INVOKE_TIME_REPORT("mrb_incremental_gc()");
   GC_TIME_START;
 
-  if (is_minor_gc(mrb)) {
-    incremental_gc_until(mrb, GC_STATE_NONE);
+  if (mrb->gc_state == GC_STATE_SWEEP) {
+    /* keep the sweep from falling behind the allocation */
+    lazy_sweep(mrb, (GC_STEP_SIZE/100) * mrb->gc_step_ratio, FALSE);
+    if (mrb->gc_state == GC_STATE_SWEEP) {
+      mrb->gc_threshold = mrb->live + GC_STEP_SIZE;
+    }
+  }
+  else if (is_minor_gc(mrb)) {
+    incremental_gc_until(mrb, GC_STATE_SWEEP);
+    mrb->gc_threshold = mrb->live + GC_STEP_SIZE;
   }
   else {
     incremental_gc_step(mrb);
   }
 
-  if (mrb->gc_state == GC_STATE_NONE) {
-    mrb_assert(mrb->live >= mrb->gc_live_after_mark);
-    mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
-    if (mrb->gc_threshold < GC_STEP_SIZE) {
-      mrb->gc_threshold = GC_STEP_SIZE;
-    }
+  GC_TIME_STOP_AND_REPORT;
+}
 
-    if (is_major_gc(mrb)) {
-      mrb->majorgc_old_threshold = mrb->gc_live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
-      mrb->gc_full = FALSE;
-    }
-    else if (is_minor_gc(mrb)) {
-      if (mrb->live > mrb->majorgc_old_threshold) {
-        clear_all_old(mrb);
-        mrb->gc_full = TRUE;
-      }
-    }
+/* Finish the pending lazy sweep; call this when the program is idle */
+void
+mrb_gc_idle(mrb_state *mrb)
+{
+  if (mrb->gc_disabled) return;
+  if (mrb->gc_state == GC_STATE_SWEEP) {
+    lazy_sweep(mrb, ~0, FALSE);
   }
-
-  GC_TIME_STOP_AND_REPORT;
 }
 
 /* Perform a full gc cycle */
@@ -1035,6 +1328,279 @@ mrb_garbage_collect(mrb_state *mrb)
   mrb_full_gc(mrb);
 }
 
+/*
+ * Heap compaction
+ *
+ * mrb_gc_compact() runs a full GC, then moves objects from the most
+ * sparsely populated pages into the free slots of the densest ones
+ * (two fingers over the pages sorted by live count) and releases the
+ * pages left empty.  A moved object leaves its old slot as MRB_TT_FREE
+ * with gcnext pointing to the new place; the references are then
+ * redirected by a walk over the heap that follows gc_mark_children().
+ *
+ * Only Objects, Strings, Arrays, Hashes and Ranges move, as C code may
+ * hold pointers to the other types.  They are pinned as well while
+ * they are in the arena, the top self or the pending exception, and
+ * for good once their object_id is taken or they are used as a Hash
+ * key other than a String.  An object referenced only from a C
+ * variable must be in the arena.
+ */
+
+struct compact_page {
+  struct heap_page *page;
+  size_t live;
+};
+
+#define compact_movable_p(o) (((o)->tt == MRB_TT_OBJECT || (o)->tt == MRB_TT_STRING ||\
+                               (o)->tt == MRB_TT_ARRAY || (o)->tt == MRB_TT_HASH ||\
+                               (o)->tt == MRB_TT_RANGE) && !((o)->flags & MRB_FLAG_GC_PINNED))
+
+void
+mrb_gc_update_value(mrb_state *mrb, mrb_value *v)
+{
+  struct RBasic *p;
+
+  if (mrb_special_const_p(*v)) return;
+  p = mrb_basic_ptr(*v);
+  if (p->tt == MRB_TT_FREE) {
+    *v = mrb_obj_value(p->gcnext);
+  }
+}
+
+/* C functions on the VM stack may keep object pointers in their locals */
+static int
+compact_safe_p(mrb_state *mrb)
+{
+  struct mrb_context *c = mrb->c;
+  mrb_callinfo *ci;
+
+  if (c != mrb->root_c) return FALSE;
+  for (ci = c->cibase + 1; ci <= c->ci; ci++) {
+    if (ci->acc < 0) return FALSE;
+    if (ci < c->ci && ci->proc && MRB_PROC_CFUNC_P(ci->proc)) return FALSE;
+  }
+  return TRUE;
+}
+
+static int
+compact_page_cmp(const void *a, const void *b)
+{
+  size_t la = ((const struct compact_page*)a)->live;
+  size_t lb = ((const struct compact_page*)b)->live;
+
+  return (la < lb) - (la > lb);
+}
+
+static RVALUE*
+compact_free_slot(struct heap_page *page)
+{
+  RVALUE *p;
+
+  if (page->freelist) {
+    p = (RVALUE*)page->freelist;
+    page->freelist = ((struct free_obj*)p)->next;
+    return p;
+  }
+  if (page->used < MRB_HEAP_PAGE_SIZE) {
+    return &page->objects[page->used++];
+  }
+  return NULL;
+}
+
+static void
+compact_update_context(mrb_state *mrb, struct mrb_context *c)
+{
+  size_t i, e;
+
+  e = c->stack - c->stbase;
+  if (c->ci) e += c->ci->nregs;
+  if (c->stbase + e > c->stend) e = c->stend - c->stbase;
+  for (i=0; i<e; i++) {
+    mrb_gc_update_value(mrb, &c->stbase[i]);
+  }
+}
+
+static void
+compact_update_children(mrb_state *mrb, struct RBasic *obj)
+{
+  switch (obj->tt) {
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+  case MRB_TT_OBJECT:
+  case MRB_TT_DATA:
+    mrb_gc_update_iv(mrb, (struct RObject*)obj);
+    break;
+
+  case MRB_TT_ENV:
+    {
+      struct REnv *e = (struct REnv*)obj;
+
+      if (e->cioff < 0) {
+        int i, len;
+
+        len = (int)MRB_ENV_STACK_LEN(e);
+        for (i=0; i<len; i++) {
+          mrb_gc_update_value(mrb, &e->stack[i]);
+        }
+      }
+    }
+    break;
+
+  case MRB_TT_FIBER:
+    if (((struct RFiber*)obj)->cxt) {
+      compact_update_context(mrb, ((struct RFiber*)obj)->cxt);
+    }
+    break;
+
+  case MRB_TT_ARRAY:
+    {
+      struct RArray *a = (struct RArray*)obj;
+      mrb_int i;
+
+      for (i=0; i<a->len; i++) {
+        mrb_gc_update_value(mrb, &a->ptr[i]);
+      }
+    }
+    break;
+
+  case MRB_TT_HASH:
+    mrb_gc_update_iv(mrb, (struct RObject*)obj);
+    mrb_gc_update_hash(mrb, (struct RHash*)obj);
+    break;
+
+  case MRB_TT_RANGE:
+    {
+      struct RRange *r = (struct RRange*)obj;
+
+      if (r->edges) {
+        mrb_gc_update_value(mrb, &r->edges->beg);
+        mrb_gc_update_value(mrb, &r->edges->end);
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+/* Returns the number of objects moved, or -1 if it cannot run here */
+mrb_int
+mrb_gc_compact(mrb_state *mrb)
+{
+  struct compact_page *pages;
+  struct RBasic **pins;
+  struct heap_page *page;
+  size_t npages = 0, npins = 0, i, j, pos;
+  mrb_int moved = 0;
+  RVALUE *p, *e;
+
+  if (mrb->gc_disabled || !compact_safe_p(mrb)) return -1;
+  mrb_full_gc(mrb);
+
+  /* pin what C may point to; these pins are undone at the end */
+  pins = (struct RBasic**)mrb_malloc(mrb, sizeof(struct RBasic*)*(mrb->arena_idx+2));
+  for (i=0; i<(size_t)mrb->arena_idx; i++) {
+    /* only movable objects take the flag; REnv keeps its length in flags */
+    if (compact_movable_p(mrb->arena[i])) {
+      mrb->arena[i]->flags |= MRB_FLAG_GC_PINNED;
+      pins[npins++] = mrb->arena[i];
+    }
+  }
+  if (mrb->top_self && !(mrb->top_self->flags & MRB_FLAG_GC_PINNED)) {
+    mrb->top_self->flags |= MRB_FLAG_GC_PINNED;
+    pins[npins++] = (struct RBasic*)mrb->top_self;
+  }
+  if (mrb->exc && !(mrb->exc->flags & MRB_FLAG_GC_PINNED)) {
+    mrb->exc->flags |= MRB_FLAG_GC_PINNED;
+    pins[npins++] = (struct RBasic*)mrb->exc;
+  }
+
+  for (page = mrb->heaps; page; page = page->next) {
+    npages++;
+  }
+  pages = (struct compact_page*)mrb_malloc(mrb, sizeof(struct compact_page)*npages);
+  for (i=0, page = mrb->heaps; page; i++, page = page->next) {
+    pages[i].page = page;
+    pages[i].live = 0;
+    for (p = page->objects, e = p + page->used; p < e; p++) {
+      if (p->as.basic.tt == MRB_TT_FREE) continue;
+      pages[i].live++;
+      if (p->as.basic.tt == MRB_TT_HASH) {
+        mrb_gc_pin_hash_keys(mrb, &p->as.hash);
+      }
+    }
+  }
+  qsort(pages, npages, sizeof(struct compact_page), compact_page_cmp);
+
+  /* move objects from the sparse end into the dense end */
+  i = 0; j = npages ? npages - 1 : 0; pos = 0;
+  while (i < j) {
+    struct heap_page *src = pages[j].page;
+    struct RBasic *obj = NULL;
+    RVALUE *dst;
+
+    for (; pos < src->used; pos++) {
+      obj = &src->objects[pos].as.basic;
+      if (obj->tt != MRB_TT_FREE && compact_movable_p(obj)) break;
+    }
+    if (pos >= src->used) {
+      j--; pos = 0;
+      continue;
+    }
+    dst = compact_free_slot(pages[i].page);
+    if (!dst) {
+      i++;
+      continue;
+    }
+    memcpy(dst, obj, sizeof(RVALUE));
+    obj->tt = MRB_TT_FREE;
+    obj->gcnext = &dst->as.basic;
+    ((struct free_obj*)obj)->next = src->freelist;
+    src->freelist = obj;
+    pages[i].live++;
+    pages[j].live--;
+    moved++;
+  }
+
+  /* redirect every reference to a moved object */
+  if (moved > 0) {
+    for (page = mrb->heaps; page; page = page->next) {
+      for (p = page->objects, e = p + page->used; p < e; p++) {
+        if (p->as.basic.tt != MRB_TT_FREE) {
+          compact_update_children(mrb, &p->as.basic);
+        }
+      }
+    }
+    mrb_gc_update_gv(mrb);
+    compact_update_context(mrb, mrb->root_c);
+  }
+
+  /* release the emptied pages and rebuild the free page list */
+  for (i=0; i<npages; i++) {
+    if (pages[i].live == 0) {
+      unlink_heap_page(mrb, pages[i].page);
+      mrb_free(mrb, pages[i].page);
+    }
+  }
+  mrb->free_heaps = NULL;
+  for (page = mrb->heaps; page; page = page->next) {
+    page->free_prev = page->free_next = NULL;
+    page->old = FALSE;
+    if (!page_full_p(page)) {
+      link_free_heap_page(mrb, page);
+    }
+  }
+
+  for (i=0; i<npins; i++) {
+    pins[i]->flags &= ~MRB_FLAG_GC_PINNED;
+  }
+  mrb_free(mrb, pins);
+  mrb_free(mrb, pages);
+  return moved;
+}
+
 int
 mrb_gc_arena_save(mrb_state *mrb)
 {
@@ -1059,6 +1625,9 @@ mrb_gc_arena_restore(mrb_state *mrb, int idx)
   }
 #endif
   mrb->arena_idx = idx;
+#ifdef MRB_GC_ARENA_DEBUG
+  if (idx < MRB_GC_ARENA_WARN) mrb->arena_warn = MRB_GC_ARENA_WARN;
+#endif
 }
 
 /*
@@ -1120,6 +1689,26 @@ gc_start(mrb_state *mrb, mrb_value obj)
   return mrb_nil_value();
 }
 
+/*
+ *  call-seq:
+ *     GC.compact                   -> fixnum or nil
+ *
+ *  Runs a full garbage collection, then moves objects out of sparsely
+ *  populated heap pages and releases the pages left empty.  Returns
+ *  the number of objects moved, or nil when called from a block that a
+ *  C function is running (nothing can be moved then).
+ *
+ */
+
+static mrb_value
+gc_compact(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int moved = mrb_gc_compact(mrb);
+
+  if (moved < 0) return mrb_nil_value();
+  return mrb_fixnum_value(moved);
+}
+
 /*
  *  call-seq:
  *     GC.enable    -> true or false
@@ -1231,6 +1820,80 @@ gc_step_ratio_set(mrb_state *mrb, mrb_value obj)
   return mrb_nil_value();
 }
 
+/*
+ *  call-seq:
+ *     GC.max_pause_us    -> fixnum
+ *
+ *  Returns the time budget of one Incremental GC step in microseconds.
+ *  0 (the default) means steps are sized by GC.step_ratio instead.
+ *
+ */
+
+static mrb_value
+gc_max_pause_us_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_max_pause_us);
+}
+
+/*
+ *  call-seq:
+ *     GC.max_pause_us = fixnum   -> nil
+ *
+ *  Makes each Incremental GC step stop once it has run for about the
+ *  given number of microseconds; large Arrays and Hashes are then
+ *  marked in chunks.  The root scan and the final mark still run
+ *  atomically, and minor GCs of the generational mode run to the end.
+ *
+ */
+
+static mrb_value
+gc_max_pause_us_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int us;
+
+  mrb_get_args(mrb, "i", &us);
+  if (us < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative pause time");
+  }
+  mrb->gc_max_pause_us = (uint32_t)us;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.arena_high_water    -> fixnum
+ *
+ *  Returns the largest number of objects the GC arena has held at
+ *  once.  A value far above the arena size points at C code that
+ *  allocates in a loop without restoring the arena.
+ *
+ */
+
+static mrb_value
+gc_arena_high_water(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->arena_max);
+}
+
+/*
+ *  call-seq:
+ *     GC.reset_arena_high_water    -> fixnum
+ *
+ *  Restarts GC.arena_high_water from the current arena size and
+ *  returns the previous value, so the arena use of a piece of code can
+ *  be measured on its own.
+ *
+ */
+
+static mrb_value
+gc_reset_arena_high_water(mrb_state *mrb, mrb_value obj)
+{
+  int max = mrb->arena_max;
+
+  mrb->arena_max = mrb->arena_idx;
+  return mrb_fixnum_value(max);
+}
+
 static void
 change_gen_gc_mode(mrb_state *mrb, mrb_int enable)
 {
@@ -1290,7 +1953,7 @@ mrb_objspace_each_objects(mrb_state *mrb, each_object_callback* callback, void *
         RVALUE *p, *pend;
 
         p = page->objects;
-        pend = p + MRB_HEAP_PAGE_SIZE;
+        pend = p + page->used;
         for (;p < pend; p++) {
            (*callback)(mrb, &p->as.basic, data);
         }
@@ -1313,12 +1976,17 @@ mrb_init_gc(mrb_state *mrb)
   gc = mrb_define_module(mrb, "GC");
 
   mrb_define_class_method(mrb, gc, "start", gc_start, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "compact", gc_compact, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "enable", gc_enable, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "disable", gc_disable, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "interval_ratio", gc_interval_ratio_get, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "interval_ratio=", gc_interval_ratio_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "step_ratio", gc_step_ratio_get, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "step_ratio=", gc_step_ratio_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "max_pause_us", gc_max_pause_us_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "max_pause_us=", gc_max_pause_us_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "arena_high_water", gc_arena_high_water, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "reset_arena_high_water", gc_reset_arena_high_water, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "generational_mode=", gc_generational_mode_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "generational_mode", gc_generational_mode_get, MRB_ARGS_NONE());
 #ifdef GC_TEST
@@ -1501,7 +2169,7 @@ test_incremental_gc(void)
   page = mrb->heaps;
   while (page) {
     RVALUE *p = page->objects;
-    RVALUE *e = p + MRB_HEAP_PAGE_SIZE;
+    RVALUE *e = p + page->used;
     while (p<e) {
       if (is_black(&p->as.basic)) {
         live++;
@@ -1511,8 +2179,8 @@ test_incremental_gc(void)
       }
       p++;
     }
+    total += page->used;
     page = page->next;
-    total += MRB_HEAP_PAGE_SIZE;
   }
 
   mrb_assert(mrb->gray_list == NULL);
@@ -1543,7 +2211,9 @@ test_incremental_gc(void)
   mrb_assert(is_minor_gc(mrb));
   mrb_assert(mrb->majorgc_old_threshold > 0);
   mrb->majorgc_old_threshold = 0;
-  mrb_incremental_gc(mrb);
+  do {
+    mrb_incremental_gc(mrb);
+  } while (mrb->gc_state != GC_STATE_NONE);
   mrb_assert(mrb->gc_full == TRUE);
   mrb_assert(mrb->gc_state == GC_STATE_NONE);
 
@@ -7,6 +7,7 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/gc.h"
 #include "mruby/hash.h"
 #include "mruby/khash.h"
 #include "mruby/string.h"
@@ -18,7 +19,26 @@ mrb_hash_ht_hash_func(mrb_state *mrb, mrb_value key)
   khint_t h = (khint_t)mrb_type(key) << 24;
   mrb_value h2;
 
-  h2 = mrb_funcall(mrb, key, "hash", 0, 0);
+  switch (mrb_type(key)) {
+  case MRB_TT_FIXNUM:
+    /* immediates hash by value, without a method call */
+    return h ^ (khint_t)mrb_fixnum(key);
+  case MRB_TT_SYMBOL:
+    return h ^ (khint_t)mrb_symbol(key);
+  case MRB_TT_FALSE:
+    return h ^ (khint_t)mrb_nil_p(key);
+  case MRB_TT_TRUE:
+    return h;
+  case MRB_TT_STRING:
+    if (mrb_str_ptr(key)->c == mrb->string_class) {
+      /* plain String keys skip the method call; the hash is cached */
+      return h ^ (khint_t)mrb_str_hash(mrb, key);
+    }
+    break;
+  default:
+    break;
+  }
+  h2 = mrb_funcall_id(mrb, key, mrb->sym_hash, 0);
   h ^= h2.value.i;
   return h;
 }
@@ -26,6 +46,22 @@ mrb_hash_ht_hash_func(mrb_state *mrb, mrb_value key)
 static inline khint_t
 mrb_hash_ht_hash_equal(mrb_state *mrb, mrb_value a, mrb_value b)
 {
+  switch (mrb_type(a)) {
+  case MRB_TT_FIXNUM: case MRB_TT_SYMBOL:
+  case MRB_TT_FALSE: case MRB_TT_TRUE:
+    /* eql? on these is identity */
+    return mrb_obj_eq(mrb, a, b);
+  case MRB_TT_STRING:
+    if (mrb_string_p(b) &&
+        mrb_str_ptr(a)->c == mrb->string_class &&
+        mrb_str_ptr(b)->c == mrb->string_class) {
+      return RSTRING_LEN(a) == RSTRING_LEN(b) &&
+        memcmp(RSTRING_PTR(a), RSTRING_PTR(b), RSTRING_LEN(a)) == 0;
+    }
+    break;
+  default:
+    break;
+  }
   return mrb_eql(mrb, a, b);
 }
 
@@ -37,7 +73,7 @@ static void mrb_hash_modify(mrb_state *mrb, mrb_value hash);
 static inline mrb_value
 mrb_hash_ht_key(mrb_state *mrb, mrb_value key)
 {
-  if (mrb_string_p(key))
+  if (mrb_string_p(key) && !MRB_FROZEN_P(mrb_str_ptr(key)))
     return mrb_str_dup(mrb, key);
   else
     return key;
@@ -63,6 +99,40 @@ mrb_gc_mark_hash(mrb_state *mrb, struct RHash *hash)
   }
 }
 
+/* marks buckets [from, to); returns the number of marked entries */
+size_t
+mrb_gc_mark_hash_range(mrb_state *mrb, struct RHash *hash, size_t from, size_t to)
+{
+  khiter_t k;
+  khash_t(ht) *h = hash->ht;
+  size_t n = 0;
+
+  if (!h) return 0;
+  if (to > kh_end(h)) to = kh_end(h);
+  for (k = from; k < to; k++) {
+    if (kh_exist(h, k)) {
+      mrb_gc_mark_value(mrb, kh_key(h, k));
+      mrb_gc_mark_value(mrb, kh_value(h, k));
+      n++;
+    }
+  }
+  return n;
+}
+
+/* number of buckets; *buf is set to the bucket storage */
+size_t
+mrb_gc_hash_buckets(mrb_state *mrb, struct RHash *hash, void **buf)
+{
+  khash_t(ht) *h = hash->ht;
+
+  if (!h) {
+    if (buf) *buf = NULL;
+    return 0;
+  }
+  if (buf) *buf = h->keys;
+  return kh_end(h);
+}
+
 size_t
 mrb_gc_mark_hash_size(mrb_state *mrb, struct RHash *hash)
 {
@@ -76,6 +146,52 @@ mrb_gc_free_hash(mrb_state *mrb, struct RHash *hash)
   if (hash->ht) kh_destroy(ht, mrb, hash->ht);
 }
 
+/* keys other than Strings may be hashed by their address */
+void
+mrb_gc_pin_hash_keys(mrb_state *mrb, struct RHash *hash)
+{
+  khash_t(ht) *h = hash->ht;
+  khiter_t k;
+
+  if (!h) return;
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      mrb_value key = kh_key(h, k);
+
+      if (!mrb_special_const_p(key) && !mrb_string_p(key)) {
+        mrb_basic_ptr(key)->flags |= MRB_FLAG_GC_PINNED;
+      }
+    }
+  }
+}
+
+void
+mrb_gc_update_hash(mrb_state *mrb, struct RHash *hash)
+{
+  khash_t(ht) *h = hash->ht;
+  khiter_t k;
+
+  if (!h) return;
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      mrb_gc_update_value(mrb, &kh_key(h, k));
+      mrb_gc_update_value(mrb, &kh_value(h, k));
+    }
+  }
+}
+
+
+/* buckets to hold n entries without growing (kh_put grows at 3/4) */
+static khint_t
+ht_size_for(mrb_int n)
+{
+  khint_t sz = KHASH_MIN_SIZE;
+
+  while (UPPER_BOUND(sz) < (khint_t)n) {
+    sz <<= 1;
+  }
+  return sz;
+}
 
 mrb_value
 mrb_hash_new_capa(mrb_state *mrb, int capa)
@@ -83,14 +199,50 @@ mrb_hash_new_capa(mrb_state *mrb, int capa)
   struct RHash *h;
 
   h = (struct RHash*)mrb_obj_alloc(mrb, MRB_TT_HASH, mrb->hash_class);
-  h->ht = kh_init(ht, mrb);
   if (capa > 0) {
-    kh_resize(ht, mrb, h->ht, capa);
+    h->ht = kh_init_size(ht, mrb, ht_size_for(capa));
+  }
+  else {
+    h->ht = kh_init(ht, mrb);
   }
   h->iv = 0;
   return mrb_obj_value(h);
 }
 
+/*
+ * Builds a hash from n key/value pairs laid out as kv[0], kv[1], ...
+ * (OP_HASH's register window).  The table is sized once, and one
+ * write barrier on the new hash covers all of its entries.
+ */
+mrb_value
+mrb_hash_new_from_values(mrb_state *mrb, mrb_int n, const mrb_value *kv)
+{
+  mrb_value hash = mrb_hash_new_capa(mrb, (int)n);
+  khash_t(ht) *h = RHASH_TBL(hash);
+  int ai = mrb_gc_arena_save(mrb);
+  khiter_t k;
+  mrb_int i;
+
+  for (i = 0; i < n; i++) {
+    mrb_value key = kv[i*2];
+
+    if (mrb_string_p(key) && !MRB_FROZEN_P(mrb_str_ptr(key))) {
+      /* copy the key only when it is new */
+      k = kh_get(ht, mrb, h, key);
+      if (k == kh_end(h)) {
+        k = kh_put(ht, mrb, h, KEY(key));
+      }
+    }
+    else {
+      k = kh_put(ht, mrb, h, key);
+    }
+    kh_value(h, k) = kv[i*2+1];
+  }
+  mrb_write_barrier(mrb, (struct RBasic*)RHASH(hash));
+  mrb_gc_arena_restore(mrb, ai);
+  return hash;
+}
+
 mrb_value
 mrb_hash_new(mrb_state *mrb)
 {
@@ -147,11 +299,12 @@ mrb_hash_set(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value val) /* mr
     /* expand */
     int ai = mrb_gc_arena_save(mrb);
     k = kh_put(ht, mrb, h, KEY(key));
+    mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), kh_key(h, k));
     mrb_gc_arena_restore(mrb, ai);
   }
 
   kh_value(h, k) = val;
-  mrb_write_barrier(mrb, (struct RBasic*)RHASH(hash));
+  mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), val);
   return;
 }
 
@@ -351,6 +351,7 @@ mrb_obj_clone(mrb_state *mrb, mrb_value self)
   p->c = mrb_singleton_class_clone(mrb, self);
   clone = mrb_obj_value(p);
   init_copy(mrb, clone, self);
+  p->flags |= mrb_obj_ptr(self)->flags & MRB_FLAG_FROZEN;
 
   return clone;
 }
@@ -408,6 +409,22 @@ mrb_obj_extend(mrb_state *mrb, int argc, mrb_value *argv, mrb_value obj)
   return obj;
 }
 
+/*
+ *  call-seq:
+ *     obj.frozen?    -> true or false
+ *
+ *  Returns the freeze status of <i>obj</i>.  Immediate values
+ *  (nil, true, false, Fixnum, Symbol) are always frozen.
+ */
+static mrb_value
+mrb_obj_frozen(mrb_state *mrb, mrb_value self)
+{
+  if (mrb_special_const_p(self)) {
+    return mrb_true_value();
+  }
+  return mrb_bool_value(MRB_FROZEN_P(mrb_basic_ptr(self)) != 0);
+}
+
 /* 15.3.1.3.13 */
 /*
  *  call-seq:
@@ -514,6 +531,10 @@ mrb_obj_instance_eval(mrb_state *mrb, mrb_value self)
     c = 0;
     break;
   default:
+    if (MRB_FROZEN_P(mrb_basic_ptr(self))) {
+      c = 0;
+      break;
+    }
     cv = mrb_singleton_class(mrb, self);
     c = mrb_class_ptr(cv);
     break;
@@ -574,7 +595,7 @@ get_valid_iv_sym(mrb_state *mrb, mrb_value iv_name)
   mrb_assert(mrb_symbol_p(iv_name) || mrb_string_p(iv_name));
 
   if (mrb_string_p(iv_name)) {
-    iv_name_id = mrb_intern_cstr(mrb, RSTRING_PTR(iv_name));
+    iv_name_id = mrb_intern(mrb, RSTRING_PTR(iv_name), RSTRING_LEN(iv_name));
     valid_iv_name(mrb, iv_name_id, RSTRING_PTR(iv_name), RSTRING_LEN(iv_name));
   }
   else {
@@ -1124,6 +1145,7 @@ mrb_init_kernel(mrb_state *mrb)
   mrb_define_method(mrb, krn, "eql?",                       mrb_obj_equal_m,                 MRB_ARGS_REQ(1));    /* 15.3.1.3.10 */
   mrb_define_method(mrb, krn, "equal?",                     mrb_obj_equal_m,                 MRB_ARGS_REQ(1));    /* 15.3.1.3.11 */
   mrb_define_method(mrb, krn, "extend",                     mrb_obj_extend_m,                MRB_ARGS_ANY());     /* 15.3.1.3.13 */
+  mrb_define_method(mrb, krn, "frozen?",                    mrb_obj_frozen,                  MRB_ARGS_NONE());
   mrb_define_method(mrb, krn, "global_variables",           mrb_f_global_variables,          MRB_ARGS_NONE());    /* 15.3.1.3.14 */
   mrb_define_method(mrb, krn, "hash",                       mrb_obj_hash,                    MRB_ARGS_NONE());    /* 15.3.1.3.15 */
   mrb_define_method(mrb, krn, "initialize_copy",            mrb_obj_init_copy,               MRB_ARGS_REQ(1));    /* 15.3.1.3.16 */
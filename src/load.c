@@ -89,27 +89,34 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, uint32_t *len, mrb_bool a
 
     for (i = 0; i < plen; i++) {
       mrb_value s;
+      const char *data;
 
       tt = *src++; //pool TT
       pool_data_len = bin_to_uint16(src); //pool data length
       src += sizeof(uint16_t);
-      if (alloc) {
-        s = mrb_str_new(mrb, (char *)src, pool_data_len);
-      }
-      else {
-        s = mrb_str_new_static(mrb, (char *)src, pool_data_len);
-      }
+      data = (const char *)src;
       src += pool_data_len;
       switch (tt) { //pool data
       case IREP_TT_FIXNUM:
-        irep->pool[i] = mrb_str_to_inum(mrb, s, 10, FALSE);
+        /* numbers are read in place, without a temporary string */
+        irep->pool[i] = mrb_str_len_to_inum(mrb, data, pool_data_len, 10, FALSE);
         break;
 
       case IREP_TT_FLOAT:
-        irep->pool[i] = mrb_float_pool(mrb, mrb_str_to_dbl(mrb, s, FALSE));
+        irep->pool[i] = mrb_float_pool(mrb, mrb_str_len_to_dbl(mrb, data, pool_data_len, FALSE));
         break;
 
       case IREP_TT_STRING:
+      case IREP_TT_FSTRING:
+        if (alloc) {
+          s = mrb_str_new(mrb, data, pool_data_len);
+        }
+        else {
+          s = mrb_str_new_static(mrb, data, pool_data_len);
+        }
+        if (tt == IREP_TT_FSTRING) {
+          MRB_SET_FROZEN_FLAG(mrb_str_ptr(s));
+        }
         irep->pool[i] = mrb_str_pool(mrb, s);
         break;
 
@@ -8,6 +8,7 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mruby.h"
 #include "mruby/array.h"
@@ -102,104 +103,102 @@ num_div(mrb_state *mrb, mrb_value x)
  *  representation.
  */
 
-mrb_value
-mrb_flo_to_str(mrb_state *mrb, mrb_value flo, int max_digit)
+/*
+ * Writes n in Float#to_s style to buf, which must hold
+ * MRB_NUM_BUF_SIZE bytes, and returns the length.  The digits are the
+ * shortest ones that read back as n; like CRuby, magnitudes from
+ * 1e-4 up to (but not including) 1e15 print in fixed notation and the
+ * rest as d.ddde+XX.
+ */
+size_t
+mrb_flo_to_buf(mrb_float n, char *buf)
 {
-  mrb_value result;
-  mrb_float n;
+  char digits[20];
+  char *c = buf;
+  int len, decpt, i;
 
-  if (max_digit > 40) {
-    mrb_raise(mrb, E_RANGE_ERROR, "Too large max_digit.");
+  if (isnan(n)) {
+    memcpy(buf, "NaN", 3);
+    return 3;
   }
-  else if (!mrb_float_p(flo)) {
-    mrb_raise(mrb, E_TYPE_ERROR, "non float value");
+  if (signbit(n)) {
+    *(c++) = '-';
+    n = -n;
   }
-
-  n = mrb_float(flo);
-
-  if (isnan(n)) {
-    result = mrb_str_new(mrb, "NaN", 3);
+  if (isinf(n)) {
+    memcpy(c, "inf", 3);
+    return c + 3 - buf;
+  }
+  if (n == 0) {
+    memcpy(c, "0.0", 3);
+    return c + 3 - buf;
   }
-  else if (isinf(n)) {
-    if (n < 0) {
-      result = mrb_str_new(mrb, "-inf", 4);
+
+  len = mrb_flo_shortest(n, digits, &decpt);
+  if (decpt > 0 && decpt <= 15) {
+    /* ddd.ddd, ddd00.0 */
+    if (len <= decpt) {
+      memcpy(c, digits, len);
+      c += len;
+      for (i = len; i < decpt; i++) *(c++) = '0';
+      *(c++) = '.';
+      *(c++) = '0';
     }
     else {
-      result = mrb_str_new(mrb, "inf", 3);
+      memcpy(c, digits, decpt);
+      c += decpt;
+      *(c++) = '.';
+      memcpy(c, digits + decpt, len - decpt);
+      c += len - decpt;
     }
   }
+  else if (decpt > -4 && decpt <= 0) {
+    /* 0.000ddd */
+    *(c++) = '0';
+    *(c++) = '.';
+    for (i = decpt; i < 0; i++) *(c++) = '0';
+    memcpy(c, digits, len);
+    c += len;
+  }
   else {
-    int digit;
-    int m;
-    int exp;
-    int e = 0;
-    char s[48];
-    char *c = &s[0];
-
-    if (n < 0) {
-      n = -n;
-      *(c++) = '-';
-    }
+    int e = decpt - 1;
 
-    exp = (int)log10(n);
-
-    if ((exp < 0 ? -exp : exp) > max_digit) {
-      /* exponent representation */
-      e = 1;
-      m = exp;
-      if (m < 0) {
-        m -= 1;
-      }
-      n = n / pow(10.0, m);
-      m = 0;
+    *(c++) = digits[0];
+    *(c++) = '.';
+    if (len > 1) {
+      memcpy(c, digits + 1, len - 1);
+      c += len - 1;
     }
     else {
-      /* un-exponent (normal) representation */
-      m = exp;
-      if (m < 0) {
-        m = 0;
-      }
+      *(c++) = '0';
     }
-
-    /* puts digits */
-    while (max_digit >= 0) {
-      mrb_float weight = pow(10.0, m);
-      digit = (int)floor(n / weight + FLT_EPSILON);
-      *(c++) = '0' + digit;
-      n -= (digit * weight);
-      max_digit--;
-      if (m-- == 0) {
-        *(c++) = '.';
-      }
-      else if (m < -1 && n < FLT_EPSILON) {
-        break;
-      }
+    *(c++) = 'e';
+    if (e < 0) {
+      *(c++) = '-';
+      e = -e;
     }
-
-    if (e) {
-      *(c++) = 'e';
-      if (exp > 0) {
-        *(c++) = '+';
-      }
-      else {
-        *(c++) = '-';
-        exp = -exp;
-      }
-
-      if (exp >= 100) {
-        mrb_raise(mrb, E_RANGE_ERROR, "Too large exponent.");
-      }
-
-      *(c++) = '0' + exp / 10;
-      *(c++) = '0' + exp % 10;
+    else {
+      *(c++) = '+';
+    }
+    if (e >= 100) {
+      *(c++) = '0' + e / 100;
+      e %= 100;
     }
+    *(c++) = '0' + e / 10;
+    *(c++) = '0' + e % 10;
+  }
+  return c - buf;
+}
 
-    *c = '\0';
+mrb_value
+mrb_flo_to_str(mrb_state *mrb, mrb_value flo)
+{
+  char buf[MRB_NUM_BUF_SIZE];
 
-    result = mrb_str_new(mrb, &s[0], c - &s[0]);
+  if (!mrb_float_p(flo)) {
+    mrb_raise(mrb, E_TYPE_ERROR, "non float value");
   }
-
-  return result;
+  return mrb_str_new(mrb, buf, mrb_flo_to_buf(mrb_float(flo), buf));
 }
 
 /* 15.2.9.3.16(x) */
@@ -216,11 +215,7 @@ mrb_flo_to_str(mrb_state *mrb, mrb_value flo, int max_digit)
 static mrb_value
 flo_to_s(mrb_state *mrb, mrb_value flt)
 {
-#ifdef MRB_USE_FLOAT
-  return mrb_flo_to_str(mrb, flt, 7);
-#else
-  return mrb_flo_to_str(mrb, flt, 14);
-#endif
+  return mrb_flo_to_str(mrb, flt);
 }
 
 /* 15.2.9.3.2  */
@@ -1160,33 +1155,73 @@ fix_minus(mrb_state *mrb, mrb_value self)
 }
 
 
-mrb_value
-mrb_fixnum_to_str(mrb_state *mrb, mrb_value x, int base)
-{
-  char buf[sizeof(mrb_int)*CHAR_BIT+1];
-  char *b = buf + sizeof buf;
-  mrb_int val = mrb_fixnum(x);
+#ifdef MRB_INT64
+typedef uint64_t fix_uint;
+#else
+typedef uint32_t fix_uint;
+#endif
 
-  if (base < 2 || 36 < base) {
-    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid radix %S", mrb_fixnum_value(base));
-  }
+/* "00" to "99" */
+static const char digit_pairs[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
 
-  if (val == 0) {
-    *--b = '0';
+/*
+ * Writes val in the given base to buf, which must hold
+ * MRB_NUM_BUF_SIZE bytes, and returns the length.  Decimal takes
+ * two digits per division from digit_pairs.
+ */
+size_t
+mrb_fixnum_to_buf(mrb_int val, int base, char *buf)
+{
+  char tmp[sizeof(mrb_int)*CHAR_BIT+1];
+  char *b = tmp + sizeof tmp;
+  fix_uint u = (val < 0) ? (fix_uint)0 - (fix_uint)val : (fix_uint)val;
+  size_t len;
+
+  if (base == 10) {
+    while (u >= 100) {
+      const char *d = digit_pairs + (u % 100) * 2;
+
+      u /= 100;
+      *--b = d[1];
+      *--b = d[0];
+    }
+    if (u >= 10) {
+      *--b = digit_pairs[u * 2 + 1];
+      *--b = digit_pairs[u * 2];
+    }
+    else {
+      *--b = (char)('0' + u);
+    }
   }
-  else if (val < 0) {
+  else {
     do {
-      *--b = mrb_digitmap[-(val % base)];
-    } while (val /= base);
+      *--b = mrb_digitmap[u % base];
+    } while (u /= base);
+  }
+  if (val < 0) {
     *--b = '-';
   }
-  else {
-    do {
-      *--b = mrb_digitmap[(int)(val % base)];
-    } while (val /= base);
+
+  len = tmp + sizeof(tmp) - b;
+  memcpy(buf, b, len);
+  return len;
+}
+
+mrb_value
+mrb_fixnum_to_str(mrb_state *mrb, mrb_value x, int base)
+{
+  char buf[MRB_NUM_BUF_SIZE];
+
+  if (base < 2 || 36 < base) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid radix %S", mrb_fixnum_value(base));
   }
 
-  return mrb_str_new(mrb, b, buf + sizeof(buf) - b);
+  return mrb_str_new(mrb, buf, mrb_fixnum_to_buf(mrb_fixnum(x), base, buf));
 }
 
 /* 15.2.8.3.25 */
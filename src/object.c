@@ -46,7 +46,7 @@ mrb_equal(mrb_state *mrb, mrb_value obj1, mrb_value obj2)
   mrb_value result;
 
   if (mrb_obj_eq(mrb, obj1, obj2)) return TRUE;
-  result = mrb_funcall(mrb, obj1, "==", 1, obj2);
+  result = mrb_funcall_id(mrb, obj1, mrb->sym_eq, 1, obj2);
   if (mrb_test(result)) return TRUE;
   return FALSE;
 }
@@ -598,5 +598,5 @@ mrb_bool
 mrb_eql(mrb_state *mrb, mrb_value obj1, mrb_value obj2)
 {
   if (mrb_obj_eq(mrb, obj1, obj2)) return TRUE;
-  return mrb_test(mrb_funcall(mrb, obj1, "eql?", 1, obj2));
+  return mrb_test(mrb_funcall_id(mrb, obj1, mrb->sym_eql, 1, obj2));
 }
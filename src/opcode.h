@@ -9,6 +9,7 @@
 
 #define MAXARG_Bx        (0xffff)
 #define MAXARG_sBx       (MAXARG_Bx>>1)         /* `sBx' is signed */
+#define MAXARG_C         (0x7f)
 
 /* instructions: packed 32 bit      */
 /* -------------------------------  */
@@ -95,7 +96,7 @@ enum {
   OP_SUPER,/*     A B C   R(A) := super(R(A+1),... ,R(A+C-1))             */
   OP_ARGARY,/*    A Bx    R(A) := argument array (16=6:1:5:4)             */
   OP_ENTER,/*     Ax      arg setup according to flags (24=5:5:1:5:5:1:1) */
-  OP_KARG,/*      A B C   R(A) := kdict[mSym(B)]; if C kdict.rm(mSym(B))  */
+  OP_KARG,/*      A B C   R(A) unset: raise(C=0) or skip next OP_JMP (C=1)*/
   OP_KDICT,/*     A C     R(A) := kdict                                   */
 
   OP_RETURN,/*    A B     return R(A) (B=normal,in-block return/break)    */
@@ -140,8 +141,8 @@ enum {
   OP_STOP,/*              stop VM                                         */
   OP_ERR,/*       Bx      raise RuntimeError with message Lit(Bx)         */
 
-  OP_RSVD1,/*             reserved instruction #1                         */
-  OP_RSVD2,/*             reserved instruction #2                         */
+  OP_STRCATN,/*   A B C   R(A) := str_new(R(B),R(B+1)..R(B+C-1))          */
+  OP_SENDK,/*     A B C   R(A) := call(R(A),mSym(B),R(A+1),...,kw:...,&blk)*/
   OP_RSVD3,/*             reserved instruction #3                         */
   OP_RSVD4,/*             reserved instruction #4                         */
   OP_RSVD5,/*             reserved instruction #5                         */
@@ -153,6 +154,13 @@ enum {
 #define OP_L_LAMBDA  (OP_L_STRICT|OP_L_CAPTURE)
 #define OP_L_BLOCK   OP_L_CAPTURE
 
+/* OP_SENDK: C is (keywords<<4|arguments); keyword names follow mSym(B) */
+#define SENDK_C(n,k)      (((k)<<4)|(n))
+#define SENDK_ARGC(c)     ((c)&0xf)
+#define SENDK_KWC(c)      ((c)>>4)
+#define SENDK_MAXARGS     15
+#define SENDK_MAXKW       7
+
 #define OP_R_NORMAL 0
 #define OP_R_BREAK  1
 #define OP_R_RETURN 2
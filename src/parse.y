@@ -185,6 +185,18 @@ append_gen(parser_state *p, node *a, node *b)
 #define append(a,b) append_gen(p,(a),(b))
 #define push(a,b) append_gen(p,(a),list1(b))
 
+static int
+length(node *a)
+{
+  int n = 0;
+
+  while (a) {
+    n++;
+    a = a->cdr;
+  }
+  return n;
+}
+
 static char*
 parser_strndup(parser_state *p, const char *s, size_t len)
 {
@@ -625,23 +637,62 @@ new_arg(parser_state *p, mrb_sym sym)
   return cons((node*)NODE_ARG, nsym(sym));
 }
 
-// (m o r m2 b)
+// (m o r m2 . tail)
 // m: (a b c)
 // o: ((a . e1) (b . e2))
 // r: a
 // m2: (a b c)
-// b: a
+// tail: see new_args_tail
 static node*
-new_args(parser_state *p, node *m, node *opt, mrb_sym rest, node *m2, mrb_sym blk)
+new_args(parser_state *p, node *m, node *opt, mrb_sym rest, node *m2, node *tail)
 {
   node *n;
 
-  n = cons(m2, nsym(blk));
+  n = cons(m2, tail);
   n = cons(nsym(rest), n);
   n = cons(opt, n);
   return cons(m, n);
 }
 
+// ((k . kr) . b)
+// k: ((a . e1) (b . 0))  (0: required keyword)
+// kr: a
+// b: a
+static node*
+new_args_tail(parser_state *p, node *kws, mrb_sym kwrest, mrb_sym blk)
+{
+  node *k = 0;
+
+  if (kws || kwrest) {
+    /* the block local (added last) goes in front of the keyword
+       locals, so the block register stays next to the arguments */
+    int nk = (kws ? length(kws) : 0) + (kwrest ? 1 : 0);
+    int n = length(p->locals->car) - nk - 1;
+    node *prev = 0, *kw = p->locals->car, *b, *t;
+
+    while (n--) {
+      prev = kw;
+      kw = kw->cdr;
+    }
+    for (t = kw; t->cdr->cdr; t = t->cdr)
+      ;
+    b = t->cdr;
+    t->cdr = 0;
+    b->cdr = kw;
+    if (prev) prev->cdr = b;
+    else p->locals->car = b;
+    k = cons(kws, nsym(kwrest));
+  }
+  return cons(k, nsym(blk));
+}
+
+// (a . e)
+static node*
+new_kw_arg(parser_state *p, mrb_sym kw, node *def)
+{
+  return cons(nsym(kw), def);
+}
+
 // (:block_arg . a)
 static node*
 new_block_arg(parser_state *p, node *a)
@@ -1063,15 +1114,17 @@ heredoc_end(parser_state *p)
 %type <nd> assoc_list assocs assoc undef_list backref for_var
 %type <nd> block_param opt_block_param block_param_def f_opt
 %type <nd> bv_decls opt_bv_decl bvar f_larglist lambda_body
+%type <nd> args_tail opt_args_tail f_kwarg f_kw
 %type <nd> brace_block cmd_brace_block do_block lhs none f_bad_arg
 %type <nd> mlhs mlhs_list mlhs_post mlhs_basic mlhs_item mlhs_node mlhs_inner
 %type <id> fsym sym basic_symbol operation operation2 operation3
-%type <id> cname fname op f_rest_arg f_block_arg opt_f_block_arg f_norm_arg
+%type <id> cname fname op f_rest_arg f_block_arg opt_f_block_arg f_norm_arg f_kwrest
 %type <nd> heredoc words symbols
 
 %token tUPLUS             /* unary+ */
 %token tUMINUS            /* unary- */
 %token tPOW               /* ** */
+%token tDSTAR             /* ** argument prefix */
 %token tCMP               /* <=> */
 %token tEQ                /* == */
 %token tEQQ               /* === */
@@ -2336,63 +2389,63 @@ f_margs		: f_marg_list
 
 block_param	: f_arg ',' f_block_optarg ',' f_rest_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, $3, $5, 0, $6);
+		      $$ = new_args(p, $1, $3, $5, 0, new_args_tail(p, 0, 0, $6));
 		    }
 		| f_arg ',' f_block_optarg ',' f_rest_arg ',' f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, $3, $5, $7, $8);
+		      $$ = new_args(p, $1, $3, $5, $7, new_args_tail(p, 0, 0, $8));
 		    }
 		| f_arg ',' f_block_optarg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, $3, 0, 0, $4);
+		      $$ = new_args(p, $1, $3, 0, 0, new_args_tail(p, 0, 0, $4));
 		    }
 		| f_arg ',' f_block_optarg ',' f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, $3, 0, $5, $6);
+		      $$ = new_args(p, $1, $3, 0, $5, new_args_tail(p, 0, 0, $6));
 		    }
 		| f_arg ',' f_rest_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, 0, $3, 0, $4);
+		      $$ = new_args(p, $1, 0, $3, 0, new_args_tail(p, 0, 0, $4));
 		    }
 		| f_arg ','
 		    {
-		      $$ = new_args(p, $1, 0, 1, 0, 0);
+		      $$ = new_args(p, $1, 0, 1, 0, new_args_tail(p, 0, 0, 0));
 		    }
 		| f_arg ',' f_rest_arg ',' f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, 0, $3, $5, $6);
+		      $$ = new_args(p, $1, 0, $3, $5, new_args_tail(p, 0, 0, $6));
 		    }
 		| f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, $1, 0, 0, 0, $2);
+		      $$ = new_args(p, $1, 0, 0, 0, new_args_tail(p, 0, 0, $2));
 		    }
 		| f_block_optarg ',' f_rest_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, 0, $1, $3, 0, $4);
+		      $$ = new_args(p, 0, $1, $3, 0, new_args_tail(p, 0, 0, $4));
 		    }
 		| f_block_optarg ',' f_rest_arg ',' f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, 0, $1, $3, $5, $6);
+		      $$ = new_args(p, 0, $1, $3, $5, new_args_tail(p, 0, 0, $6));
 		    }
 		| f_block_optarg opt_f_block_arg
 		    {
-		      $$ = new_args(p, 0, $1, 0, 0, $2);
+		      $$ = new_args(p, 0, $1, 0, 0, new_args_tail(p, 0, 0, $2));
 		    }
 		| f_block_optarg ',' f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, 0, $1, 0, $3, $4);
+		      $$ = new_args(p, 0, $1, 0, $3, new_args_tail(p, 0, 0, $4));
 		    }
 		| f_rest_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, 0, 0, $1, 0, $2);
+		      $$ = new_args(p, 0, 0, $1, 0, new_args_tail(p, 0, 0, $2));
 		    }
 		| f_rest_arg ',' f_arg opt_f_block_arg
 		    {
-		      $$ = new_args(p, 0, 0, $1, $3, $4);
+		      $$ = new_args(p, 0, 0, $1, $3, new_args_tail(p, 0, 0, $4));
 		    }
 		| f_block_arg
 		    {
-		      $$ = new_args(p, 0, 0, 0, 0, $1);
+		      $$ = new_args(p, 0, 0, 0, 0, new_args_tail(p, 0, 0, $1));
 		    }
 		;
 
@@ -2896,66 +2949,95 @@ f_arglist	: '(' f_args rparen
 		    }
 		;
 
-f_args		: f_arg ',' f_optarg ',' f_rest_arg opt_f_block_arg
+args_tail	: f_kwarg ',' f_kwrest opt_f_block_arg
+		    {
+		      $$ = new_args_tail(p, $1, $3, $4);
+		    }
+		| f_kwarg opt_f_block_arg
+		    {
+		      $$ = new_args_tail(p, $1, 0, $2);
+		    }
+		| f_kwrest opt_f_block_arg
+		    {
+		      $$ = new_args_tail(p, 0, $1, $2);
+		    }
+		| f_block_arg
+		    {
+		      $$ = new_args_tail(p, 0, 0, $1);
+		    }
+		;
+
+opt_args_tail	: ',' args_tail
+		    {
+		      $$ = $2;
+		    }
+		| /* none */
+		    {
+		      local_add_f(p, 0);
+		      $$ = new_args_tail(p, 0, 0, 0);
+		    }
+		;
+
+f_args		: f_arg ',' f_optarg ',' f_rest_arg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, $3, $5, 0, $6);
 		    }
-		| f_arg ',' f_optarg ',' f_rest_arg ',' f_arg opt_f_block_arg
+		| f_arg ',' f_optarg ',' f_rest_arg ',' f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, $3, $5, $7, $8);
 		    }
-		| f_arg ',' f_optarg opt_f_block_arg
+		| f_arg ',' f_optarg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, $3, 0, 0, $4);
 		    }
-		| f_arg ',' f_optarg ',' f_arg opt_f_block_arg
+		| f_arg ',' f_optarg ',' f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, $3, 0, $5, $6);
 		    }
-		| f_arg ',' f_rest_arg opt_f_block_arg
+		| f_arg ',' f_rest_arg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, 0, $3, 0, $4);
 		    }
-		| f_arg ',' f_rest_arg ',' f_arg opt_f_block_arg
+		| f_arg ',' f_rest_arg ',' f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, 0, $3, $5, $6);
 		    }
-		| f_arg opt_f_block_arg
+		| f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, $1, 0, 0, 0, $2);
 		    }
-		| f_optarg ',' f_rest_arg opt_f_block_arg
+		| f_optarg ',' f_rest_arg opt_args_tail
 		    {
 		      $$ = new_args(p, 0, $1, $3, 0, $4);
 		    }
-		| f_optarg ',' f_rest_arg ',' f_arg opt_f_block_arg
+		| f_optarg ',' f_rest_arg ',' f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, 0, $1, $3, $5, $6);
 		    }
-		| f_optarg opt_f_block_arg
+		| f_optarg opt_args_tail
 		    {
 		      $$ = new_args(p, 0, $1, 0, 0, $2);
 		    }
-		| f_optarg ',' f_arg opt_f_block_arg
+		| f_optarg ',' f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, 0, $1, 0, $3, $4);
 		    }
-		| f_rest_arg opt_f_block_arg
+		| f_rest_arg opt_args_tail
 		    {
 		      $$ = new_args(p, 0, 0, $1, 0, $2);
 		    }
-		| f_rest_arg ',' f_arg opt_f_block_arg
+		| f_rest_arg ',' f_arg opt_args_tail
 		    {
 		      $$ = new_args(p, 0, 0, $1, $3, $4);
 		    }
-		| f_block_arg
+		| args_tail
 		    {
 		      $$ = new_args(p, 0, 0, 0, 0, $1);
 		    }
 		| /* none */
 		    {
 		      local_add_f(p, 0);
-		      $$ = new_args(p, 0, 0, 0, 0, 0);
+		      $$ = new_args(p, 0, 0, 0, 0, new_args_tail(p, 0, 0, 0));
 		    }
 		;
 
@@ -3019,6 +3101,44 @@ f_opt		: tIDENTIFIER '=' arg_value
 		    }
 		;
 
+f_kw		: tLABEL arg_value
+		    {
+		      local_add_f(p, $1);
+		      $$ = new_kw_arg(p, $1, $2);
+		    }
+		| tLABEL
+		    {
+		      local_add_f(p, $1);
+		      $$ = new_kw_arg(p, $1, 0);
+		    }
+		;
+
+f_kwarg		: f_kw
+		    {
+		      $$ = list1($1);
+		    }
+		| f_kwarg ',' f_kw
+		    {
+		      $$ = push($1, $3);
+		    }
+		;
+
+kwrest_mark	: tPOW
+		| tDSTAR
+		;
+
+f_kwrest	: kwrest_mark tIDENTIFIER
+		    {
+		      local_add_f(p, $2);
+		      $$ = $2;
+		    }
+		| kwrest_mark
+		    {
+		      local_add_f(p, 0);
+		      $$ = -1;
+		    }
+		;
+
 f_block_opt	: tIDENTIFIER '=' primary_value
 		    {
 		      local_add_f(p, $1);
@@ -3365,6 +3485,39 @@ skip(parser_state *p, char term)
   }
 }
 
+/* reads a comment line before the first token, looking for
+   "frozen_string_literal: true" ('-' and '_' and case ignored) */
+static void
+magic_comment(parser_state *p)
+{
+  static const char name[] = "frozen_string_literal";
+  char buf[128];
+  size_t len = 0;
+  char *s;
+  int c;
+
+  for (;;) {
+    c = nextc(p);
+    if (c < 0 || c == '\n') break;
+    if (len < sizeof(buf)-1) {
+      buf[len++] = (c == '-') ? '_' : (char)TOLOWER(c);
+    }
+  }
+  buf[len] = '\0';
+  s = strstr(buf, name);
+  if (!s) return;
+  s += sizeof(name)-1;
+  while (ISSPACE(*s)) s++;
+  if (*s++ != ':') return;
+  while (ISSPACE(*s)) s++;
+  if (strncmp(s, "true", 4) == 0 && !ISALNUM(s[4])) {
+    p->frozen_string_literal = TRUE;
+  }
+  else if (strncmp(s, "false", 5) == 0 && !ISALNUM(s[5])) {
+    p->frozen_string_literal = FALSE;
+  }
+}
+
 static int
 peek_n(parser_state *p, int c, int n)
 {
@@ -3946,7 +4099,12 @@ parser_yylex(parser_state *p)
     goto retry;
 
   case '#':     /* it's a comment */
-    skip(p, '\n');
+    if (!p->token_seen) {
+      magic_comment(p);
+    }
+    else {
+      skip(p, '\n');
+    }
   /* fall through */
   case '\n':
   maybe_heredoc:
@@ -4001,7 +4159,12 @@ parser_yylex(parser_state *p)
 	return tOP_ASGN;
       }
       pushback(p, c);
-      c = tPOW;
+      if (IS_BEG()) {
+	c = tDSTAR;
+      }
+      else {
+	c = tPOW;
+      }
     }
     else {
       if (c == '=') {
@@ -5118,6 +5281,7 @@ yylex(void *lval, parser_state *p)
 
   p->ylval = lval;
   t = parser_yylex(p);
+  if (t != 0) p->token_seen = TRUE;
 
   return t;
 }
@@ -5137,6 +5301,8 @@ parser_init_cxt(parser_state *p, mrbc_context *cxt)
     }
   }
   p->capture_errors = cxt->capture_errors;
+  p->optimize = cxt->optimize;
+  p->frozen_string_literal = cxt->frozen_string_literal;
   if (cxt->partial_hook) {
     p->cxt = cxt;
   }
@@ -5457,6 +5623,39 @@ dump_recur(mrb_state *mrb, node *tree, int offset)
   }
 }
 
+static void
+dump_args_tail(mrb_state *mrb, node *n, int offset)
+{
+  if (n->car) {
+    node *n2 = n->car->car;
+
+    if (n2) {
+      dump_prefix(offset+1);
+      printf("keyword args:\n");
+      while (n2) {
+	dump_prefix(offset+2);
+	printf("%s:", mrb_sym2name(mrb, sym(n2->car->car)));
+	if (n2->car->cdr) {
+	  putc(' ', stdout);
+	  parser_dump(mrb, n2->car->cdr, 0);
+	}
+	else {
+	  putc('\n', stdout);
+	}
+	n2 = n2->cdr;
+      }
+    }
+    if (n->car->cdr) {
+      dump_prefix(offset+1);
+      printf("kwrest=**%s\n", mrb_sym2name(mrb, sym(n->car->cdr)));
+    }
+  }
+  if (n->cdr) {
+    dump_prefix(offset+1);
+    printf("blk=&%s\n", mrb_sym2name(mrb, sym(n->cdr)));
+  }
+}
+
 #endif
 
 void
@@ -5569,11 +5768,7 @@ parser_dump(mrb_state *mrb, node *tree, int offset)
 	printf("post mandatory args:\n");
 	dump_recur(mrb, n->car, offset+2);
       }
-      n = n->cdr;
-      if (n) {
-	dump_prefix(offset+1);
-	printf("blk=&%s\n", mrb_sym2name(mrb, sym(n)));
-      }
+      dump_args_tail(mrb, n->cdr, offset);
     }
     dump_prefix(offset+1);
     printf("body:\n");
@@ -6122,11 +6317,7 @@ parser_dump(mrb_state *mrb, node *tree, int offset)
 	printf("post mandatory args:\n");
 	dump_recur(mrb, n->car, offset+2);
       }
-      n = n->cdr;
-      if (n) {
-	dump_prefix(offset+1);
-	printf("blk=&%s\n", mrb_sym2name(mrb, sym(n)));
-      }
+      dump_args_tail(mrb, n->cdr, offset);
     }
     parser_dump(mrb, tree->cdr->car, offset+1);
     break;
@@ -6172,11 +6363,7 @@ parser_dump(mrb_state *mrb, node *tree, int offset)
 	printf("post mandatory args:\n");
 	dump_recur(mrb, n->car, offset+2);
       }
-      n = n->cdr;
-      if (n) {
-	dump_prefix(offset+1);
-	printf("blk=&%s\n", mrb_sym2name(mrb, sym(n)));
-      }
+      dump_args_tail(mrb, n->cdr, offset);
     }
     tree = tree->cdr;
     parser_dump(mrb, tree->car, offset+1);
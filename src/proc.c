@@ -41,7 +41,7 @@ closure_setup(mrb_state *mrb, struct RProc *p, int nlocals)
 
   if (!mrb->c->ci->env) {
     e = (struct REnv*)mrb_obj_alloc(mrb, MRB_TT_ENV, (struct RClass*)mrb->c->ci->proc->env);
-    e->flags= (unsigned int)nlocals;
+    MRB_ENV_SET_STACK_LEN(e, nlocals);
     e->mid = mrb->c->ci->mid;
     e->cioff = mrb->c->ci - mrb->c->cibase;
     e->stack = mrb->c->stack;
@@ -80,9 +80,60 @@ mrb_closure_new_cfunc(mrb_state *mrb, mrb_func_t func, int nlocals)
   struct RProc *p = mrb_proc_new_cfunc(mrb, func);
 
   closure_setup(mrb, p, nlocals);
+  mrb_proc_escape(mrb, p);
   return p;
 }
 
+/* cfunc proc carrying its own values; read them with mrb_cfunc_env_get() */
+struct RProc *
+mrb_proc_new_cfunc_with_env(mrb_state *mrb, mrb_func_t func, mrb_int argc, const mrb_value *argv)
+{
+  struct RProc *p = mrb_proc_new_cfunc(mrb, func);
+  struct REnv *e;
+  mrb_int i;
+
+  e = (struct REnv*)mrb_obj_alloc(mrb, MRB_TT_ENV, NULL);
+  e->stack = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value)*argc);
+  for (i=0; i<argc; i++) {
+    e->stack[i] = argv[i];
+  }
+  MRB_ENV_SET_STACK_LEN(e, argc);
+  e->flags |= MRB_ENV_ESCAPED;
+  e->mid = 0;
+  e->cioff = -1;
+  p->env = e;
+  mrb_field_write_barrier(mrb, (struct RBasic*)p, (struct RBasic*)e);
+  return p;
+}
+
+mrb_value
+mrb_cfunc_env_get(mrb_state *mrb, mrb_int idx)
+{
+  struct RProc *p = mrb->c->ci->proc;
+  struct REnv *e = p->env;
+
+  if (!MRB_PROC_CFUNC_P(p) || !e || e->cioff >= 0) {
+    mrb_raise(mrb, E_TYPE_ERROR, "no cfunc env in current method");
+  }
+  if (idx < 0 || (mrb_int)MRB_ENV_STACK_LEN(e) <= idx) {
+    mrb_raise(mrb, E_INDEX_ERROR, "cfunc env index out of range");
+  }
+  return e->stack[idx];
+}
+
+/* the proc may outlive the frames it captures; their stacks
+   have to be copied to the heap when they return */
+void
+mrb_proc_escape(mrb_state *mrb, struct RProc *p)
+{
+  struct REnv *e = p->env;
+
+  while (e && !MRB_ENV_ESCAPED_P(e)) {
+    e->flags |= MRB_ENV_ESCAPED;
+    e = (struct REnv*)e->c;
+  }
+}
+
 void
 mrb_proc_copy(struct RProc *a, struct RProc *b)
 {
@@ -5,6 +5,7 @@
 */
 
 #include "mruby.h"
+#include "mruby/array.h"
 #include "mruby/class.h"
 #include "mruby/range.h"
 #include "mruby/string.h"
@@ -25,7 +26,7 @@ range_check(mrb_state *mrb, mrb_value a, mrb_value b)
     return;
   }
 
-  ans =  mrb_funcall(mrb, a, "<=>", 1, b);
+  ans =  mrb_funcall_id(mrb, a, mrb->sym_cmp, 1, b);
   if (mrb_nil_p(ans)) {
     /* can not be compared */
     mrb_raise(mrb, E_ARGUMENT_ERROR, "bad value for range");
@@ -173,7 +174,7 @@ mrb_range_eq(mrb_state *mrb, mrb_value range)
 static mrb_bool
 r_le(mrb_state *mrb, mrb_value a, mrb_value b)
 {
-  mrb_value r = mrb_funcall(mrb, a, "<=>", 1, b); /* compare result */
+  mrb_value r = mrb_funcall_id(mrb, a, mrb->sym_cmp, 1, b); /* compare result */
   /* output :a < b => -1, a = b =>  0, a > b => +1 */
 
   if (mrb_fixnum_p(r)) {
@@ -187,7 +188,7 @@ r_le(mrb_state *mrb, mrb_value a, mrb_value b)
 static mrb_bool
 r_gt(mrb_state *mrb, mrb_value a, mrb_value b)
 {
-  mrb_value r = mrb_funcall(mrb, a, "<=>", 1, b);
+  mrb_value r = mrb_funcall_id(mrb, a, mrb->sym_cmp, 1, b);
   /* output :a < b => -1, a = b =>  0, a > b => +1 */
 
   return mrb_fixnum_p(r) && mrb_fixnum(r) == 1;
@@ -196,7 +197,7 @@ r_gt(mrb_state *mrb, mrb_value a, mrb_value b)
 static mrb_bool
 r_ge(mrb_state *mrb, mrb_value a, mrb_value b)
 {
-  mrb_value r = mrb_funcall(mrb, a, "<=>", 1, b); /* compare result */
+  mrb_value r = mrb_funcall_id(mrb, a, mrb->sym_cmp, 1, b); /* compare result */
   /* output :a < b => -1, a = b =>  0, a > b => +1 */
 
   if (mrb_fixnum_p(r)) {
@@ -207,6 +208,9 @@ r_ge(mrb_state *mrb, mrb_value a, mrb_value b)
   return FALSE;
 }
 
+#define r_num_p(v) (mrb_fixnum_p(v) || mrb_type(v) == MRB_TT_FLOAT)
+#define r_to_flo(v) (mrb_fixnum_p(v) ? (mrb_float)mrb_fixnum(v) : mrb_float(v))
+
 /*
  *  call-seq:
  *     range === obj       =>  true or false
@@ -226,6 +230,22 @@ mrb_range_include(mrb_state *mrb, mrb_value range)
 
   beg = r->edges->beg;
   end = r->edges->end;
+  if (r_num_p(beg) && r_num_p(end) && r_num_p(val)) {
+    /* numeric ranges compare in C, without <=> */
+    if (mrb_fixnum_p(beg) && mrb_fixnum_p(end) && mrb_fixnum_p(val)) {
+      mrb_int v = mrb_fixnum(val);
+
+      include_p = mrb_fixnum(beg) <= v &&
+                  (r->excl ? v < mrb_fixnum(end) : v <= mrb_fixnum(end));
+    }
+    else {
+      mrb_float v = r_to_flo(val);
+
+      include_p = r_to_flo(beg) <= v &&
+                  (r->excl ? v < r_to_flo(end) : v <= r_to_flo(end));
+    }
+    return mrb_bool_value(include_p);
+  }
   include_p = r_le(mrb, beg, val) && /* beg <= val */
               ((r->excl && r_gt(mrb, end, val)) || /* end >  val */
               (r_ge(mrb, end, val))); /* end >= val */
@@ -257,6 +277,43 @@ mrb_range_each(mrb_state *mrb, mrb_value range)
     return range;
 }
 
+/*
+ *  call-seq:
+ *     rng.to_a   => array
+ *
+ *  Returns an array of the elements of <i>rng</i>.  A range of
+ *  Fixnums is filled in directly; others go through +each+.
+ *
+ *     (1..4).to_a    #=> [1, 2, 3, 4]
+ */
+static mrb_value
+range_to_a(mrb_state *mrb, mrb_value range)
+{
+  struct RRange *r = mrb_range_ptr(range);
+  struct RArray *a;
+  mrb_int b, e, i;
+  mrb_float n;
+
+  if (!mrb_fixnum_p(r->edges->beg) || !mrb_fixnum_p(r->edges->end)) {
+    return mrb_funcall(mrb, range, "entries", 0);
+  }
+  b = mrb_fixnum(r->edges->beg);
+  e = mrb_fixnum(r->edges->end);
+  n = (mrb_float)e - (mrb_float)b + (r->excl ? 0 : 1);
+  if (n <= 0) {
+    return mrb_ary_new(mrb);
+  }
+  if (n > MRB_INT_MAX) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
+  }
+  a = mrb_ary_ptr(mrb_ary_new_capa(mrb, (mrb_int)n));
+  for (i = 0; i < (mrb_int)n; i++) {
+    a->ptr[i] = mrb_fixnum_value(b + i);
+  }
+  a->len = (mrb_int)n;
+  return mrb_obj_value(a);
+}
+
 mrb_int
 mrb_range_beg_len(mrb_state *mrb, mrb_value range, mrb_int *begp, mrb_int *lenp, mrb_int len)
 {
@@ -416,6 +473,7 @@ mrb_init_range(mrb_state *mrb)
   mrb_define_method(mrb, r, "initialize",      mrb_range_initialize,  MRB_ARGS_ANY());  /* 15.2.14.4.9  */
   mrb_define_method(mrb, r, "last",            mrb_range_end,         MRB_ARGS_NONE()); /* 15.2.14.4.10 */
   mrb_define_method(mrb, r, "member?",         mrb_range_include,     MRB_ARGS_REQ(1)); /* 15.2.14.4.11 */
+  mrb_define_method(mrb, r, "to_a",            range_to_a,            MRB_ARGS_NONE());
 
   mrb_define_method(mrb, r, "to_s",            range_to_s,            MRB_ARGS_NONE()); /* 15.2.14.4.12(x) */
   mrb_define_method(mrb, r, "inspect",         range_inspect,         MRB_ARGS_NONE()); /* 15.2.14.4.13(x) */
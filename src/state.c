@@ -6,17 +6,64 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "mruby.h"
 #include "mruby/class.h"
 #include "mruby/irep.h"
 #include "mruby/variable.h"
 #include "mruby/debug.h"
+#include "mruby/gc.h"
 #include "mruby/string.h"
+#include "mruby/khash.h"
+
+#ifndef MRB_CONTEXT_POOL_SIZE
+#define MRB_CONTEXT_POOL_SIZE 16
+#endif
+#ifndef MRB_CONTEXT_POOL_STACK_MAX
+#define MRB_CONTEXT_POOL_STACK_MAX 1024
+#endif
+#ifndef MRB_CONTEXT_POOL_CI_MAX
+#define MRB_CONTEXT_POOL_CI_MAX 64
+#endif
 
 void mrb_init_heap(mrb_state*);
 void mrb_init_core(mrb_state*);
 void mrb_final_core(mrb_state*);
 
+static uint64_t
+splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * Keys String#hash.  Without a system random source, the time, the
+ * clock and a couple of (randomized) addresses are mixed together;
+ * enough that hash-flooding keys cannot be precomputed.
+ */
+static void
+init_str_hash_key(mrb_state *mrb)
+{
+#ifdef MRB_STR_HASH_SEED
+  uint64_t x = MRB_STR_HASH_SEED;
+#else
+  static uint64_t opened = 0;
+  uint64_t x;
+
+  x = (uint64_t)time(NULL);
+  x ^= (uint64_t)clock() << 20;
+  x ^= (uint64_t)(uintptr_t)mrb << 8;
+  x ^= (uint64_t)(uintptr_t)&x << 24;
+  x ^= splitmix64(&opened);
+#endif
+  mrb->str_hash_key[0] = splitmix64(&x);
+  mrb->str_hash_key[1] = splitmix64(&x);
+}
+
 static mrb_value
 inspect_main(mrb_state *mrb, mrb_value mod)
 {
@@ -41,6 +88,7 @@ mrb_open_allocf(mrb_allocf f, void *ud)
   mrb->ud = ud;
   mrb->allocf = f;
   mrb->current_white_part = MRB_GC_WHITE_A;
+  init_str_hash_key(mrb);
 
 #ifndef MRB_GC_FIXED_ARENA
   mrb->arena = (struct RBasic**)mrb_malloc(mrb, sizeof(struct RBasic*)*MRB_GC_ARENA_SIZE);
@@ -112,6 +160,65 @@ mrb_open(void)
 void mrb_free_symtbl(mrb_state *mrb);
 void mrb_free_heap(mrb_state *mrb);
 
+/*
+ * Literal table: pool strings are interned here so that identical
+ * literals in different ireps share one RString.  The value counts
+ * the pool slots referring to each string.
+ */
+static inline khint_t
+lit_hash_func(mrb_state *mrb, mrb_value s)
+{
+  return (khint_t)mrb_str_hash(mrb, s) ^ (MRB_FROZEN_P(mrb_str_ptr(s)) ? 1 : 0);
+}
+#define lit_hash_equal(mrb, a, b) (RSTRING_LEN(a) == RSTRING_LEN(b) &&\
+  MRB_FROZEN_P(mrb_str_ptr(a)) == MRB_FROZEN_P(mrb_str_ptr(b)) &&\
+  memcmp(RSTRING_PTR(a), RSTRING_PTR(b), RSTRING_LEN(a)) == 0)
+
+KHASH_DECLARE(lit, mrb_value, int, 1)
+KHASH_DEFINE(lit, mrb_value, int, 1, lit_hash_func, lit_hash_equal)
+
+static void
+free_pool_str(mrb_state *mrb, struct RString *s)
+{
+  mrb_gc_free_str(mrb, s);
+  mrb_free(mrb, s);
+}
+
+/*
+ * A frozen literal is handed out as is by OP_STRING and may be kept
+ * anywhere after its irep is gone, so it stays until mrb_close().
+ */
+static void
+str_pool_release(mrb_state *mrb, mrb_value str)
+{
+  khash_t(lit) *h = mrb->lit_table;
+  khiter_t k;
+
+  if (MRB_FROZEN_P(mrb_str_ptr(str))) return;
+  k = kh_get(lit, mrb, h, str);
+  if (k != kh_end(h) && mrb_obj_ptr(kh_key(h, k)) == mrb_obj_ptr(str)) {
+    if (--kh_value(h, k) > 0) return;
+    kh_del(lit, mrb, h, k);
+  }
+  free_pool_str(mrb, mrb_str_ptr(str));
+}
+
+static void
+free_lit_table(mrb_state *mrb)
+{
+  khash_t(lit) *h = mrb->lit_table;
+  khiter_t k;
+
+  if (!h) return;
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      free_pool_str(mrb, mrb_str_ptr(kh_key(h, k)));
+    }
+  }
+  kh_destroy(lit, mrb, h);
+  mrb->lit_table = NULL;
+}
+
 void
 mrb_irep_incref(mrb_state *mrb, mrb_irep *irep)
 {
@@ -136,10 +243,7 @@ mrb_irep_free(mrb_state *mrb, mrb_irep *irep)
     mrb_free(mrb, irep->iseq);
   for (i=0; i<irep->plen; i++) {
     if (mrb_type(irep->pool[i]) == MRB_TT_STRING) {
-      if ((mrb_str_ptr(irep->pool[i])->flags & MRB_STR_NOFREE) == 0) {
-        mrb_free(mrb, mrb_str_ptr(irep->pool[i])->ptr);
-      }
-      mrb_free(mrb, mrb_obj_ptr(irep->pool[i]));
+      str_pool_release(mrb, irep->pool[i]);
     }
 #ifdef MRB_WORD_BOXING
     else if (mrb_type(irep->pool[i]) == MRB_TT_FLOAT) {
@@ -164,26 +268,47 @@ mrb_str_pool(mrb_state *mrb, mrb_value str)
 {
   struct RString *s = mrb_str_ptr(str);
   struct RString *ns;
+  khash_t(lit) *h;
+  khiter_t k;
   mrb_int len;
 
+  if (!mrb->lit_table) {
+    mrb->lit_table = kh_init(lit, mrb);
+  }
+  h = mrb->lit_table;
+  k = kh_get(lit, mrb, h, str);
+  if (k != kh_end(h)) {
+    kh_value(h, k)++;
+    return kh_key(h, k);
+  }
+
   ns = (struct RString *)mrb_malloc(mrb, sizeof(struct RString));
   ns->tt = MRB_TT_STRING;
   ns->c = mrb->string_class;
+  /* outside the heap: black, so the GC never traces it from a register */
+  paint_black(ns);
 
   len = s->len;
   ns->len = len;
+  ns->aux.capa = len;
   if (s->flags & MRB_STR_NOFREE) {
     ns->ptr = s->ptr;
     ns->flags = MRB_STR_NOFREE;
   }
   else {
+    ns->flags = 0;
     ns->ptr = (char *)mrb_malloc(mrb, (size_t)len+1);
     if (s->ptr) {
       memcpy(ns->ptr, s->ptr, len);
     }
     ns->ptr[len] = '\0';
   }
-  return mrb_obj_value(ns);
+  ns->flags |= s->flags & MRB_FLAG_FROZEN;
+  str = mrb_obj_value(ns);
+  k = kh_put(lit, mrb, h, str);
+  kh_key(h, k) = str;
+  kh_value(h, k) = 1;
+  return str;
 }
 
 void
@@ -197,6 +322,89 @@ mrb_free_context(mrb_state *mrb, struct mrb_context *c)
   mrb_free(mrb, c);
 }
 
+/* get a context with at least the given stack/callinfo capacity;
+   released contexts are reused before allocating new ones */
+struct mrb_context*
+mrb_context_alloc(mrb_state *mrb, size_t stsize, size_t cisize)
+{
+  static const struct mrb_context mrb_context_zero = { 0 };
+  struct mrb_context *c = mrb->context_pool;
+  struct mrb_context pooled = mrb_context_zero;
+  mrb_value *stbase;
+  mrb_callinfo *cibase;
+  size_t stcapa, cicapa;
+
+  if (c) {
+    mrb->context_pool = c->prev;
+    mrb->context_pool_len--;
+    pooled = *c;
+  }
+  else {
+    c = (struct mrb_context*)mrb_malloc(mrb, sizeof(struct mrb_context));
+  }
+  stbase = pooled.stbase; stcapa = pooled.stend - pooled.stbase;
+  cibase = pooled.cibase; cicapa = pooled.ciend - pooled.cibase;
+  *c = mrb_context_zero;
+  /* exception handler arrays are kept as they are */
+  c->rescue = pooled.rescue; c->rsize = pooled.rsize;
+  c->ensure = pooled.ensure; c->esize = pooled.esize;
+  if (stcapa < stsize) {
+    stbase = (mrb_value *)mrb_realloc(mrb, stbase, sizeof(mrb_value)*stsize);
+    stcapa = stsize;
+  }
+  if (cicapa < cisize) {
+    cibase = (mrb_callinfo *)mrb_realloc(mrb, cibase, sizeof(mrb_callinfo)*cisize);
+    cicapa = cisize;
+  }
+  /* only the requested part is handed out clean; the VM clears the
+     stack itself whenever it extends a frame beyond that */
+  memset(stbase, 0, sizeof(mrb_value)*stsize);
+  memset(cibase, 0, sizeof(mrb_callinfo)*cisize);
+  c->stbase = c->stack = stbase;
+  c->stend = stbase + stcapa;
+  c->cibase = c->ci = cibase;
+  c->ciend = cibase + cicapa;
+  return c;
+}
+
+/* return a context that is no longer referenced to the pool */
+void
+mrb_context_recycle(mrb_state *mrb, struct mrb_context *c)
+{
+  if (!c) return;
+  if (mrb->context_pool_len >= MRB_CONTEXT_POOL_SIZE) {
+    mrb_free_context(mrb, c);
+    return;
+  }
+  if (c->stend - c->stbase > MRB_CONTEXT_POOL_STACK_MAX) {
+    c->stbase = (mrb_value *)mrb_realloc(mrb, c->stbase, sizeof(mrb_value)*MRB_CONTEXT_POOL_STACK_MAX);
+    c->stend = c->stbase + MRB_CONTEXT_POOL_STACK_MAX;
+  }
+  if (c->ciend - c->cibase > MRB_CONTEXT_POOL_CI_MAX) {
+    c->cibase = (mrb_callinfo *)mrb_realloc(mrb, c->cibase, sizeof(mrb_callinfo)*MRB_CONTEXT_POOL_CI_MAX);
+    c->ciend = c->cibase + MRB_CONTEXT_POOL_CI_MAX;
+  }
+  c->fib = NULL;
+  c->prev = mrb->context_pool;
+  mrb->context_pool = c;
+  mrb->context_pool_len++;
+}
+
+static void
+free_context_pool(mrb_state *mrb)
+{
+  struct mrb_context *c = mrb->context_pool;
+
+  while (c) {
+    struct mrb_context *next = c->prev;
+
+    mrb_free_context(mrb, c);
+    c = next;
+  }
+  mrb->context_pool = NULL;
+  mrb->context_pool_len = 0;
+}
+
 void
 mrb_close(mrb_state *mrb)
 {
@@ -207,6 +415,8 @@ mrb_close(mrb_state *mrb)
   mrb_free_context(mrb, mrb->root_c);
   mrb_free_symtbl(mrb);
   mrb_free_heap(mrb);
+  free_lit_table(mrb);
+  free_context_pool(mrb);
   mrb_alloca_free(mrb);
 #ifndef MRB_GC_FIXED_ARENA
   mrb_free(mrb, mrb->arena);
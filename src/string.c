@@ -12,6 +12,8 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/numeric.h"
+#include "mruby/proc.h"
 #include "mruby/range.h"
 #include "mruby/string.h"
 #include "mruby/variable.h"
@@ -26,9 +28,17 @@ typedef struct mrb_shared_string {
   mrb_int len;
 } mrb_shared_string;
 
+/*
+ * A substring shares its parent's buffer and keeps all of it alive,
+ * so a view only shares a buffer of up to STR_PIN_MAX bytes, or one
+ * it covers at least 1/STR_PIN_RATIO of; smaller views are copied.
+ */
+#define STR_PIN_MAX 4096
+#define STR_PIN_RATIO 8
+#define STR_PIN_OK_P(blen, len) ((blen) <= STR_PIN_MAX || (len) >= (blen) / STR_PIN_RATIO)
+
 static mrb_value str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2);
 static mrb_value mrb_str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len);
-
 #define RESIZE_CAPA(s,capacity) do {\
       s->ptr = (char *)mrb_realloc(mrb, s->ptr, (capacity)+1);\
       s->aux.capa = capacity;\
@@ -49,12 +59,23 @@ str_decref(mrb_state *mrb, mrb_shared_string *shared)
 void
 mrb_str_modify(mrb_state *mrb, struct RString *s)
 {
+  if (MRB_FROZEN_P(s)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "can't modify frozen String");
+  }
+  s->flags &= ~MRB_STR_HASHED;
   if (s->flags & MRB_STR_SHARED) {
     mrb_shared_string *shared = s->aux.shared;
 
-    if (shared->refcnt == 1 && s->ptr == shared->ptr) {
+    if (shared->refcnt == 1 && !shared->nofree) {
+      /* the last view takes the buffer over */
+      if (s->ptr != shared->ptr) {
+        memmove(shared->ptr, s->ptr, s->len);
+      }
       s->ptr = shared->ptr;
       s->aux.capa = shared->len;
+      if (!STR_PIN_OK_P(shared->len, s->len)) {
+        RESIZE_CAPA(s, s->len);
+      }
       s->ptr[s->len] = '\0';
       mrb_free(mrb, shared);
     }
@@ -353,6 +374,10 @@ mrb_str_concat(mrb_state *mrb, mrb_value self, mrb_value other)
   mrb_int len;
 
   mrb_str_modify(mrb, s1);
+  if (mrb_fixnum_p(other) && mrb_builtin_to_s_p(mrb, other)) {
+    mrb_str_cat_int(mrb, self, mrb_fixnum(other), 10);
+    return;
+  }
   if (!mrb_string_p(other)) {
     other = mrb_str_to_str(mrb, other);
   }
@@ -722,10 +747,12 @@ mrb_str_index(mrb_state *mrb, mrb_value str, mrb_value sub, mrb_int offset)
 mrb_value
 mrb_str_dup(mrb_state *mrb, mrb_value str)
 {
-  /* should return shared string */
   struct RString *s = mrb_str_ptr(str);
+  mrb_value dup = mrb_str_subseq(mrb, str, 0, s->len);
 
-  return mrb_str_new(mrb, s->ptr, s->len);
+  mrb_str_ptr(dup)->hash = s->hash;
+  mrb_str_ptr(dup)->flags |= s->flags & MRB_STR_HASHED;
+  return dup;
 }
 
 static mrb_value
@@ -894,48 +921,31 @@ mrb_str_capitalize(mrb_state *mrb, mrb_value self)
   return str;
 }
 
-/* 15.2.10.5.10  */
-/*
- *  call-seq:
- *     str.chomp!(separator=$/)   => str or nil
- *
- *  Modifies <i>str</i> in place as described for <code>String#chomp</code>,
- *  returning <i>str</i>, or <code>nil</code> if no modifications were made.
- */
-static mrb_value
-mrb_str_chomp_bang(mrb_state *mrb, mrb_value str)
+/* length of s without the separator chomp would remove */
+static mrb_int
+chomp_len(struct RString *s, int argc, mrb_value rs)
 {
-  mrb_value rs;
-  mrb_int newline;
-  char *p, *pp;
+  const char *p = s->ptr;
+  mrb_int len = s->len;
   mrb_int rslen;
-  mrb_int len;
-  struct RString *s = mrb_str_ptr(str);
+  char newline;
 
-  mrb_str_modify(mrb, s);
-  len = s->len;
-  if (mrb_get_args(mrb, "|S", &rs) == 0) {
-    if (len == 0) return mrb_nil_value();
+  if (argc == 0) {
   smart_chomp:
-    if (s->ptr[len-1] == '\n') {
-      s->len--;
-      if (s->len > 0 &&
-          s->ptr[s->len-1] == '\r') {
-        s->len--;
+    if (len == 0) return len;
+    if (p[len-1] == '\n') {
+      len--;
+      if (len > 0 && p[len-1] == '\r') {
+        len--;
       }
     }
-    else if (s->ptr[len-1] == '\r') {
-      s->len--;
-    }
-    else {
-      return mrb_nil_value();
+    else if (p[len-1] == '\r') {
+      len--;
     }
-    s->ptr[s->len] = '\0';
-    return str;
+    return len;
   }
 
-  if (len == 0 || mrb_nil_p(rs)) return mrb_nil_value();
-  p = s->ptr;
+  if (len == 0 || mrb_nil_p(rs)) return len;
   rslen = RSTRING_LEN(rs);
   if (rslen == 0) {
     while (len>0 && p[len-1] == '\n') {
@@ -943,29 +953,44 @@ mrb_str_chomp_bang(mrb_state *mrb, mrb_value str)
       if (len>0 && p[len-1] == '\r')
         len--;
     }
-    if (len < s->len) {
-      s->len = len;
-      p[len] = '\0';
-      return str;
-    }
-    return mrb_nil_value();
+    return len;
   }
-  if (rslen > len) return mrb_nil_value();
+  if (rslen > len) return len;
   newline = RSTRING_PTR(rs)[rslen-1];
-  if (rslen == 1 && newline == '\n')
-    newline = RSTRING_PTR(rs)[rslen-1];
   if (rslen == 1 && newline == '\n')
     goto smart_chomp;
 
-  pp = p + len - rslen;
   if (p[len-1] == newline &&
      (rslen <= 1 ||
-     memcmp(RSTRING_PTR(rs), pp, rslen) == 0)) {
-    s->len = len - rslen;
-    p[s->len] = '\0';
-    return str;
+     memcmp(RSTRING_PTR(rs), p + len - rslen, rslen) == 0)) {
+    return len - rslen;
   }
-  return mrb_nil_value();
+  return len;
+}
+
+/* 15.2.10.5.10  */
+/*
+ *  call-seq:
+ *     str.chomp!(separator=$/)   => str or nil
+ *
+ *  Modifies <i>str</i> in place as described for <code>String#chomp</code>,
+ *  returning <i>str</i>, or <code>nil</code> if no modifications were made.
+ */
+static mrb_value
+mrb_str_chomp_bang(mrb_state *mrb, mrb_value str)
+{
+  mrb_value rs = mrb_nil_value();
+  int argc;
+  mrb_int len;
+  struct RString *s = mrb_str_ptr(str);
+
+  mrb_str_modify(mrb, s);
+  argc = mrb_get_args(mrb, "|S", &rs);
+  len = chomp_len(s, argc, rs);
+  if (len == s->len) return mrb_nil_value();
+  s->len = len;
+  s->ptr[len] = '\0';
+  return str;
 }
 
 /* 15.2.10.5.9  */
@@ -990,11 +1015,11 @@ mrb_str_chomp_bang(mrb_state *mrb, mrb_value str)
 static mrb_value
 mrb_str_chomp(mrb_state *mrb, mrb_value self)
 {
-  mrb_value str;
+  mrb_value rs = mrb_nil_value();
+  int argc;
 
-  str = mrb_str_dup(mrb, self);
-  mrb_str_chomp_bang(mrb, str);
-  return str;
+  argc = mrb_get_args(mrb, "|S", &rs);
+  return mrb_str_subseq(mrb, self, 0, chomp_len(mrb_str_ptr(self), argc, rs));
 }
 
 /* 15.2.10.5.12 */
@@ -1006,23 +1031,32 @@ mrb_str_chomp(mrb_state *mrb, mrb_value self)
  *  or <code>nil</code> if <i>str</i> is the empty string.  See also
  *  <code>String#chomp!</code>.
  */
-static mrb_value
-mrb_str_chop_bang(mrb_state *mrb, mrb_value str)
+static mrb_int
+chop_len(struct RString *s)
 {
-  struct RString *s = mrb_str_ptr(str);
+  mrb_int len = s->len;
 
-  mrb_str_modify(mrb, s);
-  if (s->len > 0) {
-    int len;
-    len = s->len - 1;
+  if (len > 0) {
+    len--;
     if (s->ptr[len] == '\n') {
       if (len > 0 &&
           s->ptr[len-1] == '\r') {
         len--;
       }
     }
-    s->len = len;
-    s->ptr[len] = '\0';
+  }
+  return len;
+}
+
+static mrb_value
+mrb_str_chop_bang(mrb_state *mrb, mrb_value str)
+{
+  struct RString *s = mrb_str_ptr(str);
+
+  mrb_str_modify(mrb, s);
+  if (s->len > 0) {
+    s->len = chop_len(s);
+    s->ptr[s->len] = '\0';
     return str;
   }
   return mrb_nil_value();
@@ -1048,10 +1082,7 @@ mrb_str_chop_bang(mrb_state *mrb, mrb_value str)
 static mrb_value
 mrb_str_chop(mrb_state *mrb, mrb_value self)
 {
-  mrb_value str;
-  str = mrb_str_dup(mrb, self);
-  mrb_str_chop_bang(mrb, str);
-  return str;
+  return mrb_str_subseq(mrb, self, 0, chop_len(mrb_str_ptr(self)));
 }
 
 /* 15.2.10.5.14 */
@@ -1149,6 +1180,15 @@ mrb_str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
   mrb_shared_string *shared;
 
   orig = mrb_str_ptr(str);
+  if (orig->flags & MRB_STR_SHARED) {
+    shared = orig->aux.shared;
+    if (!shared->nofree && !STR_PIN_OK_P(shared->len, len)) {
+      return mrb_obj_value(str_new(mrb, orig->ptr+beg, len));
+    }
+  }
+  else if (!(orig->flags & MRB_STR_NOFREE) && !STR_PIN_OK_P(orig->len, len)) {
+    return mrb_obj_value(str_new(mrb, orig->ptr+beg, len));
+  }
   str_make_shared(mrb, orig);
   shared = orig->aux.shared;
   s = mrb_obj_alloc_string(mrb);
@@ -1192,21 +1232,72 @@ mrb_str_buf_append(mrb_state *mrb, mrb_value str, mrb_value str2)
   return str;
 }
 
+/*
+ * String#hash is SipHash-1-3 keyed per mrb_state, so colliding keys
+ * cannot be crafted offline.  The result is cached on the string
+ * until mrb_str_modify().
+ */
+#define SIP_ROTL(x,b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND do {\
+  v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32);\
+  v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;\
+  v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;\
+  v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32);\
+} while (0)
+
+static uint64_t
+siphash13(const uint64_t key[2], const char *p, size_t len)
+{
+  const unsigned char *u = (const unsigned char*)p;
+  uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+  uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+  uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+  uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+  uint64_t m, b = (uint64_t)len << 56;
+  size_t i, n = len & ~(size_t)7;
+
+  for (i = 0; i < n; i += 8) {
+#ifdef MRB_ENDIAN_BIG
+    int j;
+
+    m = 0;
+    for (j = 7; j >= 0; j--) m = (m << 8) | u[i+j];
+#else
+    memcpy(&m, u + i, sizeof(m));
+#endif
+    v3 ^= m;
+    SIP_ROUND;
+    v0 ^= m;
+  }
+  switch (len & 7) {
+  case 7: b |= (uint64_t)u[i+6] << 48;
+  case 6: b |= (uint64_t)u[i+5] << 40;
+  case 5: b |= (uint64_t)u[i+4] << 32;
+  case 4: b |= (uint64_t)u[i+3] << 24;
+  case 3: b |= (uint64_t)u[i+2] << 16;
+  case 2: b |= (uint64_t)u[i+1] << 8;
+  case 1: b |= (uint64_t)u[i];
+  }
+  v3 ^= b;
+  SIP_ROUND;
+  v0 ^= b;
+  v2 ^= 0xff;
+  SIP_ROUND;
+  SIP_ROUND;
+  SIP_ROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
 mrb_int
 mrb_str_hash(mrb_state *mrb, mrb_value str)
 {
-  /* 1-8-7 */
   struct RString *s = mrb_str_ptr(str);
-  mrb_int len = s->len;
-  char *p = s->ptr;
-  mrb_int key = 0;
 
-  while (len--) {
-    key = key*65599 + *p;
-    p++;
+  if (!(s->flags & MRB_STR_HASHED)) {
+    s->hash = (uint32_t)siphash13(mrb->str_hash_key, s->ptr, s->len);
+    s->flags |= MRB_STR_HASHED;
   }
-  key = key + (key>>5);
-  return key;
+  return (mrb_int)(int32_t)s->hash;
 }
 
 /* 15.2.10.5.20 */
@@ -1344,14 +1435,20 @@ mrb_str_index_m(mrb_state *mrb, mrb_value str)
 static mrb_value
 str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2)
 {
+  if (MRB_FROZEN_P(s1)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "can't modify frozen String");
+  }
+  s1->hash = s2->hash;
+  s1->flags = (s1->flags & ~MRB_STR_HASHED) | (s2->flags & MRB_STR_HASHED);
   if (s2->flags & MRB_STR_SHARED) {
   L_SHARE:
     if (s1->flags & MRB_STR_SHARED){
       str_decref(mrb, s1->aux.shared);
     }
-    else {
+    else if (!(s1->flags & MRB_STR_NOFREE)) {
       mrb_free(mrb, s1->ptr);
     }
+    s1->flags &= ~MRB_STR_NOFREE;
     s1->ptr = s2->ptr;
     s1->len = s2->len;
     s1->aux.shared = s2->aux.shared;
@@ -1446,14 +1543,55 @@ mrb_str_intern(mrb_state *mrb, mrb_value self)
 
 }
 /* ---------------------------------- */
+/*
+ * Whether obj is a Fixnum, Float, Symbol, nil, true or false whose
+ * class still has its builtin to_s, so that the result can be made
+ * without a method call.
+ */
+mrb_bool
+mrb_builtin_to_s_p(mrb_state *mrb, mrb_value obj)
+{
+  struct RClass *c0, *c;
+  struct RProc *m;
+
+  switch (mrb_type(obj)) {
+  case MRB_TT_FIXNUM: case MRB_TT_FLOAT: case MRB_TT_SYMBOL:
+  case MRB_TT_FALSE: case MRB_TT_TRUE:
+    break;
+  default:
+    return FALSE;
+  }
+  c = c0 = mrb_class(mrb, obj);
+  m = mrb_method_search_vm(mrb, &c, mrb_intern_lit(mrb, "to_s"));
+  return m && MRB_PROC_CFUNC_P(m) && c == c0;
+}
+
 mrb_value
 mrb_obj_as_string(mrb_state *mrb, mrb_value obj)
 {
   mrb_value str;
+  const char *p;
+  size_t len;
 
   if (mrb_string_p(obj)) {
     return obj;
   }
+  if (mrb_builtin_to_s_p(mrb, obj)) {
+    switch (mrb_type(obj)) {
+    case MRB_TT_FIXNUM:
+      return mrb_fixnum_to_str(mrb, obj, 10);
+    case MRB_TT_FLOAT:
+      return mrb_flo_to_str(mrb, obj);
+    case MRB_TT_SYMBOL:
+      p = mrb_sym2name_len(mrb, mrb_symbol(obj), &len);
+      return mrb_str_new_static(mrb, p, len);
+    case MRB_TT_TRUE:
+      return mrb_str_new(mrb, "true", 4);
+    default:
+      if (mrb_nil_p(obj)) return mrb_str_new(mrb, 0, 0);
+      return mrb_str_new(mrb, "false", 5);
+    }
+  }
   str = mrb_funcall(mrb, obj, "to_s", 0);
   if (!mrb_string_p(str))
     return mrb_any_to_s(mrb, obj);
@@ -1877,16 +2015,14 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
 }
 
 mrb_value
-mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
+mrb_str_len_to_inum(mrb_state *mrb, const char *str, size_t len, int base, int badcheck)
 {
-  char *end;
+  const char *e = str + len;
+  const char *end;
   char sign = 1;
   int c;
-  unsigned long n;
   mrb_int val;
 
-#undef ISDIGIT
-#define ISDIGIT(c) ('0' <= (c) && (c) <= '9')
 #define conv_digit(c) \
     (!ISASCII(c) ? -1 : \
      isdigit(c) ? ((c) - '0') : \
@@ -1898,22 +2034,22 @@ mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
     if (badcheck) goto bad;
     return mrb_fixnum_value(0);
   }
-  while (ISSPACE(*str)) str++;
+  while (str < e && ISSPACE(*str)) str++;
 
-  if (str[0] == '+') {
+  if (str < e && str[0] == '+') {
     str++;
   }
-  else if (str[0] == '-') {
+  else if (str < e && str[0] == '-') {
     str++;
     sign = 0;
   }
-  if (str[0] == '+' || str[0] == '-') {
+  if (str < e && (str[0] == '+' || str[0] == '-')) {
     if (badcheck) goto bad;
     return mrb_fixnum_value(0);
   }
   if (base <= 0) {
-    if (str[0] == '0') {
-      switch (str[1]) {
+    if (str < e && str[0] == '0') {
+      switch (str + 1 < e ? str[1] : '\0') {
         case 'x': case 'X':
           base = 16;
           break;
@@ -1937,28 +2073,29 @@ mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
       base = 10;
     }
   }
+  c = e - str >= 2 && str[0] == '0' ? str[1] : '\0';
   switch (base) {
     case 2:
-      if (str[0] == '0' && (str[1] == 'b'||str[1] == 'B')) {
+      if (c == 'b' || c == 'B') {
         str += 2;
       }
       break;
     case 3:
       break;
     case 8:
-      if (str[0] == '0' && (str[1] == 'o'||str[1] == 'O')) {
+      if (c == 'o' || c == 'O') {
         str += 2;
       }
     case 4: case 5: case 6: case 7:
       break;
     case 10:
-      if (str[0] == '0' && (str[1] == 'd'||str[1] == 'D')) {
+      if (c == 'd' || c == 'D') {
         str += 2;
       }
     case 9: case 11: case 12: case 13: case 14: case 15:
       break;
     case 16:
-      if (str[0] == '0' && (str[1] == 'x'||str[1] == 'X')) {
+      if (c == 'x' || c == 'X') {
         str += 2;
       }
       break;
@@ -1968,9 +2105,9 @@ mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
       }
       break;
   } /* end of switch (base) { */
-  if (*str == '0') {    /* squeeze preceeding 0s */
+  if (str < e && *str == '0') {    /* squeeze preceeding 0s */
     int us = 0;
-    while ((c = *++str) == '0' || c == '_') {
+    while (++str < e && ((c = *str) == '0' || c == '_')) {
       if (c == '_') {
         if (++us >= 2)
           break;
@@ -1978,66 +2115,61 @@ mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
       else
         us = 0;
     }
-    if (!(c = *str) || ISSPACE(c)) --str;
+    if (str == e || ISSPACE(*str)) --str;
   }
-  c = *str;
+  c = str < e ? *str : '\0';
   c = conv_digit(c);
   if (c < 0 || c >= base) {
     if (badcheck) goto bad;
     return mrb_fixnum_value(0);
   }
 
-  n = strtoul((char*)str, &end, base);
-  if (n > MRB_INT_MAX) {
-    mrb_raisef(mrb, E_ARGUMENT_ERROR, "string (%S) too big for integer", mrb_str_new_cstr(mrb, str));
+  if (!mrb_read_int(str, e, base, &val, &end)) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "string (%S) too big for integer", mrb_str_new(mrb, str, end - str));
   }
-  val = n;
   if (badcheck) {
-    if (end == str) goto bad; /* no number */
-    while (*end && ISSPACE(*end)) end++;
-    if (*end) goto bad;        /* trailing garbage */
+    while (end < e && ISSPACE(*end)) end++;
+    if (end < e) goto bad;        /* trailing garbage */
   }
 
   return mrb_fixnum_value(sign ? val : -val);
 bad:
-  mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid string for number(%S)", mrb_str_new_cstr(mrb, str));
+  mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid string for number(%S)", mrb_str_new(mrb, str, e - str));
   /* not reached */
   return mrb_fixnum_value(0);
 }
 
+mrb_value
+mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
+{
+  return mrb_str_len_to_inum(mrb, str, str ? strlen(str) : 0, base, badcheck);
+}
+
 char *
 mrb_string_value_cstr(mrb_state *mrb, mrb_value *ptr)
 {
   struct RString *ps = mrb_str_ptr(*ptr);
   char *s = ps->ptr;
 
-  if (!s || ps->len != strlen(s)) {
+  if (!s || memchr(s, '\0', ps->len)) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "string contains null byte");
   }
+  if (s[ps->len] != '\0') {
+    /* a substring sharing a longer buffer */
+    *ptr = mrb_str_new(mrb, s, ps->len);
+    s = RSTRING_PTR(*ptr);
+  }
   return s;
 }
 
 mrb_value
 mrb_str_to_inum(mrb_state *mrb, mrb_value str, int base, int badcheck)
 {
-  char *s;
-  int len;
-
   str = mrb_str_to_str(mrb, str);
   if (badcheck) {
-    s = mrb_string_value_cstr(mrb, &str);
-  }
-  else {
-    s = RSTRING_PTR(str);
+    mrb_string_value_cstr(mrb, &str);
   }
-  if (s) {
-    len = RSTRING_LEN(str);
-    if (s[len]) {    /* no sentinel somehow */
-      struct RString *temp_str = str_new(mrb, s, len);
-      s = temp_str->ptr;
-    }
-  }
-  return mrb_cstr_to_inum(mrb, s, base, badcheck);
+  return mrb_str_len_to_inum(mrb, RSTRING_PTR(str), RSTRING_LEN(str), base, badcheck);
 }
 
 /* 15.2.10.5.38 */
@@ -2081,93 +2213,85 @@ mrb_str_to_i(mrb_state *mrb, mrb_value self)
 }
 
 double
-mrb_cstr_to_dbl(mrb_state *mrb, const char * p, int badcheck)
+mrb_str_len_to_dbl(mrb_state *mrb, const char *p, size_t len, int badcheck)
 {
-  char *end;
+  const char *e = p + len;
+  const char *end;
   double d;
 #if !defined(DBL_DIG)
 # define DBL_DIG 16
 #endif
 
-  enum {max_width = 20};
-#define OutOfRange() (((w = end - p) > max_width) ? \
-      (w = max_width, ellipsis = "...") : \
-      (w = (int)(end - p), ellipsis = ""))
-
   if (!p) return 0.0;
-  while (ISSPACE(*p)) p++;
+  while (p < e && ISSPACE(*p)) p++;
 
-  if (!badcheck && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+  if (!badcheck && e - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
     return 0.0;
   }
-  d = strtod(p, &end);
+  d = mrb_read_float(mrb, p, e, &end);
   if (p == end) {
     if (badcheck) {
 bad:
-      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid string for float(%S)", mrb_str_new_cstr(mrb, p));
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid string for float(%S)", mrb_str_new(mrb, p, e - p));
       /* not reached */
     }
     return d;
   }
-  if (*end) {
+  if (end < e && *end) {
     char buf[DBL_DIG * 4 + 10];
     char *n = buf;
-    char *e = buf + sizeof(buf) - 1;
+    char *b = buf + sizeof(buf) - 1;
     char prev = 0;
 
-    while (p < end && n < e) prev = *n++ = *p++;
-    while (*p) {
+    while (p < end && n < b) prev = *n++ = *p++;
+    while (p < e && *p) {
       if (*p == '_') {
         /* remove underscores between digits */
         if (badcheck) {
           if (n == buf || !ISDIGIT(prev)) goto bad;
           ++p;
-          if (!ISDIGIT(*p)) goto bad;
+          if (p == e || !ISDIGIT(*p)) goto bad;
         }
         else {
-          while (*++p == '_');
+          while (++p < e && *p == '_');
           continue;
         }
       }
       prev = *p++;
-      if (n < e) *n++ = prev;
+      if (n < b) *n++ = prev;
     }
     *n = '\0';
     p = buf;
+    e = n;
 
     if (!badcheck && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
       return 0.0;
     }
 
-    d = strtod(p, &end);
+    d = mrb_read_float(mrb, p, e, &end);
     if (badcheck) {
-      if (!end || p == end) goto bad;
-      while (*end && ISSPACE(*end)) end++;
-      if (*end) goto bad;
+      if (p == end) goto bad;
+      while (end < e && ISSPACE(*end)) end++;
+      if (end < e) goto bad;
     }
   }
   return d;
 }
 
 double
-mrb_str_to_dbl(mrb_state *mrb, mrb_value str, int badcheck)
+mrb_cstr_to_dbl(mrb_state *mrb, const char * p, int badcheck)
 {
-  char *s;
-  int len;
+  return mrb_str_len_to_dbl(mrb, p, p ? strlen(p) : 0, badcheck);
+}
 
+double
+mrb_str_to_dbl(mrb_state *mrb, mrb_value str, int badcheck)
+{
   str = mrb_str_to_str(mrb, str);
-  s = RSTRING_PTR(str);
-  len = RSTRING_LEN(str);
-  if (s) {
-    if (badcheck && memchr(s, '\0', len)) {
-      mrb_raise(mrb, E_ARGUMENT_ERROR, "string for Float contains null byte");
-    }
-    if (s[len]) {    /* no sentinel somehow */
-      struct RString *temp_str = str_new(mrb, s, len);
-      s = temp_str->ptr;
-    }
+  if (badcheck && memchr(RSTRING_PTR(str), '\0', RSTRING_LEN(str))) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "string for Float contains null byte");
   }
-  return mrb_cstr_to_dbl(mrb, s, badcheck);
+  return mrb_str_len_to_dbl(mrb, RSTRING_PTR(str), RSTRING_LEN(str), badcheck);
 }
 
 /* 15.2.10.5.39 */
@@ -2388,6 +2512,19 @@ mrb_str_cat(mrb_state *mrb, mrb_value str, const char *ptr, size_t len)
   return str;
 }
 
+/* appends n written in base, without a temporary String */
+mrb_value
+mrb_str_cat_int(mrb_state *mrb, mrb_value str, mrb_int n, int base)
+{
+  char buf[MRB_NUM_BUF_SIZE];
+
+  if (base < 2 || 36 < base) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid radix %S", mrb_fixnum_value(base));
+  }
+  str_buf_cat(mrb, mrb_str_ptr(str), buf, mrb_fixnum_to_buf(n, base, buf));
+  return str;
+}
+
 mrb_value
 mrb_str_cat_cstr(mrb_state *mrb, mrb_value str, const char *ptr)
 {
@@ -2490,6 +2627,91 @@ mrb_str_bytes(mrb_state *mrb, mrb_value str)
   return a;
 }
 
+/*
+ *  call-seq:
+ *     str.succ!   -> str
+ *     str.next!   -> str
+ *
+ *  Replaces _str_ with its successor: the rightmost alphanumeric is
+ *  incremented, carrying into alphanumerics to its left; a string
+ *  without any alphanumerics has its last byte incremented instead.
+ *
+ *     "az".succ!      #=> "ba"
+ *     "zz99".succ!    #=> "aaa00"
+ *     "a-9".succ!     #=> "b-0"
+ */
+static mrb_value
+mrb_str_succ_bang(mrb_state *mrb, mrb_value str)
+{
+  struct RString *s = mrb_str_ptr(str);
+  mrb_int i, pos, len = s->len;
+  char carry;
+  unsigned char *p;
+
+  if (len == 0) return str;
+  mrb_str_modify(mrb, s);
+  p = (unsigned char *)s->ptr;
+  for (pos = len - 1; pos >= 0 && !ISALNUM(p[pos]); pos--)
+    ;
+  if (pos < 0) {
+    for (i = len - 1; i >= 0; i--) {
+      if (++p[i] != 0) return str;
+    }
+    pos = 0;
+    carry = '\1';
+  }
+  else {
+    for (;;) {
+      switch (p[pos]) {
+      case '9': p[pos] = '0'; carry = '1'; break;
+      case 'z': p[pos] = 'a'; carry = 'a'; break;
+      case 'Z': p[pos] = 'A'; carry = 'A'; break;
+      default:
+        p[pos]++;
+        return str;
+      }
+      for (i = pos - 1; i >= 0 && !ISALNUM(p[i]); i--)
+        ;
+      if (i < 0) break;
+      pos = i;
+    }
+  }
+  mrb_str_resize(mrb, str, len + 1);
+  memmove(s->ptr + pos + 1, s->ptr + pos, len - pos);
+  s->ptr[pos] = carry;
+  return str;
+}
+
+/*
+ *  call-seq:
+ *     str.succ   -> new_str
+ *     str.next   -> new_str
+ *
+ *  Returns the successor to _str_ (see String#succ!).
+ *
+ *     "abcd".succ   #=> "abce"
+ *     "1.9".succ    #=> "2.0"
+ */
+static mrb_value
+mrb_str_succ(mrb_state *mrb, mrb_value self)
+{
+  return mrb_str_succ_bang(mrb, mrb_str_dup(mrb, self));
+}
+
+/*
+ *  call-seq:
+ *     str.freeze   -> str
+ *
+ *  Prevents further modifications to _str_.  A frozen string raises
+ *  RuntimeError from every destructive method.
+ */
+static mrb_value
+mrb_str_freeze(mrb_state *mrb, mrb_value str)
+{
+  MRB_SET_FROZEN_FLAG(mrb_str_ptr(str));
+  return str;
+}
+
 /* ---------------------------*/
 void
 mrb_init_string(mrb_state *mrb)
@@ -2543,6 +2765,11 @@ mrb_init_string(mrb_state *mrb)
   mrb_define_method(mrb, s, "upcase!",         mrb_str_upcase_bang,     MRB_ARGS_REQ(1)); /* 15.2.10.5.43 */
   mrb_define_method(mrb, s, "inspect",         mrb_str_inspect,         MRB_ARGS_NONE()); /* 15.2.10.5.46(x) */
   mrb_define_method(mrb, s, "bytes",           mrb_str_bytes,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "succ",            mrb_str_succ,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "succ!",           mrb_str_succ_bang,       MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "next",            mrb_str_succ,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "next!",           mrb_str_succ_bang,       MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "freeze",          mrb_str_freeze,          MRB_ARGS_NONE());
 
   mrb_gv_set(mrb, mrb_intern_lit(mrb, "$;"), mrb_nil_value());
 }
@@ -168,6 +168,10 @@ void
 mrb_init_symtbl(mrb_state *mrb)
 {
   mrb->name2sym = kh_init(n2s, mrb);
+  mrb->sym_hash = mrb_intern_lit(mrb, "hash");
+  mrb->sym_eq = mrb_intern_lit(mrb, "==");
+  mrb->sym_eql = mrb_intern_lit(mrb, "eql?");
+  mrb->sym_cmp = mrb_intern_lit(mrb, "<=>");
 }
 
 /**********************************************************************
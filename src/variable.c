@@ -7,6 +7,7 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/gc.h"
 #include "mruby/proc.h"
 #include "mruby/string.h"
 #include "mruby/variable.h"
@@ -290,6 +291,22 @@ iv_free(mrb_state *mrb, iv_tbl *t)
   mrb_free(mrb, t);
 }
 
+static void
+iv_update(mrb_state *mrb, iv_tbl *t)
+{
+  segment *seg;
+  size_t i;
+
+  for (seg = t->rootseg; seg; seg = seg->next) {
+    for (i=0; i<MRB_SEGMENT_SIZE; i++) {
+      if (!seg->next && i >= t->last_len) return;
+      if (seg->key[i] != 0) {
+        mrb_gc_update_value(mrb, &seg->val[i]);
+      }
+    }
+  }
+}
+
 #else
 
 #include "mruby/khash.h"
@@ -395,6 +412,19 @@ iv_free(mrb_state *mrb, iv_tbl *t)
   kh_destroy(iv, mrb, &t->h);
 }
 
+static void
+iv_update(mrb_state *mrb, iv_tbl *t)
+{
+  khash_t(iv) *h = &t->h;
+  khiter_t k;
+
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      mrb_gc_update_value(mrb, &kh_value(h, k));
+    }
+  }
+}
+
 #endif
 
 static int
@@ -418,6 +448,14 @@ mrb_gc_mark_gv(mrb_state *mrb)
   mark_tbl(mrb, mrb->globals);
 }
 
+/* redirects references to objects moved by mrb_gc_compact() */
+void
+mrb_gc_update_gv(mrb_state *mrb)
+{
+  if (mrb->globals)
+    iv_update(mrb, mrb->globals);
+}
+
 void
 mrb_gc_free_gv(mrb_state *mrb)
 {
@@ -431,6 +469,14 @@ mrb_gc_mark_iv(mrb_state *mrb, struct RObject *obj)
   mark_tbl(mrb, obj->iv);
 }
 
+void
+mrb_gc_update_iv(mrb_state *mrb, struct RObject *obj)
+{
+  if (obj->iv) {
+    iv_update(mrb, obj->iv);
+  }
+}
+
 size_t
 mrb_gc_mark_iv_size(mrb_state *mrb, struct RObject *obj)
 {
@@ -499,7 +545,7 @@ mrb_obj_iv_set(mrb_state *mrb, struct RObject *obj, mrb_sym sym, mrb_value v)
   if (!t) {
     t = obj->iv = iv_new(mrb);
   }
-  mrb_write_barrier(mrb, (struct RBasic*)obj);
+  mrb_field_write_barrier_value(mrb, (struct RBasic*)obj, v);
   iv_put(mrb, t, sym, v);
 }
 
@@ -514,7 +560,7 @@ mrb_obj_iv_ifnone(mrb_state *mrb, struct RObject *obj, mrb_sym sym, mrb_value v)
   else if (iv_get(mrb, t, sym, &v)) {
     return;
   }
-  mrb_write_barrier(mrb, (struct RBasic*)obj);
+  mrb_field_write_barrier_value(mrb, (struct RBasic*)obj, v);
   iv_put(mrb, t, sym, v);
 }
 
@@ -771,7 +817,7 @@ mrb_mod_cv_set(mrb_state *mrb, struct RClass *c, mrb_sym sym, mrb_value v)
       iv_tbl *t = c->iv;
 
       if (iv_get(mrb, t, sym, NULL)) {
-        mrb_write_barrier(mrb, (struct RBasic*)c);
+        mrb_field_write_barrier_value(mrb, (struct RBasic*)c, v);
         iv_put(mrb, t, sym, v);
         return;
       }
@@ -783,7 +829,7 @@ mrb_mod_cv_set(mrb_state *mrb, struct RClass *c, mrb_sym sym, mrb_value v)
     cls->iv = iv_new(mrb);
   }
 
-  mrb_write_barrier(mrb, (struct RBasic*)cls);
+  mrb_field_write_barrier_value(mrb, (struct RBasic*)cls, v);
   iv_put(mrb, cls->iv, sym, v);
 }
 
@@ -1085,7 +1131,7 @@ mrb_f_global_variables(mrb_state *mrb, mrb_value self)
   buf[2] = 0;
   for (i = 1; i <= 9; ++i) {
     buf[1] = (char)(i + '0');
-    mrb_ary_push(mrb, ary, mrb_symbol_value(mrb_intern_lit(mrb, buf)));
+    mrb_ary_push(mrb, ary, mrb_symbol_value(mrb_intern(mrb, buf, 2)));
   }
   return ary;
 }
@@ -11,6 +11,7 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/gc.h"
 #include "mruby/hash.h"
 #include "mruby/irep.h"
 #include "mruby/numeric.h"
@@ -232,23 +233,45 @@ cipush(mrb_state *mrb)
   ci->env = 0;
   ci->pc = 0;
   ci->err = 0;
+  ci->kwc = 0;
 
   return ci;
 }
 
+/* detach env from the frame that is going away */
+static void
+env_unshare(mrb_state *mrb, struct REnv *e)
+{
+  size_t len = (size_t)MRB_ENV_STACK_LEN(e);
+  mrb_value *p;
+  size_t i;
+
+  e->cioff = -1;
+  if (!MRB_ENV_ESCAPED_P(e)) {
+    /* only blocks that never escaped refer to this env; none of them
+       can be called after the frame returns, so skip the copy */
+    MRB_ENV_SET_STACK_LEN(e, 0);
+    e->stack = NULL;
+    return;
+  }
+  p = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*len);
+  stack_copy(p, e->stack, len);
+  e->stack = p;
+  /* blocks held by the captured frame outlive it as well */
+  for (i=0; i<len; i++) {
+    if (mrb_type(p[i]) == MRB_TT_PROC) {
+      mrb_proc_escape(mrb, mrb_proc_ptr(p[i]));
+    }
+  }
+}
+
 static void
 cipop(mrb_state *mrb)
 {
   struct mrb_context *c = mrb->c;
 
   if (c->ci->env) {
-    struct REnv *e = c->ci->env;
-    size_t len = (size_t)e->flags;
-    mrb_value *p = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*len);
-
-    e->cioff = -1;
-    stack_copy(p, e->stack, len);
-    e->stack = p;
+    env_unshare(mrb, c->ci->env);
   }
 
   c->ci--;
@@ -281,72 +304,113 @@ ecall(mrb_state *mrb, int i)
   if (!mrb->exc) mrb->exc = exc;
 }
 
+/* the running fiber has finished; switch back to the context that resumed it
+   and return the finished context to the pool right away */
+static void
+fiber_terminate(mrb_state *mrb)
+{
+  struct mrb_context *c = mrb->c;
+  struct RFiber *f = c->fib;
+  mrb_callinfo *ci;
+
+  for (ci = c->cibase; ci <= c->ci; ci++) {
+    if (ci->env) {
+      env_unshare(mrb, ci->env);
+      ci->env = NULL;
+    }
+  }
+  c->status = MRB_FIBER_TERMINATED;
+  mrb->c = c->prev;
+  c->prev = NULL;
+  mrb->c->status = MRB_FIBER_RUNNING;
+  if (f) {
+    f->cxt = NULL;
+    f->flags |= MRB_FIBER_DEAD;
+    mrb_context_recycle(mrb, c);
+  }
+}
+
 #ifndef MRB_FUNCALL_ARGC_MAX
 #define MRB_FUNCALL_ARGC_MAX 16
 #endif
 
-mrb_value
-mrb_funcall(mrb_state *mrb, mrb_value self, const char *name, int argc, ...)
+static mrb_value
+funcall_va(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, va_list ap)
 {
-  mrb_sym mid = mrb_intern_cstr(mrb, name);
+  mrb_value argv[MRB_FUNCALL_ARGC_MAX];
+  int i;
 
-  if (argc == 0) {
-    return mrb_funcall_argv(mrb, self, mid, 0, 0);
+  if (argc > MRB_FUNCALL_ARGC_MAX) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "Too long arguments. (limit=" TO_STR(MRB_FUNCALL_ARGC_MAX) ")");
   }
-  else if (argc == 1) {
-    mrb_value v;
-    va_list ap;
-
-    va_start(ap, argc);
-    v = va_arg(ap, mrb_value);
-    va_end(ap);
-    return mrb_funcall_argv(mrb, self, mid, 1, &v);
+  for (i = 0; i < argc; i++) {
+    argv[i] = va_arg(ap, mrb_value);
   }
-  else {
-    mrb_value argv[MRB_FUNCALL_ARGC_MAX];
-    va_list ap;
-    int i;
+  return mrb_funcall_argv(mrb, self, mid, argc, argv);
+}
 
-    if (argc > MRB_FUNCALL_ARGC_MAX) {
-      mrb_raise(mrb, E_ARGUMENT_ERROR, "Too long arguments. (limit=" TO_STR(MRB_FUNCALL_ARGC_MAX) ")");
-    }
+mrb_value
+mrb_funcall(mrb_state *mrb, mrb_value self, const char *name, int argc, ...)
+{
+  mrb_sym mid = mrb_intern_cstr(mrb, name);
+  mrb_value val;
+  va_list ap;
 
-    va_start(ap, argc);
-    for (i = 0; i < argc; i++) {
-      argv[i] = va_arg(ap, mrb_value);
-    }
-    va_end(ap);
-    return mrb_funcall_argv(mrb, self, mid, argc, argv);
-  }
+  va_start(ap, argc);
+  val = funcall_va(mrb, self, mid, argc, ap);
+  va_end(ap);
+  return val;
 }
 
+/* same as mrb_funcall, for callers that intern the name once */
 mrb_value
-mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mrb_value *argv, mrb_value blk)
+mrb_funcall_id(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, ...)
+{
+  mrb_value val;
+  va_list ap;
+
+  va_start(ap, argc);
+  val = funcall_va(mrb, self, mid, argc, ap);
+  va_end(ap);
+  return val;
+}
+
+/*
+ * Calls method p (looked up as mid, found in class c) on self.
+ * A NULL p dispatches to method_missing.
+ */
+static mrb_value
+funcall_method(mrb_state *mrb, mrb_value self, mrb_sym mid, struct RClass *c, struct RProc *p,
+               int argc, mrb_value *argv, mrb_value blk)
 {
   mrb_value val;
 
   if (!mrb->jmp) {
     jmp_buf c_jmp;
     mrb_callinfo *old_ci = mrb->c->ci;
+#ifdef MRB_GC_ARENA_DEBUG
+    int scope_depth = mrb->arena_scope_depth;
+#endif
 
     if (setjmp(c_jmp) != 0) { /* error */
       while (old_ci != mrb->c->ci) {
         mrb->c->stack = mrb->c->stbase + mrb->c->ci->stackidx;
         cipop(mrb);
       }
+#ifdef MRB_GC_ARENA_DEBUG
+      mrb->arena_scope_depth = scope_depth;
+#endif
       mrb->jmp = 0;
       val = mrb_obj_value(mrb->exc);
     }
     else {
       mrb->jmp = &c_jmp;
       /* recursive call */
-      val = mrb_funcall_with_block(mrb, self, mid, argc, argv, blk);
+      val = funcall_method(mrb, self, mid, c, p, argc, argv, blk);
       mrb->jmp = 0;
     }
   }
   else {
-    struct RProc *p;
-    struct RClass *c;
     mrb_sym undef = 0;
     mrb_callinfo *ci;
     int n;
@@ -358,8 +422,6 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mr
     if (argc < 0) {
       mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative argc for funcall (%S)", mrb_fixnum_value(argc));
     }
-    c = mrb_class(mrb, self);
-    p = mrb_method_search_vm(mrb, &c, mid);
     if (!p) {
       undef = mid;
       mid = mrb_intern_lit(mrb, "method_missing");
@@ -409,12 +471,93 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mr
   return val;
 }
 
+mrb_value
+mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mrb_value *argv, mrb_value blk)
+{
+  struct RClass *c = mrb_class(mrb, self);
+  struct RProc *p = mrb_method_search_vm(mrb, &c, mid);
+
+  return funcall_method(mrb, self, mid, c, p, argc, argv, blk);
+}
+
 mrb_value
 mrb_funcall_argv(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mrb_value *argv)
 {
   return mrb_funcall_with_block(mrb, self, mid, argc, argv, mrb_nil_value());
 }
 
+void
+mrb_call_handle_init(mrb_state *mrb, mrb_call_handle *h, mrb_sym mid)
+{
+  h->mid = mid;
+  h->serial = 0;
+  h->klass = NULL;
+  h->owner = NULL;
+  h->proc = NULL;
+}
+
+/*
+ * Like mrb_funcall_argv, but reuses the method found by the previous
+ * call through h as long as the receiver has the same class and no
+ * method table changed since (mrb->method_serial).
+ */
+mrb_value
+mrb_funcall_handle(mrb_state *mrb, mrb_call_handle *h, mrb_value self, int argc, mrb_value *argv)
+{
+  struct RClass *c = mrb_class(mrb, self);
+
+  if (h->klass != c || h->serial != mrb->method_serial) {
+    h->klass = c;
+    h->proc = mrb_method_search_vm(mrb, &c, h->mid);
+    h->owner = c;
+    h->serial = mrb->method_serial;
+  }
+  return funcall_method(mrb, self, h->mid, h->owner, h->proc, argc, argv, mrb_nil_value());
+}
+
+/*
+ * Runs body(mrb, data) with a single jump buffer installed, so the
+ * mrb_funcall family called inside does not set up its own on every
+ * call.  If an exception escapes, *state is set to TRUE and the
+ * exception is returned instead of being left in mrb->exc.
+ */
+mrb_value
+mrb_protect(mrb_state *mrb, mrb_func_t body, mrb_value data, mrb_bool *state)
+{
+  void *prev_jmp = mrb->jmp;
+  struct mrb_context *c = mrb->c;
+  mrb_callinfo *old_ci = c->ci;
+  int ai = mrb_gc_arena_save(mrb);
+#ifdef MRB_GC_ARENA_DEBUG
+  int scope_depth = mrb->arena_scope_depth;
+#endif
+  jmp_buf c_jmp;
+  mrb_value val;
+
+  if (setjmp(c_jmp) != 0) {
+    mrb->c = c;
+    while (old_ci != c->ci) {
+      c->stack = c->stbase + c->ci->stackidx;
+      cipop(mrb);
+    }
+    mrb_gc_arena_restore(mrb, ai);
+#ifdef MRB_GC_ARENA_DEBUG
+    mrb->arena_scope_depth = scope_depth;
+#endif
+    val = mrb_obj_value(mrb->exc);
+    mrb->exc = NULL;
+    mrb_gc_protect(mrb, val);
+    if (state) *state = TRUE;
+  }
+  else {
+    mrb->jmp = &c_jmp;
+    val = body(mrb, data);
+    if (state) *state = FALSE;
+  }
+  mrb->jmp = prev_jmp;
+  return val;
+}
+
 mrb_value
 mrb_yield_internal(mrb_state *mrb, mrb_value b, int argc, mrb_value *argv, mrb_value self, struct RClass *c)
 {
@@ -518,8 +661,48 @@ argnum_error(mrb_state *mrb, int num)
   mrb->exc = mrb_obj_ptr(exc);
 }
 
+static void
+kwarg_error(mrb_state *mrb, const char *msg, mrb_value key)
+{
+  mrb_value str;
+
+  if (mrb_symbol_p(key)) {
+    key = mrb_sym2str(mrb, mrb_symbol(key));
+  }
+  else {
+    key = mrb_inspect(mrb, key);
+  }
+  str = mrb_format(mrb, "%S: %S", mrb_str_new_cstr(mrb, msg), key);
+  mrb->exc = mrb_obj_ptr(mrb_exc_new_str(mrb, E_ARGUMENT_ERROR, str));
+}
+
+/* methods that take keyword arguments (see OP_SENDK) */
+static inline mrb_bool
+kwargs_irep_p(mrb_irep *irep, int argc)
+{
+  mrb_aspec ax;
+
+  if (irep->ilen == 0 || GET_OPCODE(irep->iseq[0]) != OP_ENTER) return FALSE;
+  ax = GETARG_Ax(irep->iseq[0]);
+  if (!MRB_ASPEC_KEY(ax) && !MRB_ASPEC_KDICT(ax)) return FALSE;
+  /* a keyword hash fills a missing mandatory argument instead */
+  return argc >= MRB_ASPEC_REQ(ax) + MRB_ASPEC_POST(ax);
+}
+
 #define ERR_PC_SET(mrb, pc) mrb->c->ci->err = pc;
 #define ERR_PC_CLR(mrb)     mrb->c->ci->err = 0;
+/* run an allocating statement; its pc is published in ci->err for the
+   allocation hook only when one is installed */
+#define ALLOC_PC(mrb, pc, stmt) do {\
+  if ((mrb)->alloc_hook) {\
+    ERR_PC_SET(mrb, pc);\
+    stmt;\
+    ERR_PC_CLR(mrb);\
+  }\
+  else {\
+    stmt;\
+  }\
+} while (0)
 #ifdef ENABLE_DEBUG
 #define CODE_FETCH_HOOK(mrb, irep, pc, regs) if ((mrb)->code_fetch_hook) (mrb)->code_fetch_hook((mrb), (irep), (pc), (regs));
 #else
@@ -554,6 +737,119 @@ void mrb_gv_val_set(mrb_state *mrb, mrb_sym sym, mrb_value val);
 
 #define CALL_MAXARGS 127
 
+#define STRCATN_BUF_SIZE 1024
+
+/*
+ * OP_STRCATN: joins the n registers from b into one new String.
+ * Strings and nil are copied, Symbol names and formatted Fixnums and
+ * Floats go through a scratch buffer, unless their class redefines
+ * to_s; anything else goes through to_str/to_s first, before any
+ * length is taken, since that runs Ruby code.  The result is then the only object allocated unless
+ * the scratch buffer fills up.
+ */
+static mrb_value
+str_cat_regs(mrb_state *mrb, int b, int n)
+{
+  char buf[STRCATN_BUF_SIZE];
+  uint16_t buflen[MAXARG_C];
+  size_t pos = 0, len = 0, l;
+  mrb_value str;
+  char *p;
+  int i;
+  unsigned checked = 0, overridden = 0;
+
+  for (i = 0; i < n; i++) {
+    mrb_value v = mrb->c->stack[b+i];
+    int t = mrb_type(v);
+
+    switch (t) {
+    case MRB_TT_STRING:
+      break;
+    case MRB_TT_FALSE:
+      if (!mrb_nil_p(v)) {
+        mrb->c->stack[b+i] = mrb_str_to_str(mrb, v);
+        break;
+      }
+      /* fall through */
+    case MRB_TT_SYMBOL: case MRB_TT_FIXNUM: case MRB_TT_FLOAT:
+      /* formatted below only while the class keeps its builtin to_s;
+         checked once per type */
+      if (!(checked & (1 << t))) {
+        checked |= 1 << t;
+        if (!mrb_builtin_to_s_p(mrb, v)) overridden |= 1 << t;
+      }
+      if (overridden & (1 << t)) {
+        mrb->c->stack[b+i] = mrb_obj_as_string(mrb, v);
+      }
+      break;
+    default:
+      mrb->c->stack[b+i] = mrb_str_to_str(mrb, v);
+      break;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    mrb_value v = mrb->c->stack[b+i];
+    const char *name;
+
+    switch (mrb_type(v)) {
+    case MRB_TT_STRING:
+      len += RSTRING_LEN(v);
+      break;
+    case MRB_TT_SYMBOL:
+      name = mrb_sym2name_len(mrb, mrb_symbol(v), &l);
+      if (pos + l <= sizeof(buf)) {
+        memcpy(buf+pos, name, l);
+        buflen[i] = (uint16_t)l;
+        pos += l;
+      }
+      else {
+        mrb->c->stack[b+i] = mrb_str_new(mrb, name, l);
+      }
+      len += l;
+      break;
+    case MRB_TT_FIXNUM: case MRB_TT_FLOAT:
+      if (pos + MRB_NUM_BUF_SIZE <= sizeof(buf)) {
+        if (mrb_fixnum_p(v)) l = mrb_fixnum_to_buf(mrb_fixnum(v), 10, buf+pos);
+        else l = mrb_flo_to_buf(mrb_float(v), buf+pos);
+        buflen[i] = (uint16_t)l;
+        pos += l;
+      }
+      else {
+        v = mrb_fixnum_p(v) ? mrb_fixnum_to_str(mrb, v, 10) : mrb_flo_to_str(mrb, v);
+        mrb->c->stack[b+i] = v;
+        l = RSTRING_LEN(v);
+      }
+      len += l;
+      break;
+    default:                    /* nil */
+      break;
+    }
+  }
+
+  str = mrb_str_new(mrb, NULL, len);
+  p = RSTRING_PTR(str);
+  pos = 0;
+  for (i = 0; i < n; i++) {
+    mrb_value v = mrb->c->stack[b+i];
+
+    switch (mrb_type(v)) {
+    case MRB_TT_STRING:
+      memcpy(p, RSTRING_PTR(v), RSTRING_LEN(v));
+      p += RSTRING_LEN(v);
+      break;
+    case MRB_TT_SYMBOL: case MRB_TT_FIXNUM: case MRB_TT_FLOAT:
+      memcpy(p, buf+pos, buflen[i]);
+      pos += buflen[i];
+      p += buflen[i];
+      break;
+    default:
+      break;
+    }
+  }
+  return str;
+}
+
 mrb_value
 mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int stack_keep)
 {
@@ -565,6 +861,9 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
   mrb_value *regs = NULL;
   mrb_code i;
   int ai = mrb_gc_arena_save(mrb);
+#ifdef MRB_GC_ARENA_DEBUG
+  int scope_depth = mrb->arena_scope_depth;
+#endif
   jmp_buf *prev_jmp = (jmp_buf *)mrb->jmp;
   jmp_buf c_jmp;
 
@@ -590,6 +889,7 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
     &&L_OP_CLASS, &&L_OP_MODULE, &&L_OP_EXEC,
     &&L_OP_METHOD, &&L_OP_SCLASS, &&L_OP_TCLASS,
     &&L_OP_DEBUG, &&L_OP_STOP, &&L_OP_ERR,
+    &&L_OP_STRCATN, &&L_OP_SENDK,
   };
 #endif
 
@@ -598,6 +898,10 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
     mrb->jmp = &c_jmp;
   }
   else {
+#ifdef MRB_GC_ARENA_DEBUG
+    /* C frames unwound by the raise may have left their scopes open */
+    mrb->arena_scope_depth = scope_depth;
+#endif
     goto L_RAISE;
   }
   if (!mrb->c->stack) {
@@ -841,6 +1145,8 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
       struct RProc *p;
 
       p = mrb_closure_new(mrb, irep->reps[GETARG_Bx(i)]);
+      /* ensure clauses may run after the frame is popped */
+      mrb_proc_escape(mrb, p);
       /* push ensure_stack */
       if (mrb->c->esize <= mrb->c->ci->eidx) {
         if (mrb->c->esize == 0) mrb->c->esize = 16;
@@ -912,6 +1218,37 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
           regs[a+1] = sym;
         }
       }
+      else if (m->flags & (MRB_PROC_IVGET|MRB_PROC_IVSET)) {
+        /* attribute accessor; skip the call frame */
+        mrb_sym ivname = mrb_symbol(m->env->stack[0]);
+
+        if ((m->flags & MRB_PROC_IVGET) && n == 0) {
+          regs[a] = mrb_iv_get(mrb, recv, ivname);
+          NEXT;
+        }
+        if ((m->flags & MRB_PROC_IVSET) && n == 1) {
+          mrb_iv_set(mrb, recv, ivname, regs[a+1]);
+          regs[a] = regs[a+1];
+          NEXT;
+        }
+      }
+      else if ((m->flags & (MRB_PROC_AREF|MRB_PROC_ASET)) && mrb_array_p(recv)) {
+        /* slot accessor (e.g. Struct member); skip the call frame */
+        struct RArray *ary = mrb_ary_ptr(recv);
+        mrb_int idx = mrb_fixnum(m->env->stack[0]);
+
+        if (idx < ary->len) {
+          if ((m->flags & MRB_PROC_AREF) && n == 0) {
+            regs[a] = ary->ptr[idx];
+            NEXT;
+          }
+          if ((m->flags & MRB_PROC_ASET) && n == 1) {
+            mrb_ary_set(mrb, recv, idx, regs[a+1]);
+            regs[a] = regs[a+1];
+            NEXT;
+          }
+        }
+      }
 
       /* push callinfo */
       ci = cipush(mrb);
@@ -981,6 +1318,68 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
       }
     }
 
+    CASE(OP_SENDK) {
+      /* A B C  R(A) := call(R(A),Sym(B),R(A+1),...,k1: R(A+n+1),...,&R(A+n+k+1)) */
+      /* C = k<<4|n; the keyword names are Sym(B+1)...Sym(B+k) */
+      int a = GETARG_A(i);
+      int b = GETARG_B(i);
+      int n = SENDK_ARGC(GETARG_C(i));
+      int k = SENDK_KWC(GETARG_C(i));
+      struct RProc *m;
+      struct RClass *c;
+      mrb_callinfo *ci;
+      mrb_value recv = regs[a];
+      mrb_sym mid = syms[b];
+
+      c = mrb_class(mrb, recv);
+      m = mrb_method_search_vm(mrb, &c, mid);
+      if (!m || MRB_PROC_CFUNC_P(m) || !kwargs_irep_p(m->body.irep, n)) {
+        /* the callee sees the keywords as a trailing Hash */
+        mrb_value hash = mrb_hash_new_capa(mrb, k);
+        int j;
+
+        for (j=0; j<k; j++) {
+          mrb_hash_set(mrb, hash, mrb_symbol_value(syms[b+1+j]), regs[a+n+1+j]);
+        }
+        regs[a+n+2] = regs[a+n+k+1];
+        regs[a+n+1] = hash;
+        ARENA_RESTORE(mrb, ai);
+        i = MKOP_ABC(OP_SENDB, a, b, n+1);
+        goto L_SEND;
+      }
+
+      /* push callinfo */
+      ci = cipush(mrb);
+      ci->mid = mid;
+      ci->proc = m;
+      ci->stackidx = mrb->c->stack - mrb->c->stbase;
+      ci->argc = n;
+      ci->kwc = k;
+      ci->kwsyms = &syms[b+1];
+      if (c->tt == MRB_TT_ICLASS) {
+        ci->target_class = c->c;
+      }
+      else {
+        ci->target_class = c;
+      }
+      ci->pc = pc + 1;
+      ci->acc = a;
+
+      /* prepare stack */
+      mrb->c->stack += a;
+
+      /* setup environment for calling method */
+      proc = m;
+      irep = m->body.irep;
+      pool = irep->pool;
+      syms = irep->syms;
+      ci->nregs = irep->nregs;
+      stack_extend(mrb, irep->nregs, n+k+2);
+      regs = mrb->c->stack;
+      pc = irep->iseq;
+      JUMP;
+    }
+
     CASE(OP_FSEND) {
       /* A B C  R(A) := fcall(R(A),Sym(B),R(A+1),... ,R(A+C)) */
       NEXT;
@@ -1179,23 +1578,44 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
       int o  = (ax>>13)&0x1f;
       int r  = (ax>>12)&0x1;
       int m2 = (ax>>7)&0x1f;
-      /* unused
       int k  = (ax>>2)&0x1f;
       int kd = (ax>>1)&0x1;
+      /* unused
       int b  = (ax>>0)& 0x1;
       */
       int argc = mrb->c->ci->argc;
+      int kwc = mrb->c->ci->kwc;
+      mrb_sym *kwsyms = mrb->c->ci->kwsyms;
       mrb_value *argv = regs+1;
       mrb_value *argv0 = argv;
       int len = m1 + o + r + m2;
-      mrb_value *blk = &argv[argc < 0 ? 1 : argc];
+      mrb_value *blk = &argv[argc < 0 ? 1 : argc + kwc];
+      mrb_value kwv[SENDK_MAXKW];
+      mrb_value kwhash = mrb_nil_value();
+      int j;
 
+      if (MRB_ASPEC_BLOCK(ax) && !MRB_ASPEC_NOESCAPE(ax) && mrb_type(*blk) == MRB_TT_PROC) {
+        /* block bound to a local that may be stored or returned */
+        mrb_proc_escape(mrb, mrb_proc_ptr(*blk));
+      }
       if (argc < 0) {
         struct RArray *ary = mrb_ary_ptr(regs[1]);
         argv = ary->ptr;
         argc = ary->len;
         mrb_gc_protect(mrb, regs[1]);
       }
+      if (kwc > 0) {
+        /* keyword values follow the arguments (OP_SENDK); the moves
+           below may overwrite them */
+        for (j=0; j<kwc; j++) {
+          kwv[j] = argv[argc+j];
+          mrb_gc_protect(mrb, kwv[j]);
+        }
+      }
+      else if ((k || kd) && argc > m1 + m2 && mrb_hash_p(argv[argc-1])) {
+        kwhash = argv[--argc];
+        mrb_gc_protect(mrb, kwhash);
+      }
       if (mrb->c->ci->proc && MRB_PROC_STRICT_P(mrb->c->ci->proc)) {
         if (argc >= 0) {
           if (argc < m1 + m2 || (r == 0 && argc > len)) {
@@ -1209,6 +1629,7 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
         argv = mrb_ary_ptr(argv[0])->ptr;
       }
       mrb->c->ci->argc = len;
+      mrb->c->ci->kwc = 0;
       if (argc < len) {
         regs[len+1] = *blk; /* move block */
         if (argv0 != argv) {
@@ -1246,13 +1667,80 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
         }
         pc += o + 1;
       }
+      if (k || kd) {
+        /* bind keywords by name; syms[0..k-1] are the parameter names */
+        mrb_value *kwp = &regs[len+2];
+        mrb_value rest = mrb_nil_value();
+
+        for (j=0; j<k; j++) {
+          kwp[j] = mrb_undef_value();
+        }
+        if (kwc > 0) {
+          for (j=0; j<kwc; j++) {
+            int x;
+
+            for (x=0; x<k; x++) {
+              if (syms[x] == kwsyms[j]) break;
+            }
+            if (x < k) {
+              kwp[x] = kwv[j];
+            }
+            else if (kd) {
+              if (mrb_nil_p(rest)) rest = mrb_hash_new(mrb);
+              mrb_hash_set(mrb, rest, mrb_symbol_value(kwsyms[j]), kwv[j]);
+            }
+            else {
+              kwarg_error(mrb, "unknown keyword", mrb_symbol_value(kwsyms[j]));
+              goto L_RAISE;
+            }
+          }
+        }
+        else if (mrb_hash_p(kwhash)) {
+          mrb_value keys = mrb_hash_keys(mrb, kwhash);
+          struct RArray *ka = mrb_ary_ptr(keys);
+          int x;
+
+          for (j=0; j<ka->len; j++) {
+            mrb_value key = ka->ptr[j];
+
+            for (x=0; x<k; x++) {
+              if (mrb_symbol_p(key) && syms[x] == mrb_symbol(key)) break;
+            }
+            if (x < k) {
+              kwp[x] = mrb_hash_get(mrb, kwhash, key);
+            }
+            else if (kd) {
+              if (mrb_nil_p(rest)) rest = mrb_hash_new(mrb);
+              mrb_hash_set(mrb, rest, key, mrb_hash_get(mrb, kwhash, key));
+            }
+            else {
+              kwarg_error(mrb, "unknown keyword", key);
+              goto L_RAISE;
+            }
+          }
+        }
+        if (kd) {
+          /* **opts is the only Hash built for register keywords */
+          kwp[k] = mrb_nil_p(rest) ? mrb_hash_new(mrb) : rest;
+        }
+        ARENA_RESTORE(mrb, ai);
+      }
       JUMP;
     }
 
     CASE(OP_KARG) {
-      /* A B C          R(A) := kdict[Sym(B)]; if C kdict.rm(Sym(B)) */
-      /* if C == 2; raise unless kdict.empty? */
-      /* OP_JMP should follow to skip init code */
+      /* A B C          if the keyword Sym(B) was not passed (R(A) unset): */
+      /* C=0 raises ArgumentError, C=1 skips the following OP_JMP to run */
+      /* the initializer */
+      int a = GETARG_A(i);
+
+      if (mrb_undef_p(regs[a])) {
+        if (GETARG_C(i) == 0) {
+          kwarg_error(mrb, "missing keyword", mrb_symbol_value(syms[GETARG_B(i)]));
+          goto L_RAISE;
+        }
+        pc++;
+      }
       NEXT;
     }
 
@@ -1276,7 +1764,10 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
         mrb_obj_iv_ifnone(mrb, mrb->exc, mrb_intern_lit(mrb, "ciidx"), mrb_fixnum_value(ci - mrb->c->cibase));
         eidx = ci->eidx;
         if (ci == mrb->c->cibase) {
-          if (ci->ridx == 0) goto L_STOP;
+          if (ci->ridx == 0) {
+            if (mrb->c->prev) goto L_FIBER_RAISE;
+            goto L_STOP;
+          }
           goto L_RESCUE;
         }
         while (eidx > ci[-1].eidx) {
@@ -1298,11 +1789,23 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
           else if (ci == mrb->c->cibase) {
             if (ci->ridx == 0) {
               regs = mrb->c->stack = mrb->c->stbase;
+              if (mrb->c->prev) goto L_FIBER_RAISE;
               goto L_STOP;
             }
             break;
           }
         }
+        goto L_RESCUE;
+
+      L_FIBER_RAISE:
+        /* unhandled in a fiber: it dies and the resumer gets the exception */
+        eidx = mrb->c->ci->eidx;
+        while (eidx--) {
+          ecall(mrb, eidx);
+        }
+        fiber_terminate(mrb);
+        goto L_RAISE;
+
       L_RESCUE:
         irep = ci->proc->body.irep;
         pool = irep->pool;
@@ -1345,9 +1848,7 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
               goto L_RAISE;
             }
             /* automatic yield at the end */
-            mrb->c->status = MRB_FIBER_TERMINATED;
-            mrb->c = mrb->c->prev;
-            mrb->c->status = MRB_FIBER_RUNNING;
+            fiber_terminate(mrb);
           }
           ci = mrb->c->ci;
           break;
@@ -1398,52 +1899,65 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
       c = mrb_class(mrb, recv);
       m = mrb_method_search_vm(mrb, &c, mid);
       if (!m) {
-        mrb_value sym = mrb_symbol_value(mid);
+        mrb_sym mm = mrb_intern_lit(mrb, "method_missing");
 
-        mid = mrb_intern_lit(mrb, "method_missing");
-        m = mrb_method_search_vm(mrb, &c, mid);
-        if (n == CALL_MAXARGS) {
-          mrb_ary_unshift(mrb, regs[a+1], sym);
-        }
-        else {
-          value_move(regs+a+2, regs+a+1, ++n);
-          regs[a+1] = sym;
+        m = mrb_method_search_vm(mrb, &c, mm);
+        if (m && !MRB_PROC_CFUNC_P(m)) {
+          mrb_value sym = mrb_symbol_value(mid);
+
+          mid = mm;
+          if (n == CALL_MAXARGS) {
+            mrb_ary_unshift(mrb, regs[a+1], sym);
+          }
+          else {
+            value_move(regs+a+2, regs+a+1, ++n);
+            regs[a+1] = sym;
+          }
         }
       }
+      if (!m || MRB_PROC_CFUNC_P(m)) {
+        /* C functions do not grow the VM stack; call them normally and
+           let the OP_RETURN following this instruction return the result */
+        i = MKOP_ABC(OP_SEND, a, GETARG_B(i), n);
+        goto L_SEND;
+      }
 
       /* replace callinfo */
       ci = mrb->c->ci;
+      if (ci->env) {
+        /* the frame is reused; move captured variables to the heap */
+        env_unshare(mrb, ci->env);
+        ci->env = 0;
+      }
       ci->mid = mid;
-      ci->target_class = c;
+      ci->proc = m;
+      if (c->tt == MRB_TT_ICLASS) {
+        ci->target_class = c->c;
+      }
+      else {
+        ci->target_class = c;
+      }
       if (n == CALL_MAXARGS) {
         ci->argc = -1;
+        n = 1;
       }
       else {
         ci->argc = n;
       }
 
-      /* move stack */
-      value_move(mrb->c->stack, &regs[a], ci->argc+1);
+      /* move receiver and arguments to the bottom of the frame */
+      value_move(regs, &regs[a], n+1);
+      SET_NIL_VALUE(regs[n+1]);
 
-      if (MRB_PROC_CFUNC_P(m)) {
-        mrb->c->stack[0] = m->body.func(mrb, recv);
-        mrb_gc_arena_restore(mrb, ai);
-        goto L_RETURN;
-      }
-      else {
-        /* setup environment for calling method */
-        irep = m->body.irep;
-        pool = irep->pool;
-        syms = irep->syms;
-        if (ci->argc < 0) {
-          stack_extend(mrb, (irep->nregs < 3) ? 3 : irep->nregs, 3);
-        }
-        else {
-          stack_extend(mrb, irep->nregs,  ci->argc+2);
-        }
-        regs = mrb->c->stack;
-        pc = irep->iseq;
-      }
+      /* setup environment for calling method */
+      proc = m;
+      irep = m->body.irep;
+      pool = irep->pool;
+      syms = irep->syms;
+      ci->nregs = irep->nregs;
+      stack_extend(mrb, (irep->nregs < n+2) ? n+2 : irep->nregs, n+2);
+      regs = mrb->c->stack;
+      pc = irep->iseq;
       JUMP;
     }
 
@@ -1860,7 +2374,7 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
 
     CASE(OP_ARRAY) {
       /* A B C          R(A) := ary_new(R(B),R(B+1)..R(B+C)) */
-      regs[GETARG_A(i)] = mrb_ary_new_from_values(mrb, GETARG_C(i), &regs[GETARG_B(i)]);
+      ALLOC_PC(mrb, pc, regs[GETARG_A(i)] = mrb_ary_new_from_values(mrb, GETARG_C(i), &regs[GETARG_B(i)]));
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
@@ -1947,28 +2461,40 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
 
     CASE(OP_STRING) {
       /* A Bx           R(A) := str_new(Lit(Bx)) */
-      regs[GETARG_A(i)] = mrb_str_dup(mrb, pool[GETARG_Bx(i)]);
+      mrb_value str = pool[GETARG_Bx(i)];
+
+      if (MRB_FROZEN_P(mrb_str_ptr(str))) {
+        /* frozen literal: the pooled string itself */
+        regs[GETARG_A(i)] = str;
+        NEXT;
+      }
+      ALLOC_PC(mrb, pc, regs[GETARG_A(i)] = mrb_str_dup(mrb, str));
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
 
     CASE(OP_STRCAT) {
       /* A B    R(A).concat(R(B)) */
-      mrb_str_concat(mrb, regs[GETARG_A(i)], regs[GETARG_B(i)]);
+      ALLOC_PC(mrb, pc, mrb_str_concat(mrb, regs[GETARG_A(i)], regs[GETARG_B(i)]));
+      NEXT;
+    }
+
+    CASE(OP_STRCATN) {
+      /* A B C  R(A) := str_new(R(B),R(B+1)..R(B+C-1)) */
+      mrb_value str;
+
+      ALLOC_PC(mrb, pc, str = str_cat_regs(mrb, GETARG_B(i), GETARG_C(i)));
+      regs = mrb->c->stack;
+      regs[GETARG_A(i)] = str;
+      ARENA_RESTORE(mrb, ai);
       NEXT;
     }
 
     CASE(OP_HASH) {
       /* A B C   R(A) := hash_new(R(B),R(B+1)..R(B+C)) */
-      int b = GETARG_B(i);
-      int c = GETARG_C(i);
-      int lim = b+c*2;
-      mrb_value hash = mrb_hash_new_capa(mrb, c);
+      mrb_value hash;
 
-      while (b < lim) {
-        mrb_hash_set(mrb, hash, regs[b], regs[b+1]);
-        b+=2;
-      }
+      ALLOC_PC(mrb, pc, hash = mrb_hash_new_from_values(mrb, GETARG_C(i), &regs[GETARG_B(i)]));
       regs[GETARG_A(i)] = hash;
       ARENA_RESTORE(mrb, ai);
       NEXT;
@@ -1980,12 +2506,15 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
       int c = GETARG_c(i);
 
       if (c & OP_L_CAPTURE) {
-        p = mrb_closure_new(mrb, irep->reps[GETARG_b(i)]);
+        ALLOC_PC(mrb, pc, p = mrb_closure_new(mrb, irep->reps[GETARG_b(i)]));
       }
       else {
-        p = mrb_proc_new(mrb, irep->reps[GETARG_b(i)]);
+        ALLOC_PC(mrb, pc, p = mrb_proc_new(mrb, irep->reps[GETARG_b(i)]));
+      }
+      if (c & OP_L_STRICT) {
+        p->flags |= MRB_PROC_STRICT;
+        mrb_proc_escape(mrb, p);
       }
-      if (c & OP_L_STRICT) p->flags |= MRB_PROC_STRICT;
       regs[GETARG_A(i)] = mrb_obj_value(p);
       ARENA_RESTORE(mrb, ai);
       NEXT;
@@ -2108,7 +2637,7 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
     CASE(OP_RANGE) {
       /* A B C  R(A) := range_new(R(B),R(B+1),C) */
       int b = GETARG_B(i);
-      regs[GETARG_A(i)] = mrb_range_new(mrb, regs[b], regs[b+1], GETARG_C(i));
+      ALLOC_PC(mrb, pc, regs[GETARG_A(i)] = mrb_range_new(mrb, regs[b], regs[b+1], GETARG_C(i)));
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
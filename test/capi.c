@@ -0,0 +1,247 @@
+/*
+** capi.c - C API helpers for the core tests in test/t
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stdio.h>
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/compile.h"
+#include "mruby/irep.h"
+#include "mruby/proc.h"
+#include "mruby/string.h"
+#include "../src/opcode.h"
+
+void mrb_init_test_capi(mrb_state *mrb);
+
+static mrb_value
+capi_nil(mrb_state *mrb, mrb_value self)
+{
+  return mrb_nil_value();
+}
+
+/* compacts while a cfunc proc and its env are still in the arena */
+static mrb_value
+capi_compact_cfunc_env(mrb_state *mrb, mrb_value self)
+{
+  mrb_value argv[2];
+  struct RProc *p;
+  struct REnv *e;
+
+  argv[0] = mrb_str_new_cstr(mrb, "env");
+  argv[1] = mrb_ary_new_from_values(mrb, 1, argv);
+  p = mrb_proc_new_cfunc_with_env(mrb, capi_nil, 2, argv);
+  mrb_gc_compact(mrb);
+  e = p->env;
+  return mrb_ary_new_from_values(mrb, (mrb_int)MRB_ENV_STACK_LEN(e), e->stack);
+}
+
+static mrb_value
+capi_funcall_id(mrb_state *mrb, mrb_value self)
+{
+  mrb_value obj, arg;
+  mrb_sym mid;
+
+  mrb_get_args(mrb, "ono", &obj, &mid, &arg);
+  return mrb_funcall_id(mrb, obj, mid, 1, arg);
+}
+
+/* calls mid on each element through one handle, yielding in between */
+static mrb_value
+capi_funcall_handle(mrb_state *mrb, mrb_value self)
+{
+  mrb_value ary, blk, result, v;
+  mrb_sym mid;
+  mrb_call_handle h;
+  mrb_int i;
+
+  mrb_get_args(mrb, "An&", &ary, &mid, &blk);
+  mrb_call_handle_init(mrb, &h, mid);
+  result = mrb_ary_new(mrb);
+  for (i=0; i<RARRAY_LEN(ary); i++) {
+    v = RARRAY_PTR(ary)[i];
+    mrb_ary_push(mrb, result, mrb_funcall_handle(mrb, &h, v, 0, NULL));
+    if (!mrb_nil_p(blk)) {
+      mrb_yield(mrb, blk, v);
+    }
+  }
+  return result;
+}
+
+static mrb_value
+capi_protect_body(mrb_state *mrb, mrb_value blk)
+{
+  return mrb_yield_argv(mrb, blk, 0, NULL);
+}
+
+/* [state, value, exception still pending?] */
+static mrb_value
+capi_protect(mrb_state *mrb, mrb_value self)
+{
+  mrb_value blk, val, ret[3];
+  mrb_bool state = FALSE;
+
+  mrb_get_args(mrb, "&", &blk);
+  val = mrb_protect(mrb, capi_protect_body, blk, &state);
+  ret[0] = mrb_bool_value(state);
+  ret[1] = val;
+  ret[2] = mrb_bool_value(mrb->exc != NULL);
+  return mrb_ary_new_from_values(mrb, 3, ret);
+}
+
+static const char*
+iseq_opname(int op)
+{
+  switch (op) {
+  case OP_NOP:     return "NOP";
+  case OP_MOVE:    return "MOVE";
+  case OP_LOADL:   return "LOADL";
+  case OP_LOADI:   return "LOADI";
+  case OP_LOADSYM: return "LOADSYM";
+  case OP_LOADNIL: return "LOADNIL";
+  case OP_LOADSELF:return "LOADSELF";
+  case OP_LOADT:   return "LOADT";
+  case OP_LOADF:   return "LOADF";
+  case OP_JMP:     return "JMP";
+  case OP_JMPIF:   return "JMPIF";
+  case OP_JMPNOT:  return "JMPNOT";
+  case OP_SEND:    return "SEND";
+  case OP_ENTER:   return "ENTER";
+  case OP_RETURN:  return "RETURN";
+  case OP_ADD:     return "ADD";
+  case OP_ADDI:    return "ADDI";
+  case OP_SUB:     return "SUB";
+  case OP_SUBI:    return "SUBI";
+  case OP_MUL:     return "MUL";
+  case OP_DIV:     return "DIV";
+  case OP_EQ:      return "EQ";
+  case OP_LT:      return "LT";
+  case OP_LE:      return "LE";
+  case OP_GT:      return "GT";
+  case OP_GE:      return "GE";
+  case OP_STOP:    return "STOP";
+  default:         return NULL;
+  }
+}
+
+/* one line per instruction, like the codedump of mrbc -v */
+static mrb_value
+iseq_dump(mrb_state *mrb, mrb_irep *irep)
+{
+  mrb_value ary = mrb_ary_new_capa(mrb, irep->ilen);
+  char buf[64];
+  const char *name;
+  mrb_code c;
+  int i;
+
+  for (i=0; i<(int)irep->ilen; i++) {
+    c = irep->iseq[i];
+    name = iseq_opname(GET_OPCODE(c));
+    switch (GET_OPCODE(c)) {
+    case OP_NOP: case OP_STOP: case OP_ENTER:
+      snprintf(buf, sizeof(buf), "%s", name);
+      break;
+    case OP_LOADNIL: case OP_LOADSELF: case OP_LOADT: case OP_LOADF:
+    case OP_RETURN:
+      snprintf(buf, sizeof(buf), "%s R%d", name, GETARG_A(c));
+      break;
+    case OP_MOVE:
+      snprintf(buf, sizeof(buf), "%s R%d R%d", name, GETARG_A(c), GETARG_B(c));
+      break;
+    case OP_LOADI:
+      snprintf(buf, sizeof(buf), "%s R%d %d", name, GETARG_A(c), GETARG_sBx(c));
+      break;
+    case OP_LOADL:
+      snprintf(buf, sizeof(buf), "%s R%d L%d", name, GETARG_A(c), GETARG_Bx(c));
+      break;
+    case OP_LOADSYM:
+      snprintf(buf, sizeof(buf), "%s R%d :%s", name, GETARG_A(c), mrb_sym2name(mrb, irep->syms[GETARG_Bx(c)]));
+      break;
+    case OP_JMP:
+      snprintf(buf, sizeof(buf), "%s %d", name, i + GETARG_sBx(c));
+      break;
+    case OP_JMPIF: case OP_JMPNOT:
+      snprintf(buf, sizeof(buf), "%s R%d %d", name, GETARG_A(c), i + GETARG_sBx(c));
+      break;
+    case OP_SEND: case OP_ADD: case OP_ADDI: case OP_SUB: case OP_SUBI:
+    case OP_MUL: case OP_DIV: case OP_EQ: case OP_LT: case OP_LE:
+    case OP_GT: case OP_GE:
+      snprintf(buf, sizeof(buf), "%s R%d :%s %d", name, GETARG_A(c), mrb_sym2name(mrb, irep->syms[GETARG_B(c)]), GETARG_C(c));
+      break;
+    default:
+      snprintf(buf, sizeof(buf), "OP%d", GET_OPCODE(c));
+      break;
+    }
+    mrb_ary_push(mrb, ary, mrb_str_new_cstr(mrb, buf));
+  }
+  return ary;
+}
+
+static void
+iseq_dump_all(mrb_state *mrb, mrb_irep *irep, mrb_value result)
+{
+  int i;
+
+  mrb_ary_push(mrb, result, iseq_dump(mrb, irep));
+  for (i=0; i<(int)irep->rlen; i++) {
+    iseq_dump_all(mrb, irep->reps[i], result);
+  }
+}
+
+/* leaves n new objects in the arena until the call returns */
+static mrb_value
+capi_grow_arena(mrb_state *mrb, mrb_value self)
+{
+  mrb_int n, i;
+
+  mrb_get_args(mrb, "i", &n);
+  for (i=0; i<n; i++) {
+    mrb_str_new(mrb, "arena", 5);
+  }
+  return mrb_nil_value();
+}
+
+/* compiles src (with mrbc -O if optimize is true) and dumps the iseq
+   of the toplevel irep and each nested one, depth first */
+static mrb_value
+capi_iseq(mrb_state *mrb, mrb_value self)
+{
+  char *src;
+  mrb_bool optimize;
+  mrbc_context *cxt;
+  struct mrb_parser_state *p;
+  struct RProc *proc;
+  mrb_value result;
+
+  mrb_get_args(mrb, "zb", &src, &optimize);
+  cxt = mrbc_context_new(mrb);
+  cxt->optimize = optimize;
+  p = mrb_parse_string(mrb, src, cxt);
+  mrbc_context_free(mrb, cxt);
+  if (!p || !p->tree || p->nerr) {
+    if (p) mrb_parser_free(p);
+    mrb_raise(mrb, E_SYNTAX_ERROR, "iseq: syntax error");
+  }
+  proc = mrb_generate_code(mrb, p);
+  mrb_parser_free(p);
+  if (!proc) {
+    mrb_raise(mrb, E_SCRIPT_ERROR, "iseq: codegen error");
+  }
+  result = mrb_ary_new(mrb);
+  iseq_dump_all(mrb, proc->body.irep, result);
+  return result;
+}
+
+void
+mrb_init_test_capi(mrb_state *mrb)
+{
+  struct RClass *t = mrb_define_module(mrb, "CAPITest");
+
+  mrb_define_class_method(mrb, t, "compact_cfunc_env", capi_compact_cfunc_env, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, t, "funcall_id", capi_funcall_id, MRB_ARGS_REQ(3));
+  mrb_define_class_method(mrb, t, "funcall_handle", capi_funcall_handle, MRB_ARGS_REQ(2)|MRB_ARGS_BLOCK());
+  mrb_define_class_method(mrb, t, "protect", capi_protect, MRB_ARGS_BLOCK());
+  mrb_define_class_method(mrb, t, "iseq", capi_iseq, MRB_ARGS_REQ(2));
+  mrb_define_class_method(mrb, t, "grow_arena", capi_grow_arena, MRB_ARGS_REQ(1));
+}
@@ -1,18 +1,69 @@
 #include <stdlib.h>
 #include "mruby.h"
+#include "mruby/array.h"
 #include "mruby/irep.h"
 #include "mruby/dump.h"
 #include "mruby/string.h"
 #include "mruby/proc.h"
+#include "mruby/variable.h"
 
 extern const uint8_t mrbtest_irep[];
+extern const uint8_t mrbtest_irep_optimized[];
 
 void mrbgemtest_init(mrb_state* mrb);
+void mrb_init_test_capi(mrb_state *mrb);
+mrb_value mrb_t_printstr(mrb_state *mrb, mrb_value self);
+
+/* run the core tests again from bytecode compiled with mrbc -O */
+static void
+mrb_init_mrbtest_optimized(mrb_state *mrb)
+{
+  static const char *const counters[] = { "$ok_test", "$ko_test", "$kill_test" };
+  mrb_state *mrb2 = mrb_open();
+  mrb_value val1, val2, ary1, ary2;
+  size_t i;
+
+  if (mrb2 == NULL) {
+    return;
+  }
+  val1 = mrb_gv_get(mrb, mrb_intern_lit(mrb, "$mrbtest_verbose"));
+  if (mrb_test(val1)) {
+    mrb_gv_set(mrb2, mrb_intern_lit(mrb2, "$mrbtest_verbose"), val1);
+  }
+  mrb_define_method(mrb2, mrb2->kernel_module, "__t_printstr__", mrb_t_printstr, MRB_ARGS_REQ(1));
+  mrb_init_test_capi(mrb2);
+  mrb_load_irep(mrb2, mrbtest_irep_optimized);
+  if (mrb2->exc) {
+    mrb_p(mrb2, mrb_obj_value(mrb2->exc));
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < sizeof(counters)/sizeof(counters[0]); i++) {
+    val2 = mrb_gv_get(mrb2, mrb_intern_cstr(mrb2, counters[i]));
+    val1 = mrb_gv_get(mrb, mrb_intern_cstr(mrb, counters[i]));
+    if (mrb_fixnum_p(val1) && mrb_fixnum_p(val2)) {
+      mrb_gv_set(mrb, mrb_intern_cstr(mrb, counters[i]), mrb_fixnum_value(mrb_fixnum(val1) + mrb_fixnum(val2)));
+    }
+  }
+  ary1 = mrb_gv_get(mrb, mrb_intern_lit(mrb, "$asserts"));
+  ary2 = mrb_gv_get(mrb2, mrb_intern_lit(mrb2, "$asserts"));
+  if (mrb_array_p(ary1) && mrb_array_p(ary2)) {
+    for (i = 0; i < (size_t)RARRAY_LEN(ary2); i++) {
+      mrb_value s = RARRAY_PTR(ary2)[i];
+
+      mrb_ary_push(mrb, ary1, mrb_str_new(mrb, RSTRING_PTR(s), RSTRING_LEN(s)));
+    }
+  }
+  mrb_close(mrb2);
+}
 
 void
 mrb_init_mrbtest(mrb_state *mrb)
 {
+  mrb_init_test_capi(mrb);
   mrb_load_irep(mrb, mrbtest_irep);
+  if (!mrb->exc) {
+    mrb_init_mrbtest_optimized(mrb);
+  }
 #ifndef DISABLE_GEMS
   mrbgemtest_init(mrb);
 #endif
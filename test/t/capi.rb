@@ -0,0 +1,68 @@
+##
+# C API tests (helpers in test/capi.c)
+
+assert('mrb_funcall_id') do
+  assert_equal 3, CAPITest.funcall_id(1, :+, 2)
+  assert_equal [1, 2], CAPITest.funcall_id([1], :push, 2)
+  assert_raise(NoMethodError) { CAPITest.funcall_id(1, :no_such_method, 2) }
+end
+
+assert('mrb_funcall_handle') do
+  class CAPIHandleA; def name; :a; end; end
+  class CAPIHandleB; def name; :b; end; end
+  a = CAPIHandleA.new
+  b = CAPIHandleB.new
+  assert_equal [:a, :a, :b, :a], CAPITest.funcall_handle([a, a, b, a], :name)
+
+  # a redefinition between calls is seen through the cached handle
+  n = 0
+  r = CAPITest.funcall_handle([a, a, a], :name) do
+    n += 1
+    CAPIHandleA.class_eval { define_method(:name) { :"a#{n}" } }
+  end
+  assert_equal [:a, :a1, :a2], r
+end
+
+assert('mrb_protect') do
+  assert_equal [false, 3, false], CAPITest.protect { 1 + 2 }
+
+  state, exc, pending = CAPITest.protect { raise ArgumentError, "protected" }
+  assert_true state
+  assert_kind_of ArgumentError, exc
+  assert_equal "protected", exc.message
+  assert_false pending
+
+  state, exc, pending = CAPITest.protect { [1].map { |x| x.no_such_method } }
+  assert_true state
+  assert_kind_of NoMethodError, exc
+  assert_false pending
+end
+
+assert('mrbc -O iseq') do
+  # constant arithmetic is folded into one load
+  src = "def m; 1 + 2 * 3; end"
+  assert_equal ["ENTER", "LOADI R2 1", "LOADI R3 2", "LOADI R4 3",
+                "MUL R3 :* 1", "ADD R2 :+ 1", "RETURN R2"], CAPITest.iseq(src, false)[1]
+  assert_equal ["ENTER", "LOADI R2 7", "RETURN R2"], CAPITest.iseq(src, true)[1]
+
+  # a jump to a return becomes the return
+  src = "def m(x); x < 3 ? 1 : 2; end"
+  assert_equal ["ENTER", "MOVE R3 R1", "LOADI R4 3", "LT R3 :< 1", "JMPNOT R3 7",
+                "LOADI R3 1", "JMP 8", "LOADI R3 2", "RETURN R3"], CAPITest.iseq(src, false)[1]
+  assert_equal ["ENTER", "MOVE R3 R1", "LOADI R4 3", "LT R3 :< 1", "JMPNOT R3 7",
+                "LOADI R3 1", "RETURN R3", "LOADI R3 2", "RETURN R3"], CAPITest.iseq(src, true)[1]
+
+  # a constant condition is resolved at compile time
+  src = "def m(a); if a && true then 1 end; end"
+  assert_equal ["ENTER", "MOVE R3 R1", "JMPNOT R3 5", "LOADI R3 1", "RETURN R3",
+                "LOADNIL R3", "RETURN R3"], CAPITest.iseq(src, true)[1]
+
+  # code after return is dropped
+  src = "def m; return 1; 2; end"
+  assert_equal ["ENTER", "LOADI R2 1", "RETURN R2", "LOADI R2 2", "RETURN R2"], CAPITest.iseq(src, false)[1]
+  assert_equal ["ENTER", "LOADI R2 1", "RETURN R2"], CAPITest.iseq(src, true)[1]
+
+  # division by zero is left for run time
+  src = "def m; 1 / 0; end"
+  assert_equal CAPITest.iseq(src, false), CAPITest.iseq(src, true)
+end
@@ -143,3 +143,24 @@ assert('Float#truncate', '15.2.9.3.15') do
   assert_equal( 3,  3.123456789.truncate)
   assert_equal(-3, -3.1.truncate)
 end
+
+assert('Float#to_s', '15.2.9.3.16') do
+  assert_equal "1.0", 1.0.to_s
+  assert_equal "123456789.123", 123456789.123.to_s
+  assert_equal "0.30000000000000004", (0.1 + 0.2).to_s
+  assert_equal "100000000000000.0", 1e14.to_s
+  assert_equal "1.0e+15", 1e15.to_s
+  assert_equal "1.5e+15", 1.5e15.to_s
+  assert_equal "1.0e+16", 1e16.to_s
+  assert_equal "0.0001", 0.0001.to_s
+  assert_equal "-1.5e-05", -0.000015.to_s
+  assert_equal "1.0e+100", 1e100.to_s
+  assert_equal "1.7976931348623157e+308", 1.7976931348623157e308.to_s
+end
+
+assert('Float#to_s round trip') do
+  [1.0 / 3, 2.0 / 3, 1e23, 9007199254740993.0,
+   2.2250738585072014e-308, 0.1 * 3, 123.456e-200].each do |f|
+    assert_equal f, f.to_s.to_f
+  end
+end
@@ -43,3 +43,133 @@ assert('GC.generational_mode=') do
     GC.generational_mode = origin
   end
 end
+
+assert('GC keeps young objects stored into old containers') do
+  origin = GC.generational_mode
+  begin
+    GC.generational_mode = true
+    ary = Array.new(2000)
+    hash = {}
+    obj = Object.new
+    GC.start
+    2000.times do |i|
+      ary[i] = "a#{i}"
+      hash[i] = ["h#{i}"]
+      obj.instance_variable_set(:@last, "o#{i}")
+      10.times { "garbage" * 10 }
+    end
+    GC.start
+    assert_equal "a1999", ary[1999]
+    assert_equal "a0", ary[0]
+    assert_equal ["h1234"], hash[1234]
+    assert_equal "o1999", obj.instance_variable_get(:@last)
+  ensure
+    GC.generational_mode = origin
+  end
+end
+
+assert('GC.max_pause_us=') do
+  origin = GC.max_pause_us
+  begin
+    assert_equal 0, origin
+    assert_equal 300, (GC.max_pause_us = 300)
+    assert_equal 300, GC.max_pause_us
+    assert_raise(ArgumentError) { GC.max_pause_us = -1 }
+  ensure
+    GC.max_pause_us = origin
+  end
+end
+
+assert('GC with max_pause_us marks large containers in chunks') do
+  origin_pause = GC.max_pause_us
+  origin_gen = GC.generational_mode
+  begin
+    GC.generational_mode = false
+    GC.max_pause_us = 50
+    ary = Array.new(20000) {|i| "a#{i}" }
+    hash = {}
+    5000.times {|i| hash[i] = "h#{i}" }
+    3000.times do |i|
+      ary[i * 5] = "b#{i}"
+      ary << "c#{i}"
+      hash[i + 5000] = "n#{i}"
+      "garbage" * 20
+    end
+    GC.start
+    assert_equal 23000, ary.size
+    assert_equal "a19999", ary[19999]
+    assert_equal "b2999", ary[14995]
+    assert_equal "c2999", ary.last
+    assert_equal "h4999", hash[4999]
+    assert_equal "n2999", hash[7999]
+  ensure
+    GC.max_pause_us = origin_pause
+    GC.generational_mode = origin_gen
+  end
+end
+
+assert('GC.compact') do
+  keep = []
+  junk = []
+  4000.times do |i|
+    s = "s#{i}"
+    if i % 10 == 0
+      keep << s
+    else
+      junk << [s]
+    end
+  end
+  pinned = Object.new
+  id = pinned.object_id
+  key = [1, 2]
+  h = { key => "by array", "str" => keep, :sym => 1..keep.size }
+  o = Object.new
+  o.instance_variable_set(:@list, keep)
+  $gc_compact_test = { :k => "global" }
+  junk = nil
+
+  moved = GC.compact
+  assert_kind_of Fixnum, moved
+  assert_true moved > 0
+  assert_equal 400, keep.size
+  assert_equal "s0", keep.first
+  assert_equal "s3990", keep.last
+  assert_equal id, pinned.object_id
+  assert_equal "by array", h[key]
+  assert_equal "by array", h[[1, 2]]
+  assert_true keep.equal?(h["str"])
+  assert_equal 1..400, h[:sym]
+  assert_true keep.equal?(o.instance_variable_get(:@list))
+  assert_equal "global", $gc_compact_test[:k]
+
+  GC.start
+  assert_equal "s3990", keep.last
+  assert_equal 400, keep.map { |s| s + "!" }.size
+end
+
+assert('GC.compact from a block run by C') do
+  h = Hash.new { |hash, k| GC.compact }
+  assert_nil h[:missing]
+end
+
+assert('GC.compact with a cfunc env in the arena') do
+  assert_equal ["env", ["env"]], CAPITest.compact_cfunc_env
+end
+
+assert('GC.arena_high_water') do
+  assert_kind_of Fixnum, GC.arena_high_water
+  assert_true GC.arena_high_water > 0
+
+  GC.reset_arena_high_water
+  base = GC.arena_high_water
+  CAPITest.grow_arena(60)
+  assert_equal base + 60, GC.arena_high_water
+  CAPITest.grow_arena(20)
+  assert_equal base + 60, GC.arena_high_water
+
+  assert_equal base + 60, GC.reset_arena_high_water
+  GC.reset_arena_high_water
+  base = GC.arena_high_water
+  CAPITest.grow_arena(20)
+  assert_equal base + 20, GC.arena_high_water
+end
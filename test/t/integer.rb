@@ -193,6 +193,46 @@ assert('Integer#to_s', '15.2.8.3.25') do
   assert_equal("-1", -1.to_s)
 end
 
+assert('Integer#to_s digits') do
+  assert_equal '0', 0.to_s
+  assert_equal '9', 9.to_s
+  assert_equal '10', 10.to_s
+  assert_equal '99', 99.to_s
+  assert_equal '100', 100.to_s
+  assert_equal '-100', -100.to_s
+  assert_equal '1234567', 1234567.to_s
+  assert_equal '-1234567', -1234567.to_s
+  assert_equal '-ff', -255.to_s(16)
+  assert_equal '1010', 10.to_s(2)
+  assert_equal 'zz', 1295.to_s(36)
+end
+
+assert('Integer#to_s interpolation') do
+  assert_equal "a-12b", "a#{-12}b"
+  assert_equal "1,2.5,sym,,true,false", [1, 2.5, :sym, nil, true, false].join(",")
+end
+
+assert('Integer#to_s overridden in interpolation') do
+  [[Fixnum, 1], [NilClass, nil], [Symbol, :s], [Float, 1.5]].each do |c, v|
+    c.class_eval do
+      alias_method :__to_s_saved, :to_s
+      def to_s(*a); "X"; end
+    end
+    begin
+      assert_equal "aX", "a#{v}"
+      assert_equal "Xb", "#{v}b"
+      assert_equal ["aX"], %W(a#{v})
+    ensure
+      c.class_eval do
+        alias_method :to_s, :__to_s_saved
+        remove_method :__to_s_saved
+      end
+    end
+    assert_equal "a#{v.to_s}", "a#{v}"
+  end
+  assert_equal ["a1"], %W(a#{1})
+end
+
 assert('Integer#truncate', '15.2.8.3.26') do
   assert_equal 1, 1.truncate
 end
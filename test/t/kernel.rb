@@ -249,6 +249,13 @@ assert('Kernel#extend works on toplevel', '15.3.1.3.13') do
   assert_true respond_to?(:test_method)
 end
 
+assert('Kernel#frozen?') do
+  assert_true 1.frozen?
+  assert_true nil.frozen?
+  assert_true :sym.frozen?
+  assert_false Object.new.frozen?
+end
+
 assert('Kernel#global_variables', '15.3.1.3.14') do
   assert_equal Array, global_variables.class
 end
@@ -492,8 +499,8 @@ end
 
 assert('stack extend') do
   def recurse(count, stop)
-    return count if count > stop
-    recurse(count+1, stop)
+    return 0 if count > stop
+    1 + recurse(count+1, stop)
   end
 
   assert_equal 6, recurse(0, 5)
@@ -107,3 +107,159 @@ assert('The undef statement (method undefined)', '13.3.7 a) 5)') do
     undef :non_existing_method
   end
 end
+
+assert('Tail call in method body') do
+  def tailcall_count(n, acc)
+    return acc if n == 0
+    tailcall_count(n - 1, acc + 1)
+  end
+
+  def tailcall_even(n)
+    return true if n == 0
+    tailcall_odd(n - 1)
+  end
+
+  def tailcall_odd(n)
+    return false if n == 0
+    tailcall_even(n - 1)
+  end
+
+  # deeper than the VM stack limit without tail call elimination
+  assert_equal 100000, tailcall_count(100000, 0)
+  assert_true tailcall_even(100000)
+  assert_false tailcall_odd(100000)
+end
+
+assert('Tail call in branches') do
+  def tailcall_ev(n); n == 0 ? true : tailcall_od(n - 1); end
+  def tailcall_od(n); n == 0 ? false : tailcall_ev(n - 1); end
+
+  def tailcall_if(n)
+    if n > 0
+      tailcall_case(n - 1)
+    else
+      :if
+    end
+  end
+
+  def tailcall_case(n)
+    case n % 3
+    when 0 then tailcall_if(n)
+    when 1 then tailcall_and(n - 1)
+    else tailcall_if(n)
+    end
+  end
+
+  def tailcall_and(n)
+    n >= 0 && tailcall_if(n)
+  end
+
+  assert_true tailcall_ev(100000)
+  assert_false tailcall_od(100000)
+  assert_equal :if, tailcall_if(100000)
+  assert_equal :if, tailcall_case(100000)
+end
+
+assert('Tail call to C function and method_missing') do
+  class TailCallTest
+    def to_cfunc(a); a.push(1); end
+    def splat(*a); tail_sum(*a); end
+    def tail_sum(a, b, c); a + b + c; end
+    def captured(x)
+      pr = lambda { x }
+      tail_id(pr)
+    end
+    def tail_id(v); v; end
+    def missing; no_such_method(1, 2); end
+    def method_missing(name, *args)
+      [name, args]
+    end
+  end
+
+  t = TailCallTest.new
+  assert_equal [1], t.to_cfunc([])
+  assert_equal 6, t.splat(1, 2, 3)
+  assert_equal 7, t.captured(7).call
+  assert_equal [:no_such_method, [1, 2]], t.missing
+end
+
+assert('Proc return to a method ending in a call') do
+  class TailCallProcTest
+    def home
+      pr = proc { return 1 }
+      callit(pr)
+    end
+    def home_loop
+      pr = nil
+      i = 0
+      while i < 2
+        return callit(pr) if pr
+        pr = proc { return 3 }
+        i += 1
+      end
+    end
+    def callit(pr)
+      pr.call
+      2
+    end
+  end
+
+  t = TailCallProcTest.new
+  assert_equal 1, t.home
+  assert_equal 3, t.home_loop
+end
+
+assert('Keyword arguments') do
+  class KeywordArgTest
+    def opt(a, b = 2, *r, k: 10, j:, **o, &blk)
+      [a, b, r, k, j, o, blk ? blk.call : nil]
+    end
+    def only(k: 1); k; end
+    def hash_arg(h); h; end
+    def mixed(h, k: 1); [h, k]; end
+    def rest(**o); o; end
+    def defaults(k: 1, j: k + 1); [k, j]; end
+    def yielder(a, k: 1); yield a, k; end
+  end
+
+  t = KeywordArgTest.new
+  assert_equal [1, 2, [], 10, 3, {}, nil], t.opt(1, j: 3)
+  assert_equal [1, 5, [6, 7], 4, 3, {:z => 9}, :blk],
+               t.opt(1, 5, 6, 7, j: 3, k: 4, z: 9) { :blk }
+  assert_equal [1, 2, [], 2, 1, {}, nil], t.opt(1, {j: 1, k: 2})
+  assert_raise(ArgumentError) { t.opt(1) }
+  assert_equal 1, t.only
+  assert_equal 5, t.only(k: 5)
+  assert_equal 9, t.send(:only, k: 9)
+  assert_raise(ArgumentError) { t.only(x: 1) }
+  assert_equal({:a => 1, :b => 2}, t.hash_arg(a: 1, b: 2))
+  assert_equal [{:k => 3}, 1], t.mixed(k: 3)
+  assert_equal [{:a => 1}, 2], t.mixed({a: 1}, k: 2)
+  assert_equal({}, t.rest)
+  assert_equal 8, t.rest(a: 1, b: 2, c: 3, d: 4, e: 5, f: 6, g: 7, h: 8).size
+  assert_equal [1, 2], t.defaults
+  assert_equal [5, 6], t.defaults(k: 5)
+  assert_equal [1, 0], t.defaults(j: 0)
+  assert_equal 7, t.yielder(3, k: 4) { |x, y| x + y }
+
+  l = ->(a, k: 2) { [a, k] }
+  assert_equal [1, 3], l.call(1, k: 3)
+  assert_equal [1, 2], l.call(1)
+end
+
+assert('Keyword arguments with zsuper') do
+  class KeywordSuperBase
+    def initialize(x, y: 2); @v = [x, y]; end
+    attr_reader :v
+  end
+  class KeywordSuper < KeywordSuperBase
+    def initialize(x, y: 3); super; end
+  end
+  class KeywordSuperBlock < KeywordSuperBase
+    def initialize(x, y: 3); [1].each { super }; end
+  end
+
+  assert_equal [1, 3], KeywordSuper.new(1).v
+  assert_equal [1, 5], KeywordSuper.new(1, y: 5).v
+  assert_equal [4, 6], KeywordSuperBlock.new(4, y: 6).v
+end
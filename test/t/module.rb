@@ -176,6 +176,22 @@ assert('Module#attr_writer', '15.2.2.4.14') do
   assert_equal 'test', AttrTestWriter.cattr_val
 end
 
+assert('Module#attr_accessor called indirectly') do
+  class AttrTestIndirect
+    attr_accessor :a
+  end
+  class AttrTestIndirectSub < AttrTestIndirect; end
+
+  o = AttrTestIndirectSub.new
+  assert_nil o.a
+  assert_equal 3, (o.a = 3)
+  assert_equal 3, o.a
+  assert_equal 4, o.send(:a=, 4)
+  assert_equal 4, o.send(:a)
+  assert_equal 4, o.instance_variable_get(:@a)
+  assert_raise(ArgumentError) { o.a(1) }
+end
+
 assert('Module#class_eval', '15.2.2.4.15') do
   class Test4ClassEval
     @a = 11
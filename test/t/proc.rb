@@ -91,3 +91,38 @@ assert('Proc#return_does_not_break_self') do
   assert_equal nil, c.return_nil
   assert_equal c, c.block.call
 end
+
+assert('Proc escaping through block argument') do
+  class ProcEscapeTest
+    def call3(&block); block.call(1) + block.call(2); end
+    def keep(&block); @kept = block; 0; end
+    def pass(&block); keep(&block); end
+    def nest(&block); call3 { |i| block.call(i) }; end
+    def ret(&block); block; end
+    def outer; v = 10; yield_keep { v }; end
+    def yield_keep; keep { yield }; end
+    attr_reader :kept
+  end
+
+  t = ProcEscapeTest.new
+  x = 5
+  assert_equal 13, t.call3 { |i| x + i }
+  assert_equal 13, t.nest { |i| x + i }
+
+  def proc_escape_local(t, &b); v = 7; t.keep { v }; v = 8; nil; end
+  proc_escape_local(t)
+  GC.start
+  assert_equal 8, t.kept.call
+
+  def proc_escape_pass(t); v = 3; t.pass { v }; end
+  proc_escape_pass(t)
+  GC.start
+  assert_equal 3, t.kept.call
+
+  def proc_escape_ret(t); v = 4; t.ret { v }; end
+  assert_equal 4, proc_escape_ret(t).call
+
+  t.outer
+  GC.start
+  assert_equal 10, t.kept.call
+end
@@ -80,3 +80,52 @@ assert('Range#eql?', '15.2.14.4.14') do
   assert_false (1..10).eql? (Range.new(1.0, 10.0))
   assert_false (1..10).eql? "1..10"
 end
+
+assert('Range#each with Fixnum edges') do
+  a = []
+  (1...4).each {|i| a << i }
+  assert_equal [1, 2, 3], a
+  a = []
+  (3..1).each {|i| a << i }
+  assert_equal [], a
+  a = []
+  (0..10).each {|i| a << i; break if i == 2 }
+  assert_equal [0, 1, 2], a
+end
+
+assert('Range#each with String edges') do
+  a = []
+  ('y'..'ab').each {|s| a << s }
+  assert_equal [], a
+  a = []
+  ('az'...'bc').each {|s| a << s }
+  assert_equal ['az', 'ba', 'bb'], a
+  assert_equal 52, ('a'...'ba').to_a.size
+end
+
+assert('Range#step') do
+  a = []
+  (1..10).step(3) {|i| a << i }
+  assert_equal [1, 4, 7, 10], a
+  a = []
+  (1.0...2.0).step(0.5) {|f| a << f }
+  assert_equal [1.0, 1.5], a
+  a = []
+  ('a'..'e').step(2) {|s| a << s }
+  assert_equal ['a', 'c', 'e'], a
+  assert_raise(ArgumentError) { (1..2).step(0) {} }
+end
+
+assert('Range#to_a') do
+  assert_equal [1, 2, 3], (1..3).to_a
+  assert_equal [1, 2], (1...3).to_a
+  assert_equal [], (3..1).to_a
+  assert_equal ['a', 'b'], ('a'..'b').to_a
+end
+
+assert('Range#include? with numeric edges') do
+  assert_true (1.0..2.0).include?(2)
+  assert_false (1...3).include?(3)
+  assert_true (1...3).include?(2.5)
+  assert_false (1..3).include?(3.5)
+end
@@ -259,6 +259,32 @@ assert('String#hash', '15.2.10.5.20') do
   assert_equal 'abc'.hash, a.hash
 end
 
+assert('String#hash follows modification') do
+  a = 'abc'
+  h = a.hash
+  a << 'd'
+  assert_equal 'abcd'.hash, a.hash
+  a.chop!
+  assert_equal h, a.hash
+  b = 'xyz'
+  b.hash
+  b.replace 'abc'
+  assert_equal h, b.hash
+  assert_equal h, a.dup.hash
+  assert_not_equal 'abc'.hash, 'acb'.hash
+end
+
+assert('Hash lookup with a modified String key') do
+  k = 'key'
+  h = { k => 1 }
+  assert_equal 1, h[k]
+  k << '2'
+  assert_nil h[k]
+  h[k] = 2
+  assert_equal 1, h['key']
+  assert_equal 2, h['key2']
+end
+
 assert('String#include?', '15.2.10.5.21') do
   assert_true 'abc'.include?(97)
   assert_false 'abc'.include?(100)
@@ -470,6 +496,30 @@ assert('String#to_i', '15.2.10.5.39') do
   assert_equal 4, d
 end
 
+assert('String#to_i with long digit runs') do
+  assert_equal 2147483647, '2147483647'.to_i
+  assert_equal 12345678, '12345678'.to_i
+  assert_equal 123456789, '123456789x'.to_i
+  assert_equal 12, '000000000000000000012'.to_i
+  assert_equal(-98765432, '  -98765432 '.to_i)
+  assert_equal 1, '1_000'.to_i
+  assert_equal 31, '0x1f'.to_i(16)
+end
+
+assert('String#to_f correctly rounded') do
+  assert_equal 0.1 + 0.2, '0.30000000000000004'.to_f
+  assert_equal 1.0 / 3, '3.3333333333333331e-01'.to_f
+  assert_equal 12345678.5, '12345678.5'.to_f
+  assert_equal 1500.0, '1.5e3x'.to_f
+  assert_equal 1000.5, '1_000.5'.to_f
+  assert_equal 1.0, '1e'.to_f
+  assert_equal(-0.5, '-.5'.to_f)
+  assert_equal 1.7976931348623157e308, '1.7976931348623157e308'.to_f
+  assert_equal 1.2345678901234568e23, '123456789012345678901234'.to_f
+  assert_equal 0.0, '1e-400'.to_f
+  assert_true '1e400'.to_f.infinite?
+end
+
 assert('String#to_s', '15.2.10.5.40') do
   assert_equal 'abc', 'abc'.to_s
 end
@@ -503,6 +553,52 @@ assert('String interpolation (mrb_str_concat for shared strings)') do
   assert_equal "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA:", "#{a}:"
 end
 
+assert('String interpolation of non-strings') do
+  o = Object.new
+  def o.to_s; "obj"; end
+  s = Object.new
+  def s.to_str; "str"; end
+  assert_equal "1:-20:1.5:sym::true:obj:str", "#{1}:#{-20}:#{1.5}:#{:sym}:#{nil}:#{true}:#{o}:#{s}"
+  assert_equal "#{1.0/3}", (1.0/3).to_s
+  assert_equal "x", "#{}x"
+end
+
+assert('String interpolation makes a new string') do
+  a = []
+  2.times { |i| a << "v#{i}" }
+  a[0] << "!"
+  assert_equal ["v0!", "v1"], a
+  b = "#{a[1]}"
+  b << "?"
+  assert_equal "v1", a[1]
+end
+
+assert('String interpolation of many parts') do
+  i = 7
+  assert_equal "7" * 130, "#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}#{i}"
+end
+
+assert('String interpolation with to_s redefined') do
+  classes = [Fixnum, Float, Symbol, NilClass]
+  classes.each do |c|
+    c.class_eval do
+      alias_method :__to_s_saved, :to_s
+      define_method(:to_s) { |*a| "<#{c}>" }
+    end
+  end
+  begin
+    assert_equal "a<Fixnum>b<Float>c<Symbol>d<NilClass>e", "a#{1}b#{1.5}c#{:s}d#{nil}e"
+  ensure
+    classes.each do |c|
+      c.class_eval do
+        alias_method :to_s, :__to_s_saved
+        remove_method :__to_s_saved
+      end
+    end
+  end
+  assert_equal "a1b1.5csde", "a#{1}b#{1.5}c#{:s}d#{nil}e"
+end
+
 assert('Check the usage of a NUL character') do
   "qqq\0ppp"
 end
@@ -536,3 +632,85 @@ assert('String#inspect') do
   ("\1" * 100).inspect  # should not raise an exception - regress #1210
   assert_equal "\"\\000\"", "\0".inspect
 end
+
+assert('String#freeze') do
+  s = "frozen"
+  assert_false s.frozen?
+  assert_equal s, s.freeze
+  assert_true s.frozen?
+  assert_raise(RuntimeError) { s << "x" }
+  assert_raise(RuntimeError) { s.upcase! }
+  assert_raise(RuntimeError) { s.replace "x" }
+  assert_raise(TypeError) { s.singleton_class }
+  assert_equal "FROZEN", s.upcase
+  assert_equal "frozen", s
+end
+
+assert('String#freeze copies') do
+  s = "frozen".freeze
+  assert_true s.clone.frozen?
+  d = s.dup
+  assert_false d.frozen?
+  d << "!"
+  assert_equal "frozen!", d
+end
+
+assert('String#freeze hash key') do
+  s = "key".freeze
+  h = { s => 1 }
+  assert_true h.keys[0].equal?(s)
+  assert_equal 1, h["key"]
+end
+
+assert('String#succ') do
+  assert_equal 'abce', 'abcd'.succ
+  assert_equal 'ba', 'az'.succ
+  assert_equal 'aaa00', 'zz99'.succ
+  assert_equal 'AAa', 'Zz'.succ
+  assert_equal 'b-0', 'a-9'.succ
+  assert_equal '2.0', '1.9'.succ
+  assert_equal '**+', '***'.succ
+  assert_equal "\x01\x00", "\xff".succ
+  assert_equal '', ''.succ
+  s = 'az'
+  assert_equal 'ba', s.next!
+  assert_equal 'ba', s
+end
+
+assert('String substrings share copy-on-write') do
+  s = "hello world, hello world"
+  a = s[0, 5]
+  b = s.dup
+  c = s.chomp("world")
+  a << "!"
+  b[0] = "j"
+  c.upcase!
+  assert_equal "hello world, hello world", s
+  assert_equal "hello!", a
+  assert_equal "jello world, hello world", b
+  assert_equal "HELLO WORLD, HELLO ", c
+  assert_equal "hello world, hello worl", s.chop
+  assert_equal "abc", "abc\r\n".chomp
+  assert_equal "abc", "abc\r\n".chop
+
+  big = "x" * 10000 + "tail"
+  t = big[-4, 4]
+  big.replace ""
+  assert_equal "tail", t
+  t << "!"
+  assert_equal "tail!", t
+
+  # the last view of a buffer takes it over
+  v = ("ab" * 8)[2, 4]
+  v << "c"
+  assert_equal "ababc", v
+end
+
+assert('String substrings passed to C by name') do
+  o = Object.new
+  o.instance_variable_set("@ab".chop, 1)
+  assert_true o.instance_variable_defined?("@ab".chop)
+  assert_true o.instance_variable_defined?("@a\n".chomp)
+  assert_equal 1, o.instance_variable_get("@a\r\n".chomp)
+  assert_equal :ab, "abc".chop.to_sym
+end
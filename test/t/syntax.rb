@@ -233,3 +233,31 @@ assert('splat in case statement') do
   assert_equal [5], resultb
   assert_equal [3,8], resultc
 end
+
+assert('constant expressions and branches') do
+  def test_const_branch
+    return :early if 1 < 2
+    :late
+  end
+
+  assert_equal 7, 1 + 2 * 3
+  assert_equal 9, 10 - 1
+  assert_equal(-5, 3 - 8)
+  assert_equal 40000, 200 * 200
+  assert_true 3 >= 3
+  assert_false 3 == 4
+  assert_equal :early, test_const_branch
+  assert_equal 5, (if nil then 1 else 5 end)
+  assert_equal 1, (while true; break 1; end)
+end
+
+assert('conditional jump chains') do
+  a = nil
+  b = 2
+  assert_equal 3, (a && b || 3)
+  assert_equal 2, (b && b || 3)
+  assert_equal 2, (a || b && b)
+  x = 0
+  x += 1 while x < 10 && !(x > 5 && x % 2 == 0)
+  assert_equal 6, x
+end
@@ -22,6 +22,8 @@ struct mrbc_args {
   mrb_bool check_syntax : 1;
   mrb_bool verbose      : 1;
   mrb_bool debug_info   : 1;
+  mrb_bool optimize     : 1;
+  mrb_bool frozen_str   : 1;
 };
 
 static void
@@ -33,8 +35,10 @@ usage(const char *name)
   "-o<outfile>  place the output into <outfile>",
   "-v           print version number, then turn on verbose mode",
   "-g           produce debugging information",
+  "-O           optimize generated code",
   "-B<symbol>   binary <symbol> output in C language format",
   "--verbose    run at verbose mode",
+  "--frozen-string-literal  freeze string literals, as the magic comment does",
   "--version    print the version",
   "--copyright  print the copyright",
   NULL
@@ -119,6 +123,9 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct mrbc_args *args)
       case 'g':
         args->debug_info = 1;
         break;
+      case 'O':
+        args->optimize = 1;
+        break;
       case 'h':
         return -1;
       case '-':
@@ -133,6 +140,10 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct mrbc_args *args)
           args->verbose = 1;
           break;
         }
+        else if (strcmp(argv[i] + 2, "frozen-string-literal") == 0) {
+          args->frozen_str = 1;
+          break;
+        }
         else if (strcmp(argv[i] + 2, "copyright") == 0) {
           mrb_show_copyright(mrb);
           exit(EXIT_SUCCESS);
@@ -191,6 +202,10 @@ load_file(mrb_state *mrb, struct mrbc_args *args)
   c = mrbc_context_new(mrb);
   if (args->verbose)
     c->dump_result = 1;
+  if (args->optimize)
+    c->optimize = 1;
+  if (args->frozen_str)
+    c->frozen_string_literal = 1;
   c->no_exec = 1;
   if (input[0] == '-' && input[1] == '\0') {
     infile = stdin;